@@ -5,6 +5,7 @@
 #include "HttpClient/DataCompress.h"
 
 HTTPMultipartUpload::HTTPMultipartUpload()
+: _maxSendSpeed(0)
 {
 
 }
@@ -63,6 +64,13 @@ void HTTPMultipartUpload::setParameters( unordered_map<string, string>& paramete
     _parameters = parameters;
 }
 
+// Dumps are bulk data: they upload at background priority, so they get the smallest
+// share of HttpClient's bandwidth budget, and at most bytesPerSecond when set
+void HTTPMultipartUpload::setMaxSendSpeed( long long bytesPerSecond )
+{
+    _maxSendSpeed = bytesPerSecond;
+}
+
 void HTTPMultipartUpload::addFileAtPath( string path, string name )
 {
     _filesOfPath[name] = path;
@@ -111,6 +119,8 @@ std::string HTTPMultipartUpload::send( int& errorCode )
 
     req->setRequestData((char*)compressData, compressLen);
     req->setRequestType(network::HttpRequest::Type::POST);
+    req->setPriority(network::HttpRequest::Priority::BACKGROUND);
+    req->setMaxSendSpeed(_maxSendSpeed);
 
     string data = network::HttpClient::getInstance()->sendSynchronousRequest(req,errorCode);
 
@@ -1,9 +1,14 @@
 
 #include <string>
+#include <stdio.h>
 #include <stdarg.h>
 #include <unordered_map>
 #include "HttpClient/Buffer.h"
 
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define vsnprintf _vsnprintf
+#endif
+
 using namespace std;
 using namespace network;
 
@@ -12,7 +17,7 @@ static string formatStr(const char* format, ...)
     char buf[1024]= {0};
     va_list arglist;
     va_start(arglist, format);
-    _vsnprintf(buf, 1024, format, arglist);
+    vsnprintf(buf, 1024, format, arglist);
     va_end(arglist);
     return buf;
 }
@@ -87,6 +92,7 @@ public:
     void setParameters(unordered_map<string, string>& parameters);
     void addFileAtPath(string path, string name);
     void addFileContents(Buffer<char>& contents, string name);
+    void setMaxSendSpeed(long long bytesPerSecond);
     string send(int& errorCode);
 
 
@@ -99,6 +105,7 @@ private:
     string _boundary;
     string _minidumpID;
     string _url;
+    long long _maxSendSpeed;
     unordered_map<string, string>        _parameters;
     unordered_map<string, string>        _filesOfPath;
     //unordered_map<string, Buffer<char> > _filesOfData;
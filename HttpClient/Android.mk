@@ -5,7 +5,19 @@ LOCAL_MODULE := cocos_network_static
 
 LOCAL_MODULE_FILENAME := libnetwork
 
-LOCAL_SRC_FILES := HttpClient.cpp
+LOCAL_SRC_FILES := HttpClient.cpp \
+                   HttpCache.cpp \
+                   HttpMemoryCache.cpp \
+                   HttpRequestScheduler.cpp \
+                   HttpLatencyTracker.cpp \
+                   HttpTimerWheel.cpp \
+                   HttpRetryBudget.cpp \
+                   HttpConcurrencyLimiter.cpp \
+                   HttpExecutor.cpp \
+                   HttpCompletionQueue.cpp \
+                   HttpMetrics.cpp \
+                   HttpTrace.cpp \
+                   HttpAllocations.cpp
 
 LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/..
 
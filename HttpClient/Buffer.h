@@ -8,9 +8,11 @@
 #ifndef Foundation_Buffer_h
 #define Foundation_Buffer_h
 
+#include <cassert>
 #include <cstring>
 #include <cstddef>
 #include <memory>
+#include <stdexcept>
 
 namespace network {
 
@@ -108,7 +110,7 @@ public:
     void resize(std::size_t newCapacity, bool preserveContent = true)
     {
         if (!m_ownMem)
-            throw std::exception("Cannot resize buffer which does not own its storage.");
+            throw std::logic_error("Cannot resize buffer which does not own its storage.");
 
         if (newCapacity > m_capacity)
         {
@@ -139,7 +141,7 @@ public:
     void setCapacity(std::size_t newCapacity, bool preserveContent = true)
     {
         if (!m_ownMem)
-            throw std::exception("Cannot resize buffer which does not own its storage.");
+            throw std::logic_error("Cannot resize buffer which does not own its storage.");
 
         if (newCapacity != m_capacity)
         {
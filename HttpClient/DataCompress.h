@@ -0,0 +1,74 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __DATA_COMPRESS_H__
+#define __DATA_COMPRESS_H__
+
+#include <string.h>
+#include "zlib.h"
+
+namespace network {
+
+/**
+ * Compress data into a gzip stream, e.g. for a "Content-Encoding: gzip" request body.
+ * @param data     bytes to compress
+ * @param ndata    number of bytes in data
+ * @param zdata    buffer the gzip stream is written to
+ * @param nzdata   in: size of zdata, out: size of the gzip stream
+ * @return 0 on success, -1 if zlib failed or the stream didn't fit in zdata
+ */
+inline int gzcompress(Bytef* data, uLong ndata, Bytef* zdata, uLong* nzdata)
+{
+    if (!data || !zdata || !nzdata)
+    {
+        return -1;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // MAX_WBITS + 16 asks zlib for a gzip header and trailer instead of a zlib one
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return -1;
+    }
+
+    stream.next_in = data;
+    stream.avail_in = (uInt)ndata;
+    stream.next_out = zdata;
+    stream.avail_out = (uInt)*nzdata;
+    int result = deflate(&stream, Z_FINISH);
+    uLong written = stream.total_out;
+    deflateEnd(&stream);
+
+    // anything short of the end of the stream means zdata was too small
+    if (result != Z_STREAM_END)
+    {
+        return -1;
+    }
+    *nzdata = written;
+    return 0;
+}
+
+}
+
+#endif //__DATA_COMPRESS_H__
@@ -0,0 +1,182 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_ALLOCATION_HOOKS_H__
+#define __HTTP_ALLOCATION_HOOKS_H__
+
+// Replaces the global operator new and delete so HttpAllocations sees every C++ heap
+// allocation of the program. Include it in exactly one source file of the application,
+// e.g. the one with main(), and only in builds that want allocation accounting.
+
+#include <stdlib.h>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include "HttpAllocations.h"
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define HTTP_ALLOCATION_HOOKS_NOEXCEPT throw()
+#else
+#define HTTP_ALLOCATION_HOOKS_NOEXCEPT noexcept
+#endif
+
+void* operator new(size_t size)
+{
+    network::HttpAllocations::recordAllocation(size);
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    network::HttpAllocations::recordAllocation(size);
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* ptr) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    free(ptr);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void* ptr, size_t) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    free(ptr);
+}
+#endif
+
+#if defined(__cpp_aligned_new)
+// over-aligned types, std::align_val_t, come here instead, from C++17 on
+static void* httpAllocationHooksAlignedAlloc(size_t size, std::align_val_t alignment) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    network::HttpAllocations::recordAllocation(size);
+    size_t align = static_cast<size_t>(alignment) < sizeof(void*) ? sizeof(void*) : static_cast<size_t>(alignment);
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, align);
+#else
+    void* ptr = nullptr;
+    return posix_memalign(&ptr, align, size ? size : 1) == 0 ? ptr : nullptr;
+#endif
+}
+
+static void httpAllocationHooksAlignedFree(void* ptr) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* ptr = httpAllocationHooksAlignedAlloc(size, alignment);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    return httpAllocationHooksAlignedAlloc(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    return httpAllocationHooksAlignedAlloc(size, alignment);
+}
+
+void operator delete(void* ptr, std::align_val_t) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    httpAllocationHooksAlignedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    httpAllocationHooksAlignedFree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    httpAllocationHooksAlignedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    httpAllocationHooksAlignedFree(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    httpAllocationHooksAlignedFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) HTTP_ALLOCATION_HOOKS_NOEXCEPT
+{
+    httpAllocationHooksAlignedFree(ptr);
+}
+#endif
+
+#endif //__HTTP_ALLOCATION_HOOKS_H__
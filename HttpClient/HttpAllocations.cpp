@@ -0,0 +1,232 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "curl/curl.h"
+#include "HttpAllocations.h"
+
+namespace network {
+
+enum
+{
+    MAX_THREADS = 64,
+    RELEASED = 2       /// owner of a slot given back, thread hashes are odd
+};
+
+namespace {
+
+// Phase of one thread inside a marked phase. A thread claims a slot along its probe sequence
+// when it enters a phase and gives it back when it returns to OTHER, leaving a marker behind so
+// lookups keep probing past it. Only threads in a phase at the same time compete for slots
+struct ThreadPhase
+{
+    ThreadPhase()
+    : owner(0)
+    , phase(HttpAllocations::OTHER)
+    {
+    }
+
+    std::atomic<size_t> owner;  /// hash of the thread's id, 0 while never claimed, RELEASED once given back
+    std::atomic<int>    phase;
+};
+
+struct PhaseCounters
+{
+    PhaseCounters()
+    : allocations(0)
+    , bytes(0)
+    {
+    }
+
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytes;
+};
+
+}
+
+std::atomic<bool> HttpAllocations::s_enabled(false);
+std::atomic<uint64_t> HttpAllocations::s_requests(0);
+static ThreadPhase s_threads[MAX_THREADS];
+static PhaseCounters s_counters[HttpAllocations::PHASE_COUNT];
+
+static size_t currentThread()
+{
+    std::hash<std::thread::id> hasher;
+    return hasher(std::this_thread::get_id()) | 1;
+}
+
+// The calling thread's slot, null if it has none
+static ThreadPhase* findThread(size_t self)
+{
+    size_t start = self % MAX_THREADS;
+    for (size_t i = 0; i < MAX_THREADS; ++i)
+    {
+        ThreadPhase& slot = s_threads[(start + i) % MAX_THREADS];
+        size_t owner = slot.owner.load(std::memory_order_acquire);
+        if (owner == self)
+        {
+            return &slot;
+        }
+        if (owner == 0)
+        {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+// Claim the first free slot of the calling thread's probe sequence, null if all are taken
+static ThreadPhase* claimThread(size_t self)
+{
+    size_t start = self % MAX_THREADS;
+    for (size_t i = 0; i < MAX_THREADS; ++i)
+    {
+        ThreadPhase& slot = s_threads[(start + i) % MAX_THREADS];
+        size_t owner = slot.owner.load(std::memory_order_relaxed);
+        if ((owner == 0 || owner == RELEASED) && slot.owner.compare_exchange_strong(owner, self))
+        {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+// libcurl's allocator, counted toward the phase of the thread calling into libcurl
+static void* countedMalloc(size_t size)
+{
+    HttpAllocations::recordAllocation(size);
+    return malloc(size);
+}
+
+static void countedFree(void* ptr)
+{
+    free(ptr);
+}
+
+static void* countedRealloc(void* ptr, size_t size)
+{
+    HttpAllocations::recordAllocation(size);
+    return realloc(ptr, size);
+}
+
+static char* countedStrdup(const char* str)
+{
+    size_t size = strlen(str) + 1;
+    char* copy = (char*)countedMalloc(size);
+    if (copy)
+    {
+        memcpy(copy, str, size);
+    }
+    return copy;
+}
+
+static void* countedCalloc(size_t count, size_t size)
+{
+    HttpAllocations::recordAllocation(count * size);
+    return calloc(count, size);
+}
+
+void HttpAllocations::enable(bool enable)
+{
+    if (enable)
+    {
+        // only takes effect before libcurl's first initialization, later calls just bump its init count
+        static bool hooked = curl_global_init_mem(CURL_GLOBAL_ALL, countedMalloc, countedFree, countedRealloc, countedStrdup, countedCalloc) == CURLE_OK;
+        (void)hooked;
+    }
+    s_enabled.store(enable, std::memory_order_relaxed);
+}
+
+void HttpAllocations::reset()
+{
+    s_requests.store(0, std::memory_order_relaxed);
+    for (int phase = 0; phase < PHASE_COUNT; ++phase)
+    {
+        s_counters[phase].allocations.store(0, std::memory_order_relaxed);
+        s_counters[phase].bytes.store(0, std::memory_order_relaxed);
+    }
+}
+
+HttpAllocations::Stats HttpAllocations::getStats()
+{
+    Stats stats;
+    stats.requests = s_requests.load(std::memory_order_relaxed);
+    for (int phase = 0; phase < PHASE_COUNT; ++phase)
+    {
+        stats.phases[phase].allocations = s_counters[phase].allocations.load(std::memory_order_relaxed);
+        stats.phases[phase].bytes = s_counters[phase].bytes.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+HttpAllocations::Counters HttpAllocations::Stats::client() const
+{
+    Counters sum;
+    for (int phase = SUBMIT; phase <= DISPATCH; ++phase)
+    {
+        sum.allocations += phases[phase].allocations;
+        sum.bytes += phases[phase].bytes;
+    }
+    return sum;
+}
+
+const char* HttpAllocations::phaseName(Phase phase)
+{
+    static const char* names[] = { "other", "create", "submit", "schedule", "start", "transfer", "finish", "dispatch", "callback" };
+    return phase >= 0 && phase < PHASE_COUNT ? names[phase] : "";
+}
+
+HttpAllocations::Phase HttpAllocations::enterPhase(Phase phase)
+{
+    size_t self = currentThread();
+    ThreadPhase* thread = findThread(self);
+    if (nullptr == thread)
+    {
+        if (OTHER == phase || nullptr == (thread = claimThread(self)))
+        {
+            return OTHER;
+        }
+    }
+    Phase previous = (Phase)thread->phase.exchange(phase, std::memory_order_relaxed);
+    if (OTHER == phase)
+    {
+        thread->owner.store(RELEASED, std::memory_order_release);
+    }
+    return previous;
+}
+
+void HttpAllocations::recordAllocation(size_t bytes)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    ThreadPhase* thread = findThread(currentThread());
+    int phase = thread ? thread->phase.load(std::memory_order_relaxed) : OTHER;
+    s_counters[phase].allocations.fetch_add(1, std::memory_order_relaxed);
+    s_counters[phase].bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+}
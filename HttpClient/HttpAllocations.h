@@ -0,0 +1,159 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_ALLOCATIONS_H__
+#define __HTTP_ALLOCATIONS_H__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Opt-in accounting of heap allocations by request phase.
+ * HttpClient marks the phase each of its threads is in, and every allocation counts
+ * toward the phase of the thread making it. The C++ allocations are seen through the
+ * operator new replacements of HttpAllocationHooks.h, which the application includes
+ * in one of its source files, libcurl's through curl_global_init_mem(), installed by
+ * enable() if it runs before the first request. Only allocations are counted, not frees.
+ * While accounting is disabled every phase mark costs one relaxed load and a branch.
+ */
+class HttpAllocations
+{
+public:
+    enum Phase
+    {
+        OTHER,          /// threads or code HttpClient doesn't mark, e.g. the rest of the application
+        CREATE,         /// building requests, marked by the application with HttpAllocationScope
+        SUBMIT,         /// handing requests to HttpClient
+        SCHEDULE,       /// the network thread's own bookkeeping
+        START,          /// setting up transfers: headers, curl handle and options
+        TRANSFER,       /// libcurl moving data, response buffers growing
+        FINISH,         /// reading the outcome, caches, retries and queueing the response
+        DISPATCH,       /// handing responses to callbacks, executors and completion queues
+        CALLBACK,       /// the application's callbacks
+        PHASE_COUNT
+    };
+
+    struct Counters
+    {
+        Counters()
+        : allocations(0)
+        , bytes(0)
+        {
+        }
+
+        uint64_t allocations;
+        uint64_t bytes;
+    };
+
+    struct Stats
+    {
+        Stats()
+        : requests(0)
+        {
+        }
+
+        /** Sum of the phases inside HttpClient, SUBMIT to DISPATCH */
+        Counters client() const;
+
+        uint64_t requests;              /// requests submitted while accounting was enabled
+        Counters phases[PHASE_COUNT];
+    };
+
+    /** Start or stop counting. Enabling before the first request also counts libcurl's allocations */
+    static void enable(bool enable);
+
+    inline static bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    /** Zero every counter */
+    static void reset();
+
+    static Stats getStats();
+
+    static const char* phaseName(Phase phase);
+
+    /** Make phase the calling thread's, returns the one it replaces */
+    static Phase enterPhase(Phase phase);
+
+    /** Count an allocation of the calling thread, from an allocator hook. Never allocates */
+    static void recordAllocation(size_t bytes);
+
+    /** Count submitted requests, from HttpClient */
+    inline static void recordRequests(size_t count)
+    {
+        if (isEnabled())
+        {
+            s_requests.fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static std::atomic<bool>        s_enabled;
+    static std::atomic<uint64_t>    s_requests;
+};
+
+/** @brief Puts the calling thread in a phase for the lifetime of a scope */
+class HttpAllocationScope
+{
+public:
+    explicit HttpAllocationScope(HttpAllocations::Phase phase)
+    : _active(HttpAllocations::isEnabled())
+    , _previous(HttpAllocations::OTHER)
+    {
+        if (_active)
+        {
+            _previous = HttpAllocations::enterPhase(phase);
+        }
+    }
+
+    ~HttpAllocationScope()
+    {
+        if (_active)
+        {
+            HttpAllocations::enterPhase(_previous);
+        }
+    }
+
+private:
+    HttpAllocationScope(const HttpAllocationScope&);
+    HttpAllocationScope& operator=(const HttpAllocationScope&);
+
+    bool                    _active;
+    HttpAllocations::Phase  _previous;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_ALLOCATIONS_H__
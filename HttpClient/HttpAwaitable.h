@@ -0,0 +1,139 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_AWAITABLE_H__
+#define __HTTP_AWAITABLE_H__
+
+#include "HttpClient.h"
+
+#if HTTP_CLIENT_HAS_COROUTINES
+
+#include <coroutine>
+#include "HttpExecutor.h"
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief What co_await HttpClient::send() waits on.
+ * Suspending queues the request, its response resumes the coroutine straight from the
+ * callback dispatch, or through the executor given to send(). The awaiter lives in the
+ * coroutine frame and the request's callback only holds a pointer to it, so nothing is
+ * allocated besides what any asynchronous request allocates. The request's own callback
+ * runs before the coroutine resumes, and is the request's callback again by then.
+ */
+class HttpRequestAwaiter
+{
+public:
+    HttpRequestAwaiter(HttpClient* client, HttpRequest::pointer request, HttpExecutor* executor)
+    : _client(client)
+    , _request(request)
+    , _executor(executor)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    /** Returns false, resuming right away, when the request couldn't be queued */
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        _handle = handle;
+        _callback = _request->getCallback();
+        _request->setResponseCallback([this](HttpClient* client, HttpResponse::pointer response) {
+            complete(client, response);
+        });
+
+        // the response may resume the coroutine, and destroy this awaiter, before sendAsynchronousRequest returns
+        HttpRequest::pointer request = _request;
+        if (_client->sendAsynchronousRequest(request))
+        {
+            return true;
+        }
+        request->setResponseCallback(_callback);
+        _response = HttpResponse::pointer(new HttpResponse(request));
+        _response->setErrorBuffer("request not sent");
+        return false;
+    }
+
+    HttpResponse::pointer await_resume()
+    {
+        return std::move(_response);
+    }
+
+private:
+    void complete(HttpClient* client, HttpResponse::pointer response)
+    {
+        // Put the request's own callback back while this awaiter is alive, the coroutine may
+        // destroy it once resumed. Nothing of the callback running now is touched after that
+        ccHttpRequestCallback callback;
+        callback.swap(_callback);
+        _request->setResponseCallback(callback);
+        if (callback)
+        {
+            callback(client, response);
+        }
+
+        _response = response;
+        if (_executor)
+        {
+            _executor->post(&HttpRequestAwaiter::resume, _handle.address());
+        }
+        else
+        {
+            _handle.resume();
+        }
+    }
+
+    static void resume(void* handle)
+    {
+        std::coroutine_handle<>::from_address(handle).resume();
+    }
+
+private:
+    HttpClient*                 _client;
+    HttpRequest::pointer        _request;
+    HttpExecutor*               _executor;   /// null to resume on the dispatching thread
+    ccHttpRequestCallback       _callback;   /// the request's own callback, run before resuming
+    std::coroutine_handle<>     _handle;
+    HttpResponse::pointer       _response;
+};
+
+inline HttpRequestAwaiter HttpClient::send(HttpRequest::pointer request, HttpExecutor* executor)
+{
+    return HttpRequestAwaiter(this, request, executor);
+}
+
+// end of Network group
+/// @}
+
+}
+
+#endif // HTTP_CLIENT_HAS_COROUTINES
+
+#endif //__HTTP_AWAITABLE_H__
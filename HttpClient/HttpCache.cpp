@@ -0,0 +1,853 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+#include "curl/curl.h"
+#include "HttpCache.h"
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
+namespace network {
+
+// First line of every entry file, bump it when the layout changes
+static const char* s_entryMagic = "HTTPCACHE 2";
+// First line of every vary file
+static const char* s_varyMagic = "HTTPVARY 1";
+
+static std::string toLower(const std::string& str)
+{
+    std::string lower(str);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    return lower;
+}
+
+static std::string trim(const std::string& str)
+{
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos)
+    {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
+// Split a comma separated header value, e.g. Cache-Control or Vary
+static std::vector<std::string> splitList(const std::string& value)
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= value.size())
+    {
+        size_t comma = value.find(',', start);
+        if (comma == std::string::npos)
+        {
+            comma = value.size();
+        }
+        std::string item = trim(value.substr(start, comma - start));
+        if (!item.empty())
+        {
+            items.push_back(item);
+        }
+        start = comma + 1;
+    }
+    return items;
+}
+
+// 64-bit FNV-1a, used to turn cache keys into file names
+static std::string hashKey(const std::string& key)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size(); ++i)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    char buf[17] = {0};
+    snprintf(buf, sizeof(buf), "%016llx", hash);
+    return buf;
+}
+
+// Read a line of any length, without its line break. False at the end of the file
+static bool readLine(FILE* fp, std::string& line)
+{
+    line.clear();
+    char chunk[256];
+    while (fgets(chunk, sizeof(chunk), fp))
+    {
+        line.append(chunk);
+        if (line[line.size() - 1] == '\n')
+        {
+            line.erase(line.size() - 1);
+            if (!line.empty() && line[line.size() - 1] == '\r')
+            {
+                line.erase(line.size() - 1);
+            }
+            return true;
+        }
+    }
+    return !line.empty();
+}
+
+// With redirects or 100-continue a header buffer holds several blocks, only the last one counts
+static size_t lastBlockStart(const std::string& raw)
+{
+    size_t blockStart = 0;
+    size_t pos = 0;
+    while ((pos = raw.find("HTTP/", pos)) != std::string::npos)
+    {
+        if (pos == 0 || raw[pos - 1] == '\n')
+        {
+            blockStart = pos;
+        }
+        pos += 5;
+    }
+    return blockStart;
+}
+
+// Lines of the last header block, status line first, without line breaks
+static std::vector<std::string> headerLines(const std::vector<char>& header)
+{
+    std::string raw(header.begin(), header.end());
+    std::vector<std::string> lines;
+    size_t start = lastBlockStart(raw);
+    while (start < raw.size())
+    {
+        size_t end = raw.find('\n', start);
+        if (end == std::string::npos)
+        {
+            end = raw.size();
+        }
+        std::string line = raw.substr(start, end - start);
+        if (!line.empty() && line[line.size() - 1] == '\r')
+        {
+            line.erase(line.size() - 1);
+        }
+        if (line.empty())
+        {
+            break;
+        }
+        lines.push_back(line);
+        start = end + 1;
+    }
+    return lines;
+}
+
+// Lower case name of a "Name: value" line, empty if it has none
+static std::string fieldName(const std::string& line)
+{
+    size_t colon = line.find(':');
+    return colon == std::string::npos ? "" : toLower(trim(line.substr(0, colon)));
+}
+
+// Fields of a stored response a 304 doesn't replace, they describe the stored body
+static bool describesBody(const std::string& name)
+{
+    return name == "content-length" || name == "content-encoding"
+        || name == "transfer-encoding" || name == "content-range";
+}
+
+static bool hasExtension(const std::string& name, const char* extension)
+{
+    size_t length = strlen(extension);
+    return name.size() > length && name.compare(name.size() - length, length, extension) == 0;
+}
+
+// Names of the entries of directory
+static std::vector<std::string> listDirectory(const std::string& directory)
+{
+    std::vector<std::string> names;
+#ifdef _WIN32
+    struct _finddata_t data;
+    intptr_t handle = _findfirst((directory + "*").c_str(), &data);
+    if (handle != -1)
+    {
+        do
+        {
+            names.push_back(data.name);
+        } while (_findnext(handle, &data) == 0);
+        _findclose(handle);
+    }
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (dir)
+    {
+        struct dirent* item;
+        while ((item = readdir(dir)) != nullptr)
+        {
+            names.push_back(item->d_name);
+        }
+        closedir(dir);
+    }
+#endif
+    return names;
+}
+
+static time_t parseDate(const std::string& value)
+{
+    if (value.empty())
+    {
+        return 0;
+    }
+    time_t date = curl_getdate(value.c_str(), nullptr);
+    return date > 0 ? date : 0;
+}
+
+static void makeDirectory(const std::string& directory)
+{
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+}
+
+HttpCache::HttpCache(const std::string& directory, size_t maxSize)
+: _directory(directory)
+, _maxSize(maxSize)
+, _size(0)
+, _useClock(0)
+{
+    if (!_directory.empty() && _directory[_directory.size() - 1] != '/' && _directory[_directory.size() - 1] != '\\')
+    {
+        _directory += "/";
+    }
+    makeDirectory(_directory);
+    scanDirectory();
+    evict();
+}
+
+size_t HttpCache::getSize()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _size;
+}
+
+void HttpCache::scanDirectory()
+{
+    // Files left by a previous run count against the cap too, the oldest modified is the least recently used
+    std::vector<std::pair<time_t, std::string> > found;
+    std::vector<std::string> names = listDirectory(_directory);
+    for (std::vector<std::string>::iterator it = names.begin(); it != names.end(); ++it)
+    {
+        struct stat info;
+        std::string path = _directory + *it;
+        if ((hasExtension(*it, ".cache") || hasExtension(*it, ".vary")) && stat(path.c_str(), &info) == 0)
+        {
+            found.push_back(std::make_pair(info.st_mtime, path));
+            FileUse use;
+            use.size = (size_t)info.st_size;
+            use.lastUse = 0;
+            _files[path] = use;
+            _size += use.size;
+        }
+    }
+    std::sort(found.begin(), found.end());
+    for (std::vector<std::pair<time_t, std::string> >::iterator it = found.begin(); it != found.end(); ++it)
+    {
+        _files[it->second].lastUse = ++_useClock;
+    }
+}
+
+void HttpCache::touch(const std::string& path)
+{
+    std::map<std::string, FileUse>::iterator it = _files.find(path);
+    if (it != _files.end())
+    {
+        it->second.lastUse = ++_useClock;
+    }
+}
+
+void HttpCache::deleteFile(const std::string& path)
+{
+    ::remove(path.c_str());
+    std::map<std::string, FileUse>::iterator it = _files.find(path);
+    if (it != _files.end())
+    {
+        _size -= it->second.size;
+        _files.erase(it);
+    }
+}
+
+void HttpCache::evict()
+{
+    if (_size <= _maxSize)
+    {
+        return;
+    }
+
+    // Least recently used first, down to 90% of the cap so the next stores don't each evict a file
+    std::vector<std::pair<unsigned long long, std::string> > order;
+    for (std::map<std::string, FileUse>::iterator it = _files.begin(); it != _files.end(); ++it)
+    {
+        order.push_back(std::make_pair(it->second.lastUse, it->first));
+    }
+    std::sort(order.begin(), order.end());
+
+    size_t target = _maxSize / 10 * 9;
+    for (std::vector<std::pair<unsigned long long, std::string> >::iterator it = order.begin(); it != order.end() && _size > target; ++it)
+    {
+        deleteFile(it->second);
+    }
+}
+
+bool HttpCache::findHeader(const std::vector<std::string>& headers, const std::string& name, std::string& value)
+{
+    std::string lowerName = toLower(name);
+    for (std::vector<std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+    {
+        size_t colon = it->find(':');
+        if (colon == std::string::npos)
+        {
+            continue;
+        }
+        if (toLower(trim(it->substr(0, colon))) == lowerName)
+        {
+            value = trim(it->substr(colon + 1));
+            return true;
+        }
+    }
+    return false;
+}
+
+HttpCache::Policy HttpCache::parsePolicy(const std::vector<char>& header)
+{
+    Policy policy;
+    std::string raw(header.begin(), header.end());
+
+    bool sawCacheControl = false;
+    bool pragmaNoCache = false;
+    size_t lineStart = raw.find('\n', lastBlockStart(raw));
+    while (lineStart != std::string::npos && lineStart < raw.size())
+    {
+        ++lineStart;
+        size_t lineEnd = raw.find('\n', lineStart);
+        std::string line = raw.substr(lineStart, lineEnd == std::string::npos ? std::string::npos : lineEnd - lineStart);
+        lineStart = lineEnd;
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+        {
+            continue;
+        }
+        std::string name = toLower(trim(line.substr(0, colon)));
+        std::string value = trim(line.substr(colon + 1));
+
+        if (name == "cache-control")
+        {
+            sawCacheControl = true;
+            std::vector<std::string> directives = splitList(value);
+            for (std::vector<std::string>::iterator it = directives.begin(); it != directives.end(); ++it)
+            {
+                std::string directive = toLower(*it);
+                if (directive == "no-store")
+                {
+                    policy.noStore = true;
+                }
+                else if (directive == "no-cache")
+                {
+                    policy.noCache = true;
+                }
+                else if (directive.compare(0, 8, "max-age=") == 0)
+                {
+                    policy.maxAge = atol(directive.c_str() + 8);
+                }
+            }
+        }
+        else if (name == "pragma")
+        {
+            pragmaNoCache = toLower(value).find("no-cache") != std::string::npos;
+        }
+        else if (name == "age")
+        {
+            policy.age = atol(value.c_str());
+        }
+        else if (name == "date")
+        {
+            policy.date = parseDate(value);
+        }
+        else if (name == "expires")
+        {
+            // An invalid Expires, e.g. "0", means already expired
+            policy.expires = parseDate(value);
+            if (policy.expires == 0)
+            {
+                policy.expires = 1;
+            }
+        }
+        else if (name == "etag")
+        {
+            policy.etag = value;
+        }
+        else if (name == "last-modified")
+        {
+            policy.lastModified = value;
+        }
+        else if (name == "vary")
+        {
+            std::vector<std::string> names = splitList(value);
+            for (std::vector<std::string>::iterator it = names.begin(); it != names.end(); ++it)
+            {
+                if (*it == "*")
+                {
+                    policy.varyAll = true;
+                }
+                else
+                {
+                    policy.vary.push_back(toLower(*it));
+                }
+            }
+        }
+    }
+
+    if (!sawCacheControl && pragmaNoCache)
+    {
+        policy.noCache = true;
+    }
+    return policy;
+}
+
+time_t HttpCache::freshnessExpiry(const Policy& policy, time_t now)
+{
+    if (policy.noCache)
+    {
+        return 0;
+    }
+
+    long lifetime = 0;
+    if (policy.maxAge >= 0)
+    {
+        lifetime = policy.maxAge;
+    }
+    else if (policy.expires != 0)
+    {
+        time_t base = policy.date != 0 ? policy.date : now;
+        lifetime = (long)(policy.expires - base);
+    }
+
+    long remaining = lifetime - policy.age;
+    return remaining > 0 ? now + remaining : 0;
+}
+
+bool HttpCache::isFresh(const Entry& entry, time_t now)
+{
+    return entry.expiresAt > now;
+}
+
+void HttpCache::requestDirectives(HttpRequest::pointer request, bool& noStore, bool& noCache)
+{
+    noStore = false;
+    noCache = false;
+    std::string value;
+    if (findHeader(request->getHeaders(), "Cache-Control", value))
+    {
+        std::string lower = toLower(value);
+        noStore = lower.find("no-store") != std::string::npos;
+        noCache = lower.find("no-cache") != std::string::npos || lower.find("max-age=0") != std::string::npos;
+    }
+    else if (findHeader(request->getHeaders(), "Pragma", value))
+    {
+        noCache = toLower(value).find("no-cache") != std::string::npos;
+    }
+}
+
+std::vector<std::string> HttpCache::conditionalHeaders(const Entry& entry)
+{
+    std::vector<std::string> headers;
+    if (!entry.etag.empty())
+    {
+        headers.push_back("If-None-Match: " + entry.etag);
+    }
+    if (!entry.lastModified.empty())
+    {
+        headers.push_back("If-Modified-Since: " + entry.lastModified);
+    }
+    return headers;
+}
+
+std::string HttpCache::variantKey(HttpRequest::pointer request, const std::vector<std::string>& vary)
+{
+    std::string key(request->getUrl());
+    std::vector<std::string> headers = request->getHeaders();
+    for (std::vector<std::string>::const_iterator it = vary.begin(); it != vary.end(); ++it)
+    {
+        std::string value;
+        findHeader(headers, *it, value);
+        key.append("\n").append(*it).append(": ").append(value);
+    }
+    return key;
+}
+
+std::string HttpCache::pathForKey(const std::string& key, const char* extension)
+{
+    return _directory + hashKey(key) + extension;
+}
+
+bool HttpCache::readVary(const std::string& url, VaryFile& vary)
+{
+    vary.vary.clear();
+    vary.variants.clear();
+    FILE* fp = fopen(pathForKey(url, ".vary").c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    // A file written for another url whose hash collides is a miss
+    std::string line;
+    bool ok = readLine(fp, line) && line == s_varyMagic && readLine(fp, line) && line == url;
+    if (ok)
+    {
+        // vary header names, an empty line, then the variant file names
+        std::vector<std::string>* list = &vary.vary;
+        while (readLine(fp, line))
+        {
+            std::string name = trim(line);
+            if (name.empty())
+            {
+                list = &vary.variants;
+            }
+            else
+            {
+                list->push_back(name);
+            }
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+bool HttpCache::writeVary(const std::string& url, const VaryFile& vary)
+{
+    std::string data(s_varyMagic);
+    data.append("\n").append(url).append("\n");
+    for (std::vector<std::string>::const_iterator it = vary.vary.begin(); it != vary.vary.end(); ++it)
+    {
+        data.append(*it).append("\n");
+    }
+    data.append("\n");
+    for (std::vector<std::string>::const_iterator it = vary.variants.begin(); it != vary.variants.end(); ++it)
+    {
+        data.append(*it).append("\n");
+    }
+    return writeFile(pathForKey(url, ".vary"), data);
+}
+
+bool HttpCache::readEntry(const std::string& path, const std::string& key, Entry& entry)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    bool ok = false;
+    size_t keySize = 0;
+    size_t headerSize = 0;
+    size_t bodySize = 0;
+    std::string line;
+    do
+    {
+        if (!readLine(fp, line) || line != s_entryMagic)
+            break;
+
+        // key/value lines until the empty separator line
+        bool complete = false;
+        while (readLine(fp, line))
+        {
+            std::string field = trim(line);
+            if (field.empty())
+            {
+                complete = true;
+                break;
+            }
+            size_t space = field.find(' ');
+            std::string name = field.substr(0, space);
+            std::string value = space == std::string::npos ? "" : field.substr(space + 1);
+            if (name == "code")
+                entry.responseCode = atol(value.c_str());
+            else if (name == "stored")
+                entry.storedAt = (time_t)atoll(value.c_str());
+            else if (name == "expires")
+                entry.expiresAt = (time_t)atoll(value.c_str());
+            else if (name == "etag")
+                entry.etag = value;
+            else if (name == "lastmod")
+                entry.lastModified = value;
+            else if (name == "key")
+                keySize = (size_t)atoll(value.c_str());
+            else if (name == "header")
+                headerSize = (size_t)atoll(value.c_str());
+            else if (name == "body")
+                bodySize = (size_t)atoll(value.c_str());
+        }
+        if (!complete || keySize != key.size())
+            break;
+
+        // The file name is only a hash of the key, the entry must be for this very key
+        std::string storedKey(keySize, '\0');
+        if (keySize && fread(&storedKey[0], 1, keySize, fp) != keySize)
+            break;
+        if (storedKey != key)
+            break;
+
+        entry.header.resize(headerSize);
+        entry.body.resize(bodySize);
+        if (headerSize && fread(&entry.header.front(), 1, headerSize, fp) != headerSize)
+            break;
+        if (bodySize && fread(&entry.body.front(), 1, bodySize, fp) != bodySize)
+            break;
+        ok = true;
+    } while (0);
+
+    fclose(fp);
+    return ok;
+}
+
+bool HttpCache::writeFile(const std::string& path, const std::string& data)
+{
+    // Write next to the destination and rename, so readers never see a partial file
+    std::string tmpPath = path + ".tmp";
+    FILE* fp = fopen(tmpPath.c_str(), "wb");
+    if (!fp)
+    {
+        return false;
+    }
+    bool ok = data.empty() || fwrite(data.data(), 1, data.size(), fp) == data.size();
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok)
+    {
+        ::remove(tmpPath.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    ::remove(path.c_str());
+#endif
+    if (rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        ::remove(tmpPath.c_str());
+        return false;
+    }
+
+    FileUse& use = _files[path];
+    _size = _size - use.size + data.size();
+    use.size = data.size();
+    use.lastUse = ++_useClock;
+    return true;
+}
+
+bool HttpCache::writeEntry(const std::string& path, const std::string& key, const Entry& entry)
+{
+    char fields[256];
+    snprintf(fields, sizeof(fields), "%s\ncode %ld\nstored %lld\nexpires %lld\n",
+             s_entryMagic, entry.responseCode, (long long)entry.storedAt, (long long)entry.expiresAt);
+
+    std::string data(fields);
+    data.append("etag ").append(entry.etag).append("\n");
+    data.append("lastmod ").append(entry.lastModified).append("\n");
+
+    snprintf(fields, sizeof(fields), "key %lu\nheader %lu\nbody %lu\n\n",
+             (unsigned long)key.size(), (unsigned long)entry.header.size(), (unsigned long)entry.body.size());
+    data.append(fields);
+    data.append(key);
+    data.append(entry.header.begin(), entry.header.end());
+    data.append(entry.body.begin(), entry.body.end());
+    return writeFile(path, data);
+}
+
+bool HttpCache::lookup(HttpRequest::pointer request, Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    VaryFile vary;
+    if (!readVary(request->getUrl(), vary))
+    {
+        return false;
+    }
+    std::string key = variantKey(request, vary.vary);
+    std::string path = pathForKey(key, ".cache");
+    if (!readEntry(path, key, entry))
+    {
+        return false;
+    }
+    touch(path);
+    touch(pathForKey(request->getUrl(), ".vary"));
+    return true;
+}
+
+bool HttpCache::store(HttpRequest::pointer request, long responseCode, const std::vector<char>& header, const std::vector<char>& body)
+{
+    if (responseCode != 200)
+    {
+        return false;
+    }
+
+    Policy policy = parsePolicy(header);
+    if (policy.noStore || policy.varyAll)
+    {
+        return false;
+    }
+
+    time_t now = time(nullptr);
+    Entry entry;
+    entry.responseCode = responseCode;
+    entry.storedAt = now;
+    entry.expiresAt = freshnessExpiry(policy, now);
+    entry.etag = policy.etag;
+    entry.lastModified = policy.lastModified;
+
+    // Nothing to gain from an entry that is stale and can't be revalidated
+    if (!isFresh(entry, now) && entry.etag.empty() && entry.lastModified.empty())
+    {
+        return false;
+    }
+
+    // An entry over the cap would only evict everything else and then itself
+    std::string key = variantKey(request, policy.vary);
+    if (key.size() + header.size() + body.size() > _maxSize)
+    {
+        return false;
+    }
+    entry.header = header;
+    entry.body = body;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    VaryFile vary;
+    if (readVary(request->getUrl(), vary) && vary.vary != policy.vary)
+    {
+        // Variants keyed on other request headers can't be found anymore
+        for (std::vector<std::string>::iterator it = vary.variants.begin(); it != vary.variants.end(); ++it)
+        {
+            deleteFile(_directory + *it);
+        }
+        vary.variants.clear();
+    }
+    vary.vary = policy.vary;
+
+    std::string fileName = hashKey(key) + ".cache";
+    if (std::find(vary.variants.begin(), vary.variants.end(), fileName) == vary.variants.end())
+    {
+        vary.variants.push_back(fileName);
+    }
+    bool ok = writeVary(request->getUrl(), vary) && writeEntry(_directory + fileName, key, entry);
+    evict();
+    return ok;
+}
+
+std::vector<char> HttpCache::mergeHeaders(const std::vector<char>& stored, const std::vector<char>& notModified)
+{
+    std::vector<std::string> updates;
+    std::vector<std::string> updatedNames;
+    std::vector<std::string> notModifiedLines = headerLines(notModified);
+    for (size_t i = 1; i < notModifiedLines.size(); ++i)
+    {
+        std::string name = fieldName(notModifiedLines[i]);
+        if (!name.empty() && !describesBody(name))
+        {
+            updates.push_back(notModifiedLines[i]);
+            updatedNames.push_back(name);
+        }
+    }
+
+    std::string merged;
+    std::vector<std::string> storedLines = headerLines(stored);
+    for (size_t i = 0; i < storedLines.size(); ++i)
+    {
+        if (i > 0)
+        {
+            // The stored Age is about the old message, the 304 is the one just received
+            std::string name = fieldName(storedLines[i]);
+            if (name == "age" || std::find(updatedNames.begin(), updatedNames.end(), name) != updatedNames.end())
+            {
+                continue;
+            }
+        }
+        merged.append(storedLines[i]).append("\r\n");
+    }
+    for (std::vector<std::string>::iterator it = updates.begin(); it != updates.end(); ++it)
+    {
+        merged.append(*it).append("\r\n");
+    }
+    merged.append("\r\n");
+    return std::vector<char>(merged.begin(), merged.end());
+}
+
+void HttpCache::revalidate(Entry& entry, const std::vector<char>& notModifiedHeader, time_t now)
+{
+    entry.header = mergeHeaders(entry.header, notModifiedHeader);
+    Policy policy = parsePolicy(entry.header);
+    entry.storedAt = now;
+    entry.expiresAt = freshnessExpiry(policy, now);
+    entry.etag = policy.etag;
+    entry.lastModified = policy.lastModified;
+}
+
+void HttpCache::refresh(HttpRequest::pointer request, Entry& entry, const std::vector<char>& notModifiedHeader)
+{
+    revalidate(entry, notModifiedHeader, time(nullptr));
+    update(request, entry);
+}
+
+void HttpCache::update(HttpRequest::pointer request, const Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    VaryFile vary;
+    if (readVary(request->getUrl(), vary))
+    {
+        std::string key = variantKey(request, vary.vary);
+        writeEntry(pathForKey(key, ".cache"), key, entry);
+        evict();
+    }
+}
+
+void HttpCache::remove(const char* url)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // A vary file that fails to read belongs to another url, leave it alone
+    VaryFile vary;
+    if (readVary(url, vary))
+    {
+        for (std::vector<std::string>::iterator it = vary.variants.begin(); it != vary.variants.end(); ++it)
+        {
+            deleteFile(_directory + *it);
+        }
+        deleteFile(pathForKey(url, ".vary"));
+    }
+}
+
+}
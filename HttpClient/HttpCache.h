@@ -0,0 +1,210 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __HTTP_CACHE_H__
+#define __HTTP_CACHE_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <ctime>
+#include "HttpRequest.h"
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Disk backed cache for GET responses.
+ * Entries are keyed by the request url plus the values of the request headers
+ * listed in the response's Vary header. Each entry keeps the raw header block
+ * and body exactly as HttpResponse collected them, together with the validators
+ * (ETag / Last-Modified) needed to revalidate it once it is stale.
+ * The files are named after a hash of the key, each one also records the full key
+ * so a hash collision reads as a miss. The directory is kept under a size cap by
+ * deleting the least recently used files.
+ */
+class HttpCache
+{
+public:
+    /** Caching related fields parsed out of a raw response header block */
+    struct Policy
+    {
+        Policy()
+        : noStore(false)
+        , noCache(false)
+        , maxAge(-1)
+        , age(0)
+        , date(0)
+        , expires(0)
+        , varyAll(false)
+        {
+        }
+
+        bool                     noStore;       /// Cache-Control: no-store
+        bool                     noCache;       /// Cache-Control: no-cache, always revalidate
+        long                     maxAge;        /// Cache-Control: max-age, -1 if absent
+        long                     age;           /// Age header in seconds
+        time_t                   date;          /// Date header, 0 if absent
+        time_t                   expires;       /// Expires header, 0 if absent
+        bool                     varyAll;       /// Vary: *, response can't be reused
+        std::string              etag;          /// ETag validator
+        std::string              lastModified;  /// Last-Modified validator
+        std::vector<std::string> vary;          /// request header names the response varies on
+    };
+
+    /** A stored response */
+    struct Entry
+    {
+        Entry()
+        : responseCode(0)
+        , storedAt(0)
+        , expiresAt(0)
+        {
+        }
+
+        long                     responseCode;  /// status code of the stored response
+        time_t                   storedAt;      /// local time the response was stored or revalidated
+        time_t                   expiresAt;     /// local time the entry stops being fresh
+        std::string              etag;
+        std::string              lastModified;
+        std::vector<char>        header;        /// raw header block as collected by HttpClient
+        std::vector<char>        body;          /// raw response body
+    };
+
+    enum
+    {
+        DEFAULT_MAX_SIZE = 50 * 1024 * 1024
+    };
+
+    /** Create a cache rooted at directory, the directory is created if missing.
+     @param maxSize bytes the cache files may take on disk, files left by a previous run included
+     */
+    explicit HttpCache(const std::string& directory, size_t maxSize = DEFAULT_MAX_SIZE);
+
+    /** Get back the cache directory */
+    inline const std::string& getDirectory() const
+    {
+        return _directory;
+    }
+
+    /** Bytes the cache files take on disk */
+    size_t getSize();
+
+    /** Get back the size cap */
+    inline size_t getMaxSize() const
+    {
+        return _maxSize;
+    }
+
+    /** Find the entry matching this request, fresh or not.
+     @return false if nothing is stored for the request
+     */
+    bool lookup(HttpRequest::pointer request, Entry& entry);
+
+    /** Store a response received for request, if its headers allow it.
+     @return true if the response was written to disk
+     */
+    bool store(HttpRequest::pointer request, long responseCode, const std::vector<char>& header, const std::vector<char>& body);
+
+    /** Revalidate entry with the header block of a 304 Not Modified response and write it back */
+    void refresh(HttpRequest::pointer request, Entry& entry, const std::vector<char>& notModifiedHeader);
+
+    /** Write back entry, already revalidated with revalidate() */
+    void update(HttpRequest::pointer request, const Entry& entry);
+
+    /** Merge the header fields of a 304 Not Modified response over entry's stored ones
+     * and recompute its freshness and validators from the result (RFC 7234 4.3.4).
+     */
+    static void revalidate(Entry& entry, const std::vector<char>& notModifiedHeader, time_t now);
+
+    /** The last header block of stored with the fields of notModified's last block replacing theirs.
+     * Fields describing the body, e.g. Content-Length, are kept from stored.
+     */
+    static std::vector<char> mergeHeaders(const std::vector<char>& stored, const std::vector<char>& notModified);
+
+    /** Drop every variant stored for url, used when an unsafe method hits the resource */
+    void remove(const char* url);
+
+    /** Build If-None-Match / If-Modified-Since header lines for revalidating entry */
+    static std::vector<std::string> conditionalHeaders(const Entry& entry);
+
+    /** True while entry can be served without contacting the server */
+    static bool isFresh(const Entry& entry, time_t now);
+
+    /** True if request headers ask to bypass (no-store) or revalidate (no-cache) the cache */
+    static void requestDirectives(HttpRequest::pointer request, bool& noStore, bool& noCache);
+
+    /** Parse the last header block found in a raw header buffer */
+    static Policy parsePolicy(const std::vector<char>& header);
+
+    /** Local time at which a response with policy, received at now, stops being fresh. 0 if it never is */
+    static time_t freshnessExpiry(const Policy& policy, time_t now);
+
+    /** Find a "Name: value" line in a custom header list, name is compared case insensitively */
+    static bool findHeader(const std::vector<std::string>& headers, const std::string& name, std::string& value);
+
+private:
+    /** Content of the .vary file stored per url */
+    struct VaryFile
+    {
+        std::vector<std::string> vary;      /// request header names the stored variants vary on
+        std::vector<std::string> variants;  /// file names of the variant entries
+    };
+
+    /** Size and last use of a file in the directory, for the size cap */
+    struct FileUse
+    {
+        size_t             size;
+        unsigned long long lastUse;   /// value of the use clock when last read or written
+    };
+
+    std::string variantKey(HttpRequest::pointer request, const std::vector<std::string>& vary);
+    std::string pathForKey(const std::string& key, const char* extension);
+    bool readVary(const std::string& url, VaryFile& vary);
+    bool writeVary(const std::string& url, const VaryFile& vary);
+    bool readEntry(const std::string& path, const std::string& key, Entry& entry);
+    bool writeEntry(const std::string& path, const std::string& key, const Entry& entry);
+    bool writeFile(const std::string& path, const std::string& data);
+    void deleteFile(const std::string& path);
+    void touch(const std::string& path);
+    void scanDirectory();
+    void evict();
+
+private:
+    std::string                     _directory;
+    size_t                          _maxSize;
+    size_t                          _size;      /// sum of the sizes in _files
+    std::map<std::string, FileUse>  _files;     /// cache files by path
+    unsigned long long              _useClock;  /// ticks on every file use, orders _files for eviction
+    std::mutex                      _mutex;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_CACHE_H__
@@ -28,32 +28,103 @@
 #include <condition_variable>
 #include <errno.h>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
 #include <assert.h>
+#include <ctime>
+#include <random>
 #include "curl/curl.h"
 #include "HttpClient.h"
+#include "HttpCache.h"
+#include "HttpMemoryCache.h"
+#include "HttpRequestScheduler.h"
+#include "HttpLatencyTracker.h"
+#include "HttpTimerWheel.h"
+#include "HttpRetryBudget.h"
+#include "HttpConcurrencyLimiter.h"
+#include "HttpExecutor.h"
+#include "HttpCompletionQueue.h"
+#include "HttpTrace.h"
+#include "HttpAllocations.h"
 
 namespace network {
 
 static std::mutex       s_requestQueueMutex;
 static std::mutex       s_responseQueueMutex;
 
-static std::mutex		s_SleepMutex;
+// The network thread sleeps on this, with s_requestQueueMutex, while it has no transfer running
 static std::condition_variable		s_SleepCondition;
 
+// Multi handle owned by the network thread, guarded by s_requestQueueMutex
+static CURLM* s_multiHandle = nullptr;
+
+#if LIBCURL_VERSION_NUM < 0x074400
+// Without curl_multi_wakeup the network thread can't be interrupted while it waits on sockets,
+// this bounds how late a newly queued request may be picked up
+static const long s_pollIntervalMs = 10;
+#endif
+
+// How long a hedge refused by its host's limit or rate waits before asking again
+static const long s_hedgeRecheckMs = 10;
+
 
 static bool s_need_quit = false;
 
-static std::vector<HttpRequest::pointer>*  s_requestQueue = nullptr;
+static HttpRequestScheduler*               s_requestQueue = nullptr; // queued requests, round robin across hosts
 static std::vector<HttpResponse::pointer>* s_responseQueue = nullptr;
 
 static HttpClient *s_pHttpClient = nullptr; // pointer to singleton
 
-static char s_errorBuffer[CURL_ERROR_SIZE] = {0};
-
 typedef size_t (*write_callback)(void *ptr, size_t size, size_t nmemb, void *stream);
 
 static std::string s_cookieFilename = "";
 
+static std::shared_ptr<HttpCache> s_cache; // disk cache for GET requests, null when disabled
+static std::shared_ptr<HttpMemoryCache> s_memoryCache; // memory cache in front of the disk cache, null when disabled
+static std::shared_ptr<HttpMetrics> s_metrics;         // client-wide metrics, null when disabled
+
+// Identical GETs submitted while one is in flight wait for its result instead of hitting the network again
+struct InFlightRequest
+{
+    HttpRequest::pointer                leader;     /// the request actually sent
+    std::vector<HttpRequest::pointer>   followers;  /// requests that get a copy of the leader's response
+};
+static std::atomic<bool> s_coalesceRequests(false);
+static std::mutex        s_inFlightMutex;
+static std::unordered_map<std::string, InFlightRequest> s_inFlightRequests;
+
+// Batch sizes responses were taken off s_responseQueue in
+static std::mutex               s_dispatchStatsMutex;
+static HttpClient::DispatchStats s_dispatchStats;
+
+// Set while a drain of the response queue is posted to the callback executor, so there is one at a time
+static std::atomic<bool> s_drainPosted(false);
+
+// Set by cancelRequest(), tells the network thread to look for cancelled requests
+static std::atomic<bool> s_cancelPending(false);
+
+struct HttpTransfer;
+
+// Transfers whose disk cache entry the cache worker has read, waiting for the network thread
+// to serve or send them. Guarded by s_requestQueueMutex
+static std::vector<HttpTransfer*> s_cacheLookups;
+
+// Latencies of recent successful transfers, the base of hedging delays
+static HttpLatencyTracker s_latencies;
+
+// Retries of every request draw from one budget, and their backoff from one random source
+static HttpRetryBudget s_retryBudget;
+static std::mutex      s_jitterMutex;
+static std::mt19937    s_jitter((unsigned int)time(nullptr));
+
+// Priority weights of the transfers sharing the bandwidth budget, asynchronous ones as of the
+// network thread's last split, synchronous ones while they run
+static std::atomic<long long> s_asyncBandwidthWeight(0);
+static std::atomic<long long> s_syncBandwidthWeight(0);
+
 // Callback function used by libcurl for collect response data
 static size_t writeData(void *ptr, size_t size, size_t nmemb, void *stream)
 {
@@ -81,167 +152,62 @@ static size_t writeHeaderData(void *ptr, size_t size, size_t nmemb, void *stream
 }
 
 
-static int processGetTask(HttpRequest::pointer request, write_callback callback, void *stream, long *errorCode, write_callback headerCallback, void *headerStream);
-static int processPostTask(HttpRequest::pointer request, write_callback callback, void *stream, long *errorCode, write_callback headerCallback, void *headerStream);
-static int processPutTask(HttpRequest::pointer request, write_callback callback, void *stream, long *errorCode, write_callback headerCallback, void *headerStream);
-static int processDeleteTask(HttpRequest::pointer request, write_callback callback, void *stream, long *errorCode, write_callback headerCallback, void *headerStream);
+class CURLRaii;
+static bool prepareGetTask(CURLRaii& curl, HttpRequest::pointer request, write_callback callback, void *stream, write_callback headerCallback, void *headerStream, const std::vector<std::string>& extraHeaders);
+static bool preparePostTask(CURLRaii& curl, HttpRequest::pointer request, write_callback callback, void *stream, write_callback headerCallback, void *headerStream);
+static bool preparePutTask(CURLRaii& curl, HttpRequest::pointer request, write_callback callback, void *stream, write_callback headerCallback, void *headerStream);
+static bool prepareDeleteTask(CURLRaii& curl, HttpRequest::pointer request, write_callback callback, void *stream, write_callback headerCallback, void *headerStream);
 // int processDownloadTask(HttpRequest *task, write_callback callback, void *stream, int32_t *errorCode);
-
-// Worker thread
-void HttpClient::networkThread()
-{    
-    HttpRequest::pointer request = nullptr;
-    
-    //auto scheduler = Director::getInstance()->getScheduler();
-    
-    while (true) 
-    {
-        if (s_need_quit)
-        {
-            break;
-        }
-        
-        // step 1: send http request if the requestQueue isn't empty
-        request = nullptr;
-        
-        s_requestQueueMutex.lock();
-        
-        //Get request task from queue
-        
-        if (!s_requestQueue->empty())
-        {
-            request = s_requestQueue->at(0);
-            s_requestQueue->erase(s_requestQueue->begin());
-        }
-        
-        s_requestQueueMutex.unlock();
-        
-        if (nullptr == request)
-        {
-            // Wait for http request tasks from main thread
-            std::unique_lock<std::mutex> lk(s_SleepMutex); 
-            s_SleepCondition.wait(lk);
-            continue;
-        }
-        
-        // step 2: libcurl sync access
-        
-        // Create a HttpResponse object, the default setting is http access failed
-        HttpResponse::pointer response = HttpResponse::pointer(new HttpResponse(request));
-        
-        // request's refcount = 2 here, it's retained by HttpRespose constructor
-        //request->release();
-
-        // ok, refcount = 1 now, only HttpResponse hold it.
-        
-        long responseCode = -1;
-        int retValue = 0;
-
-        // Process the request -> get response packet
-        switch (request->getRequestType())
-        {
-            case HttpRequest::Type::GET: // HTTP GET
-                retValue = processGetTask(request,
-                                          writeData, 
-                                          response->getResponseData(), 
-                                          &responseCode,
-                                          writeHeaderData,
-                                          response->getResponseHeader());
-                break;
-            
-            case HttpRequest::Type::POST: // HTTP POST
-                retValue = processPostTask(request,
-                                           writeData, 
-                                           response->getResponseData(), 
-                                           &responseCode,
-                                           writeHeaderData,
-                                           response->getResponseHeader());
-                break;
-
-            case HttpRequest::Type::PUT:
-                retValue = processPutTask(request,
-                                          writeData,
-                                          response->getResponseData(),
-                                          &responseCode,
-                                          writeHeaderData,
-                                          response->getResponseHeader());
-                break;
-
-            case HttpRequest::Type::DELETE:
-                retValue = processDeleteTask(request,
-                                             writeData,
-                                             response->getResponseData(),
-                                             &responseCode,
-                                             writeHeaderData,
-                                             response->getResponseHeader());
-                break;
-            
-            default:
-                //assert(true, "CCHttpClient: unkown request type, only GET and POSt are supported");
-                break;
-        }
-                
-        // write data to HttpResponse
-        response->setResponseCode(responseCode);
-        
-        if (retValue != 0) 
-        {
-            response->setSucceed(false);
-            response->setErrorBuffer(s_errorBuffer);
-        }
-        else
-        {
-            response->setSucceed(true);
-        }
-
-        
-        // add response packet into queue
-        s_responseQueueMutex.lock();
-        s_responseQueue->push_back(response);
-        s_responseQueueMutex.unlock();
-        
-        if (nullptr != s_pHttpClient) 
-        {
-            dispatchResponseCallbacks();
-            //scheduler->performFunctionInCocosThread(CC_CALLBACK_0(HttpClient::dispatchResponseCallbacks, this));
-        }
-    }
-    
-    // cleanup: if worker thread received quit signal, clean up un-completed request queue
-    s_requestQueueMutex.lock();
-    s_requestQueue->clear();
-    s_requestQueueMutex.unlock();
-    
-    
-    if (s_requestQueue != nullptr) {
-        delete s_requestQueue;
-        s_requestQueue = nullptr;
-        delete s_responseQueue;
-        s_responseQueue = nullptr;
-    }
-    
-}
+static bool beginTransfer(HttpTransfer& transfer);
+static void finishTransfer(HttpTransfer& transfer, CURLcode result, HttpExecutor* cacheWorker);
+static bool lookupMemoryCache(HttpRequest::pointer request, HttpMemoryCache::Entry& entry);
+static void serveFromCache(HttpResponse::pointer response, HttpMemoryCache::Entry& entry);
+static void queueResponses(HttpRequest::pointer request, HttpResponse::pointer response);
+static bool hasPendingResponses();
+static void wakeNetworkThread();
 
 //Configure curl's timeout property
-static bool configureCURL(CURL *handle)
+static bool configureCURL(HttpRequest::pointer request, CURL *handle, char *errorBuffer)
 {
     if (!handle) {
         return false;
     }
     
+    HttpClient* client = HttpClient::getInstance();
+    long timeoutMs = request->getTimeoutMs() > 0 ? request->getTimeoutMs() : client->getTimeoutForRead() * 1000L;
+    long connectTimeoutMs = request->getConnectTimeoutMs() > 0 ? request->getConnectTimeoutMs() : client->getTimeoutForConnect() * 1000L;
+
+    // The deadline bounds the whole exchange, time already spent in the queue included
+    if (request->hasDeadline()) {
+        long remainingMs = (long)std::chrono::duration_cast<std::chrono::milliseconds>(request->getDeadline() - std::chrono::steady_clock::now()).count();
+        remainingMs = std::max(1L, remainingMs);
+        timeoutMs = timeoutMs > 0 ? std::min(timeoutMs, remainingMs) : remainingMs;
+        connectTimeoutMs = connectTimeoutMs > 0 ? std::min(connectTimeoutMs, remainingMs) : remainingMs;
+    }
+
     int32_t code;
-    code = curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, s_errorBuffer);
+    code = curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, errorBuffer);
     if (code != CURLE_OK) {
         return false;
     }
-    code = curl_easy_setopt(handle, CURLOPT_TIMEOUT, HttpClient::getInstance()->getTimeoutForRead());
+    code = curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, timeoutMs);
     if (code != CURLE_OK) {
         return false;
     }
-    code = curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, HttpClient::getInstance()->getTimeoutForConnect());
+    code = curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS, connectTimeoutMs);
     if (code != CURLE_OK) {
         return false;
     }
+    if (client->getLowSpeedLimit() > 0) {
+        curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, client->getLowSpeedLimit());
+        curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, client->getLowSpeedTime());
+    }
+    if (request->getMaxSendSpeed() > 0) {
+        curl_easy_setopt(handle, CURLOPT_MAX_SEND_SPEED_LARGE, (curl_off_t)request->getMaxSendSpeed());
+    }
+    if (request->getMaxRecvSpeed() > 0) {
+        curl_easy_setopt(handle, CURLOPT_MAX_RECV_SPEED_LARGE, (curl_off_t)request->getMaxRecvSpeed());
+    }
     curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
     curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, 0L);
     
@@ -249,6 +215,15 @@ static bool configureCURL(CURL *handle)
     // Document is here: http://curl.haxx.se/libcurl/c/curl_easy_setopt.html#CURLOPTNOSIGNAL 
     curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
 
+#if LIBCURL_VERSION_NUM >= 0x073100
+    if (HttpClient::getInstance()->isHttp2Enabled()) {
+        long version = HttpClient::getInstance()->isHttp2PriorKnowledge() ? CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE : CURL_HTTP_VERSION_2TLS;
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, version);
+        // Rather wait for a connection that can multiplex than open another one to the same host
+        curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+    }
+#endif
+
     return true;
 }
 
@@ -258,11 +233,14 @@ class CURLRaii
     CURL *_curl;
     /// Keeps custom header data
     curl_slist *_headers;
+    /// Error message of this handle, transfers may run concurrently so each has its own
+    char _errorBuffer[CURL_ERROR_SIZE];
 public:
     CURLRaii()
         : _curl(curl_easy_init())
         , _headers(nullptr)
     {
+        _errorBuffer[0] = '\0';
     }
 
     ~CURLRaii()
@@ -285,16 +263,20 @@ public:
      * @param request Null not allowed
      * @param callback Response write callback
      * @param stream Response write stream
+     * @param extraHeaders Headers sent in addition to the request's own, may be null
      */
-    bool init(HttpRequest::pointer request, write_callback callback, void *stream, write_callback headerCallback, void *headerStream)
+    bool init(HttpRequest::pointer request, write_callback callback, void *stream, write_callback headerCallback, void *headerStream,
+              const std::vector<std::string>* extraHeaders = nullptr)
     {
         if (!_curl)
             return false;
-        if (!configureCURL(_curl))
+        if (!configureCURL(request, _curl, _errorBuffer))
             return false;
 
         /* get custom header data (if set) */
        	std::vector<std::string> headers=request->getHeaders();
+        if (extraHeaders)
+            headers.insert(headers.end(), extraHeaders->begin(), extraHeaders->end());
         if(!headers.empty())
         {
             /* append custom headers one by one */
@@ -321,10 +303,32 @@ public:
         
     }
 
+    CURL *getHandle()
+    {
+        return _curl;
+    }
+
+    const char *getErrorBuffer()
+    {
+        return _errorBuffer;
+    }
+
     /// @param responseCode Null not allowed
     bool perform(long *responseCode)
     {
-        if (CURLE_OK != curl_easy_perform(_curl))
+        return finish(curl_easy_perform(_curl), responseCode);
+    }
+
+    /**
+     * @brief Checks the outcome of a transfer driven by curl_easy_perform or a multi handle
+     * @param result Result code curl reported for the transfer
+     * @param responseCode Null not allowed
+     */
+    bool finish(CURLcode result, long *responseCode)
+    {
+        // the response code is wanted even for failures, e.g. a 304 answering a revalidation
+        curl_easy_getinfo(_curl, CURLINFO_RESPONSE_CODE, responseCode);
+        if (CURLE_OK != result)
             return false;
         CURLcode code = curl_easy_getinfo(_curl, CURLINFO_RESPONSE_CODE, responseCode);
         if (code != CURLE_OK || !(*responseCode >= 200 && *responseCode < 300)) 
@@ -338,250 +342,2051 @@ public:
     }
 };
 
-//Process Get Request
-static int processGetTask(HttpRequest::pointer request, write_callback callback, void *stream, long *responseCode, write_callback headerCallback, void *headerStream)
+//Prepare Get Request
+static bool prepareGetTask(CURLRaii& curl, HttpRequest::pointer request, write_callback callback, void *stream, write_callback headerCallback, void *headerStream, const std::vector<std::string>& extraHeaders)
 {
-    CURLRaii curl;
-    bool ok = curl.init(request, callback, stream, headerCallback, headerStream)
-            && curl.setOption(CURLOPT_FOLLOWLOCATION, true)
-            && curl.perform(responseCode);
-    return ok ? 0 : 1;
+    return curl.init(request, callback, stream, headerCallback, headerStream, &extraHeaders)
+            && curl.setOption(CURLOPT_FOLLOWLOCATION, true);
 }
 
-//Process POST Request
-static int processPostTask(HttpRequest::pointer request, write_callback callback, void *stream, long *responseCode, write_callback headerCallback, void *headerStream)
+//Prepare POST Request
+static bool preparePostTask(CURLRaii& curl, HttpRequest::pointer request, write_callback callback, void *stream, write_callback headerCallback, void *headerStream)
 {
-    CURLRaii curl;
-    bool ok = curl.init(request, callback, stream, headerCallback, headerStream)
+    return curl.init(request, callback, stream, headerCallback, headerStream)
             && curl.setOption(CURLOPT_POST, 1)
             && curl.setOption(CURLOPT_POSTFIELDS, request->getRequestData())
-            && curl.setOption(CURLOPT_POSTFIELDSIZE, request->getRequestDataSize())
-            && curl.perform(responseCode);
-    return ok ? 0 : 1;
+            && curl.setOption(CURLOPT_POSTFIELDSIZE, request->getRequestDataSize());
 }
 
-//Process PUT Request
-static int processPutTask(HttpRequest::pointer request, write_callback callback, void *stream, long *responseCode, write_callback headerCallback, void *headerStream)
+//Prepare PUT Request
+static bool preparePutTask(CURLRaii& curl, HttpRequest::pointer request, write_callback callback, void *stream, write_callback headerCallback, void *headerStream)
 {
-    CURLRaii curl;
-    bool ok = curl.init(request, callback, stream, headerCallback, headerStream)
+    return curl.init(request, callback, stream, headerCallback, headerStream)
             && curl.setOption(CURLOPT_CUSTOMREQUEST, "PUT")
             && curl.setOption(CURLOPT_POSTFIELDS, request->getRequestData())
-            && curl.setOption(CURLOPT_POSTFIELDSIZE, request->getRequestDataSize())
-            && curl.perform(responseCode);
-    return ok ? 0 : 1;
+            && curl.setOption(CURLOPT_POSTFIELDSIZE, request->getRequestDataSize());
 }
 
-//Process DELETE Request
-static int processDeleteTask(HttpRequest::pointer request, write_callback callback, void *stream, long *responseCode, write_callback headerCallback, void *headerStream)
+//Prepare DELETE Request
+static bool prepareDeleteTask(CURLRaii& curl, HttpRequest::pointer request, write_callback callback, void *stream, write_callback headerCallback, void *headerStream)
 {
-    CURLRaii curl;
-    bool ok = curl.init(request, callback, stream, headerCallback, headerStream)
+    return curl.init(request, callback, stream, headerCallback, headerStream)
             && curl.setOption(CURLOPT_CUSTOMREQUEST, "DELETE")
-            && curl.setOption(CURLOPT_FOLLOWLOCATION, true)
-            && curl.perform(responseCode);
-    return ok ? 0 : 1;
+            && curl.setOption(CURLOPT_FOLLOWLOCATION, true);
 }
 
-// HttpClient implementation
-HttpClient* HttpClient::getInstance()
+// A request being fetched, either synchronously on the caller's thread
+// or as one of the transfers driven by the network thread's multi handle
+struct HttpTransfer
 {
-    if (s_pHttpClient== nullptr)
+    explicit HttpTransfer(HttpRequest::pointer req)
+    : request(req)
+    , response(new HttpResponse(req))
+    , cacheRead(false)
+    , revalidating(false)
+    , noStore(false)
+    , memoryCacheChecked(false)
+    , partner(nullptr)
+    , hedgeAt(std::chrono::steady_clock::time_point::max())
     {
-        static HttpClient httpClient; // pointer to singleton
-        s_pHttpClient = &httpClient; 
     }
-    return s_pHttpClient;
-}
 
-void HttpClient::destroyInstance()
+    HttpRequest::pointer        request;
+    HttpResponse::pointer       response;
+    CURLRaii                    curl;
+    std::shared_ptr<HttpCache>  cache;          /// disk cache the response goes to, null if none
+    HttpCache::Entry            cached;         /// entry read from the disk cache, being revalidated once stale
+    bool                        cacheRead;      /// cached holds what the disk cache had for the request
+    bool                        revalidating;   /// a conditional request was sent for cached
+    bool                        noStore;        /// the request asked not to be cached
+    bool                        memoryCacheChecked; /// the memory cache missed already, when the request was submitted
+    HttpTransfer*               partner;        /// the other copy of a hedged request, null if none
+    std::chrono::steady_clock::time_point startedAt; /// when libcurl got the transfer
+    std::chrono::steady_clock::time_point firstStartedAt; /// when libcurl got the request's first copy, the original of a hedge
+    std::chrono::steady_clock::time_point hedgeAt;   /// when to send a second copy, max() if never
+    std::string                 url;            /// endpoint of a hedge sent elsewhere, empty if none
+    std::string                 slotHost;       /// host a hedge holds a slot of, empty for the request's own transfer
+};
+
+// Fill response from a cache entry instead of the network
+static void serveFromCache(HttpResponse::pointer response, HttpCache::Entry& entry)
 {
-    delete s_pHttpClient;
-    s_pHttpClient = nullptr;
+    response->setResponseCode(entry.responseCode);
+    response->setResponseHeader(&entry.header);
+    response->setResponseData(&entry.body);
+    response->setFromCache(true);
+    response->setSucceed(true);
 }
 
-void HttpClient::enableCookies(const char* cookieFile) {
-    if (cookieFile) {
-        s_cookieFilename = std::string(cookieFile);
+// Fill response from a memory cache entry, the body is shared rather than copied
+static void serveFromCache(HttpResponse::pointer response, HttpMemoryCache::Entry& entry)
+{
+    response->setResponseCode(entry.responseCode);
+    if (entry.header)
+    {
+        *response->getResponseHeader() = *entry.header;
     }
-    else {
-        //s_cookieFilename = (FileUtils::getInstance()->getWritablePath() + "cookieFile.txt");
-        s_cookieFilename = "";
+    response->setSharedResponseData(entry.body);
+    response->setFromCache(true);
+    response->setSucceed(true);
+}
+
+// Find a fresh memory cache entry for a GET, false on a miss or when the cache is disabled
+static bool lookupMemoryCache(HttpRequest::pointer request, HttpMemoryCache::Entry& entry)
+{
+    std::shared_ptr<HttpMemoryCache> memoryCache = std::atomic_load(&s_memoryCache);
+    if (!memoryCache || request->getRequestType() != HttpRequest::Type::GET)
+    {
+        return false;
     }
+
+    bool noStore = false;
+    bool noCache = false;
+    HttpCache::requestDirectives(request, noStore, noCache);
+    return !noStore && !noCache && memoryCache->lookup(HttpMemoryCache::keyFor(request), entry);
 }
 
-HttpClient::HttpClient()
-: _timeoutForConnect(30)
-, _timeoutForRead(60)
+// Keep a GET response in the memory cache until expiresAt, if it is still fresh
+static void storeInMemoryCache(std::shared_ptr<HttpMemoryCache> memoryCache, HttpRequest::pointer request, HttpResponse::pointer response, time_t expiresAt)
 {
+    if (response->getResponseCode() != 200)
+    {
+        return;
+    }
+
+    HttpCache::Policy policy = HttpCache::parsePolicy(*response->getResponseHeader());
+    if (policy.noStore || policy.varyAll)
+    {
+        return;
+    }
+
+    HttpMemoryCache::Entry entry;
+    entry.expiresAt = expiresAt;
+    if (entry.expiresAt <= time(nullptr))
+    {
+        return;
+    }
+    entry.responseCode = response->getResponseCode();
+    entry.header = std::make_shared<const std::vector<char> >(*response->getResponseHeader());
+    entry.body = std::make_shared<const std::vector<char> >(*response->getSharedResponseData());
+    memoryCache->store(HttpMemoryCache::keyFor(request), entry);
 }
 
-HttpClient::~HttpClient()
+// Key identifying requests that may share one transfer, empty if the request can't be coalesced.
+// The priority class is part of it, so a request never waits in a lower class than its own.
+// A shared transfer runs to the leader's deadline and timeouts, so requests with their own are left out
+static std::string inFlightKey(HttpRequest::pointer request)
 {
-    s_need_quit = true;
-    
-    if (s_requestQueue != nullptr) {
-    	s_SleepCondition.notify_one();
+    if (request->getRequestType() != HttpRequest::Type::GET || request->hasDeadline()
+        || request->getTimeoutMs() > 0 || request->getConnectTimeoutMs() > 0)
+    {
+        return "";
     }
-    
-    s_pHttpClient = nullptr;
+    std::string key(1, (char)('0' + (int)request->getPriority()));
+    return key.append(" ").append(HttpMemoryCache::keyFor(request));
 }
 
-//Lazy create semaphore & mutex & thread
-bool HttpClient::lazyInitThreadSemphore()
+// Returns true if request was attached to an identical request already in flight
+static bool joinInFlight(HttpRequest::pointer request)
 {
-    if (s_requestQueue != nullptr) {
+    if (!s_coalesceRequests)
+    {
+        return false;
+    }
+    std::string key = inFlightKey(request);
+    if (key.empty())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(s_inFlightMutex);
+    std::unordered_map<std::string, InFlightRequest>::iterator it = s_inFlightRequests.find(key);
+    if (it != s_inFlightRequests.end() && !(it->second.leader->isCancelled() && it->second.followers.empty()))
+    {
+        it->second.followers.push_back(request);
         return true;
-    } else {
-        
-        s_requestQueue = new std::vector<HttpRequest::pointer>();
-        s_responseQueue = new std::vector<HttpResponse::pointer>();
-        
-        auto t = std::thread(std::bind(&HttpClient::networkThread, this));
-        t.detach();
-        
-        s_need_quit = false;
     }
-    
-    return true;
+    // nothing in flight, or only a cancelled transfer about to be dropped
+    s_inFlightRequests[key].leader = request;
+    return false;
 }
 
-//Add a get task to queue
-bool HttpClient::sendAsynchronousRequest(HttpRequest::pointer request)
-{    
-    if (false == lazyInitThreadSemphore()) 
+// Build the responses of every request coalesced onto request, starting with its own response.
+// Followers share the leader's body buffer rather than copying it.
+static std::vector<HttpResponse::pointer> completeInFlight(HttpRequest::pointer request, HttpResponse::pointer response)
+{
+    std::vector<HttpResponse::pointer> responses(1, response);
+
+    std::vector<HttpRequest::pointer> followers;
+    std::string key = inFlightKey(request);
+    if (!key.empty())
+    {
+        std::lock_guard<std::mutex> lock(s_inFlightMutex);
+        std::unordered_map<std::string, InFlightRequest>::iterator it = s_inFlightRequests.find(key);
+        if (it == s_inFlightRequests.end() || it->second.leader != request)
+        {
+            return responses;
+        }
+        followers.swap(it->second.followers);
+        s_inFlightRequests.erase(it);
+    }
+
+    for (std::vector<HttpRequest::pointer>::iterator it = followers.begin(); it != followers.end(); ++it)
+    {
+        HttpResponse::pointer copy = HttpResponse::pointer(new HttpResponse(*it));
+        copy->setResponseCode(response->getResponseCode());
+        copy->setResponseHeader(response->getResponseHeader());
+        copy->setSharedResponseData(response->getSharedResponseData());
+        copy->setErrorBuffer(response->getErrorBuffer());
+        copy->setFromCache(response->isFromCache());
+        copy->setSucceed(response->isSucceed());
+        copy->setTimings(response->getTimings());
+        responses.push_back(copy);
+    }
+    return responses;
+}
+
+// Detach a cancelled follower from the request it was coalesced onto. Returns false if it wasn't one
+static bool leaveInFlight(HttpRequest::pointer request)
+{
+    std::string key = inFlightKey(request);
+    if (key.empty())
     {
         return false;
     }
-    
-    if (!request)
+
+    std::lock_guard<std::mutex> lock(s_inFlightMutex);
+    std::unordered_map<std::string, InFlightRequest>::iterator it = s_inFlightRequests.find(key);
+    if (it == s_inFlightRequests.end())
     {
         return false;
     }
-        
-    if (!s_requestQueue) 
+    std::vector<HttpRequest::pointer>& followers = it->second.followers;
+    std::vector<HttpRequest::pointer>::iterator found = std::find(followers.begin(), followers.end(), request);
+    if (found == followers.end())
     {
         return false;
     }
-
-    s_requestQueueMutex.lock();
-    s_requestQueue->push_back(request);
-    s_requestQueueMutex.unlock();
-    // Notify thread start to work
-    s_SleepCondition.notify_one();
+    followers.erase(found);
     return true;
 }
 
-// Poll and notify main thread if responses exists in queue
-void HttpClient::dispatchResponseCallbacks()
+// True once nobody waits for request's transfer anymore: it was cancelled, and so was every
+// request coalesced onto it
+static bool isAbandoned(HttpRequest::pointer request)
 {
-    // log("CCHttpClient::dispatchResponseCallbacks is running");
-    //occurs when cocos thread fires but the network thread has already quited
-    if (nullptr == s_responseQueue) {
-        return;
+    if (!request->isCancelled())
+    {
+        return false;
+    }
+    std::string key = inFlightKey(request);
+    if (key.empty())
+    {
+        return true;
     }
-    HttpResponse::pointer response = nullptr;
-    
-    s_responseQueueMutex.lock();
 
-    if (!s_responseQueue->empty())
+    std::lock_guard<std::mutex> lock(s_inFlightMutex);
+    std::unordered_map<std::string, InFlightRequest>::iterator it = s_inFlightRequests.find(key);
+    if (it == s_inFlightRequests.end() || it->second.leader != request)
     {
-        response = s_responseQueue->at(0);
-        s_responseQueue->erase(s_responseQueue->begin());
+        return true;
     }
-    
-    s_responseQueueMutex.unlock();
-    
-    if (response)
+    std::vector<HttpRequest::pointer>& followers = it->second.followers;
+    for (std::vector<HttpRequest::pointer>::iterator follower = followers.begin(); follower != followers.end(); ++follower)
     {
-        HttpRequest::pointer request = response->getHttpRequest();
-        const ccHttpRequestCallback& callback = request->getCallback();
-        if (callback != nullptr)
+        if (!(*follower)->isCancelled())
         {
-            callback(this, response);
+            return false;
         }
     }
+    return true;
 }
 
-std::string HttpClient::sendSynchronousRequest( HttpRequest::pointer request, int& error)
+// Progress callback of synchronous transfers, aborts them once their request is cancelled
+static int abortIfCancelled(void* request, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
 {
-    if (nullptr == request)
+    return static_cast<HttpRequest*>(request)->isCancelled() ? 1 : 0;
+}
+
+// Keep successful responses in the memory cache, or drop what it holds for urls hit by unsafe methods
+static void rememberResponse(HttpTransfer& transfer)
+{
+    std::shared_ptr<HttpMemoryCache> memoryCache = std::atomic_load(&s_memoryCache);
+    if (!memoryCache || !transfer.response->isSucceed())
     {
-        return "";
+        return;
     }
-
-    // step 2: libcurl sync access
-
-    // Create a HttpResponse object, the default setting is http access failed
-    HttpResponse::pointer response = HttpResponse::pointer(new HttpResponse(request));
-
-    // request's refcount = 2 here, it's retained by HttpRespose constructor
-    //request->release();
-
-    // ok, refcount = 1 now, only HttpResponse hold it.
-
-    long responseCode = -1;
-    int retValue = 0;
-
-    // Process the request -> get response packet
-    switch (request->getRequestType())
+    if (transfer.request->getRequestType() != HttpRequest::Type::GET)
+    {
+        memoryCache->removeUrl(transfer.request->getUrl());
+    }
+    else if (!transfer.noStore)
     {
-    case HttpRequest::Type::GET: // HTTP GET
-        retValue = processGetTask(request,
-            writeData, 
-            response->getResponseData(), 
-            &responseCode,
-            writeHeaderData,
-            response->getResponseHeader());
-        break;
-
-    case HttpRequest::Type::POST: // HTTP POST
-        retValue = processPostTask(request,
-            writeData, 
-            response->getResponseData(), 
-            &responseCode,
-            writeHeaderData,
-            response->getResponseHeader());
-        break;
-
-    case HttpRequest::Type::PUT:
-        retValue = processPutTask(request,
-            writeData,
-            response->getResponseData(),
-            &responseCode,
-            writeHeaderData,
-            response->getResponseHeader());
-        break;
-
-    case HttpRequest::Type::DELETE:
-        retValue = processDeleteTask(request,
-            writeData,
-            response->getResponseData(),
-            &responseCode,
-            writeHeaderData,
-            response->getResponseHeader());
-        break;
-
-    default:
-        //assert(true, "CCHttpClient: unkown request type, only GET and POSt are supported");
-        break;
+        // A disk cache entry keeps the expiry it was stored or revalidated with, the headers alone
+        // would restart its lifetime from now
+        time_t expiresAt = transfer.response->isFromCache() ? transfer.cached.expiresAt
+            : HttpCache::freshnessExpiry(HttpCache::parsePolicy(*transfer.response->getResponseHeader()), time(nullptr));
+        storeInMemoryCache(memoryCache, transfer.request, transfer.response, expiresAt);
     }
+}
 
-    // write data to HttpResponse
-    response->setResponseCode(responseCode);
+// First step of setting up a transfer. Returns false once transfer.response is already complete,
+// answered from the memory cache. GET requests that go through the disk cache get transfer.cache,
+// their entry is read by readDiskCache() before useDiskCache() decides on it
+static bool checkMemoryCache(HttpTransfer& transfer)
+{
+    HttpRequest::pointer request = transfer.request;
+    if (request->getRequestType() != HttpRequest::Type::GET)
+    {
+        transfer.cache = std::atomic_load(&s_cache);
+        return true;
+    }
 
-    if (retValue != 0) 
+    HttpMemoryCache::Entry entry;
+    if (!transfer.memoryCacheChecked && lookupMemoryCache(request, entry))
     {
-        response->setSucceed(false);
-        response->setErrorBuffer(s_errorBuffer);
+        serveFromCache(transfer.response, entry);
+        return false;
     }
-    else
+
+    bool noCache = false;
+    HttpCache::requestDirectives(request, transfer.noStore, noCache);
+    if (!transfer.noStore)
     {
-        response->setSucceed(true);
+        transfer.cache = std::atomic_load(&s_cache);
     }
-    std::vector<char>* pResponseData = response->getResponseData();
+    return true;
+}
+
+// True if a transfer set up by checkMemoryCache() waits for its disk cache entry
+static bool needsDiskCacheRead(const HttpTransfer& transfer)
+{
+    return transfer.cache && transfer.request->getRequestType() == HttpRequest::Type::GET;
+}
+
+// Read the disk cache entry of a GET, the only step of setting up a transfer that touches the disk
+static void readDiskCache(HttpTransfer& transfer)
+{
+    HttpTraceScope trace("disk cache read");
+    transfer.cacheRead = transfer.cache->lookup(transfer.request, transfer.cached);
+}
+
+// Serve a fresh disk cache entry, or revalidate a stale one. Returns false once transfer.response is complete
+static bool useDiskCache(HttpTransfer& transfer)
+{
+    if (!transfer.cacheRead)
+    {
+        return true;
+    }
+    bool noStore = false;
+    bool noCache = false;
+    HttpCache::requestDirectives(transfer.request, noStore, noCache);
+    if (!noCache && HttpCache::isFresh(transfer.cached, time(nullptr)))
+    {
+        serveFromCache(transfer.response, transfer.cached);
+        rememberResponse(transfer);
+        return false;
+    }
+    transfer.revalidating = true;
+    return true;
+}
+
+// Last step of setting up a transfer: the curl handle. Returns false once transfer.response is complete
+static bool prepareTransfer(HttpTransfer& transfer)
+{
+    HttpRequest::pointer request = transfer.request;
+    HttpResponse::pointer response = transfer.response;
+    std::vector<std::string> conditionalHeaders;
+    if (transfer.revalidating)
+    {
+        conditionalHeaders = HttpCache::conditionalHeaders(transfer.cached);
+    }
+
+    // Out of time before touching the network, e.g. a synchronous request sent too late
+    if (request->hasDeadline() && request->getDeadline() <= std::chrono::steady_clock::now())
+    {
+        response->setResponseCode(0);
+        response->setErrorBuffer("deadline exceeded");
+        return false;
+    }
+
+    bool ok = false;
+    switch (request->getRequestType())
+    {
+        case HttpRequest::Type::GET: // HTTP GET
+            ok = prepareGetTask(transfer.curl,
+                                request,
+                                writeData, 
+                                response->getResponseData(), 
+                                writeHeaderData,
+                                response->getResponseHeader(),
+                                conditionalHeaders);
+            break;
+        
+        case HttpRequest::Type::POST: // HTTP POST
+            ok = preparePostTask(transfer.curl,
+                                 request,
+                                 writeData, 
+                                 response->getResponseData(), 
+                                 writeHeaderData,
+                                 response->getResponseHeader());
+            break;
+
+        case HttpRequest::Type::PUT:
+            ok = preparePutTask(transfer.curl,
+                                request,
+                                writeData,
+                                response->getResponseData(),
+                                writeHeaderData,
+                                response->getResponseHeader());
+            break;
+
+        case HttpRequest::Type::DELETE:
+            ok = prepareDeleteTask(transfer.curl,
+                                   request,
+                                   writeData,
+                                   response->getResponseData(),
+                                   writeHeaderData,
+                                   response->getResponseHeader());
+            break;
+        
+        default:
+            //assert(true, "CCHttpClient: unkown request type, only GET and POSt are supported");
+            break;
+    }
+
+    if (!ok)
+    {
+        response->setSucceed(false);
+        response->setErrorBuffer(transfer.curl.getErrorBuffer());
+    }
+    return ok;
+}
+
+// Set up a transfer on the calling thread, disk cache read included. Returns false once
+// transfer.response is already complete: answered from the memory or disk cache, or failed
+// to set up. Otherwise the curl handle is ready to perform.
+// GET requests go through the caches when they are enabled: fresh entries are served without
+// touching the network, stale disk entries are revalidated with a conditional request.
+static bool beginTransfer(HttpTransfer& transfer)
+{
+    if (!checkMemoryCache(transfer))
+    {
+        return false;
+    }
+    if (needsDiskCacheRead(transfer))
+    {
+        readDiskCache(transfer);
+    }
+    return useDiskCache(transfer) && prepareTransfer(transfer);
+}
+
+// A write to the disk cache, made on the cache worker so the network thread never waits on the disk
+struct DiskCacheWrite
+{
+    enum Kind
+    {
+        STORE,      /// keep a response
+        REFRESH,    /// write back entry, revalidated by a 304
+        REMOVE      /// drop what is stored for the request's url
+    };
+
+    DiskCacheWrite()
+    : kind(STORE)
+    , responseCode(0)
+    {
+    }
+
+    Kind                                        kind;
+    std::shared_ptr<HttpCache>                  cache;
+    HttpRequest::pointer                        request;
+    long                                        responseCode;
+    std::vector<char>                           header;
+    std::shared_ptr<const std::vector<char> >   body;
+    HttpCache::Entry                            entry;
+};
+
+static void writeDiskCache(void* context)
+{
+    DiskCacheWrite* write = static_cast<DiskCacheWrite*>(context);
+    {
+        HttpTraceScope trace("disk cache write");
+        switch (write->kind)
+        {
+            case DiskCacheWrite::STORE:
+                write->cache->store(write->request, write->responseCode, write->header, *write->body);
+                break;
+            case DiskCacheWrite::REFRESH:
+                write->cache->update(write->request, write->entry);
+                break;
+            case DiskCacheWrite::REMOVE:
+                write->cache->remove(write->request->getUrl());
+                break;
+        }
+    }
+    delete write;
+}
+
+// Hand a disk cache write to the cache worker, or make it right away without one
+static void updateDiskCache(HttpExecutor* cacheWorker, DiskCacheWrite* write)
+{
+    if (cacheWorker)
+    {
+        cacheWorker->post(writeDiskCache, write);
+    }
+    else
+    {
+        writeDiskCache(write);
+    }
+}
+
+// Runs on the cache worker: read the disk cache entry of a transfer, then hand it back to the network thread
+static void readDiskCacheWork(void* context)
+{
+    readDiskCache(*static_cast<HttpTransfer*>(context));
+    s_requestQueueMutex.lock();
+    s_cacheLookups.push_back(static_cast<HttpTransfer*>(context));
+    s_requestQueueMutex.unlock();
+    wakeNetworkThread();
+}
+
+#if LIBCURL_VERSION_NUM >= 0x073D00
+static long long elapsedMicroseconds(CURL* handle, CURLINFO info)
+{
+    curl_off_t microseconds = 0;
+    curl_easy_getinfo(handle, info, &microseconds);
+    return (long long)microseconds;
+}
+#else
+static long long elapsedMicroseconds(CURL* handle, CURLINFO info)
+{
+    double seconds = 0;
+    curl_easy_getinfo(handle, info, &seconds);
+    return (long long)(seconds * 1000000);
+}
+#endif
+
+// Split the time of a finished transfer into its phases. libcurl's times all count from the start of the transfer
+static HttpResponse::Timings transferTimings(HttpTransfer& transfer)
+{
+#if LIBCURL_VERSION_NUM >= 0x073D00
+    const CURLINFO infos[] = { CURLINFO_NAMELOOKUP_TIME_T, CURLINFO_CONNECT_TIME_T, CURLINFO_APPCONNECT_TIME_T,
+                               CURLINFO_PRETRANSFER_TIME_T, CURLINFO_STARTTRANSFER_TIME_T, CURLINFO_TOTAL_TIME_T };
+#else
+    const CURLINFO infos[] = { CURLINFO_NAMELOOKUP_TIME, CURLINFO_CONNECT_TIME, CURLINFO_APPCONNECT_TIME,
+                               CURLINFO_PRETRANSFER_TIME, CURLINFO_STARTTRANSFER_TIME, CURLINFO_TOTAL_TIME };
+#endif
+    long long at[6];
+    for (int i = 0; i < 6; ++i)
+    {
+        at[i] = elapsedMicroseconds(transfer.curl.getHandle(), infos[i]);
+    }
+    long long nameLookup = at[0], connect = at[1], appConnect = at[2], preTransfer = at[3], startTransfer = at[4], total = at[5];
+
+    HttpResponse::Timings timings;
+    timings.queue = std::chrono::duration_cast<std::chrono::microseconds>(transfer.startedAt - transfer.request->getSubmittedAt()).count();
+    timings.total = total;
+    // a phase libcurl never reached reads 0, as do the ones after it
+    if (connect > 0 || preTransfer > 0)
+    {
+        timings.dns = nameLookup;
+        timings.connect = std::max(0LL, connect - nameLookup);
+    }
+    if (appConnect > 0)
+    {
+        timings.tls = appConnect - connect;
+    }
+    if (preTransfer > 0)
+    {
+        timings.request = std::max(0LL, preTransfer - std::max(connect, appConnect));
+    }
+    if (startTransfer > 0)
+    {
+        timings.firstByte = std::max(0LL, startTransfer - preTransfer);
+        timings.transfer = std::max(0LL, total - startTransfer);
+    }
+    return timings;
+}
+
+static void recordRetry()
+{
+    std::shared_ptr<HttpMetrics> metrics = std::atomic_load(&s_metrics);
+    if (metrics)
+    {
+        metrics->recordRetry();
+    }
+}
+
+static const char* methodName(HttpRequest::Type type)
+{
+    switch (type)
+    {
+        case HttpRequest::Type::GET:    return "GET";
+        case HttpRequest::Type::POST:   return "POST";
+        case HttpRequest::Type::PUT:    return "PUT";
+        case HttpRequest::Type::DELETE: return "DELETE";
+        default:                        return "UNKNOWN";
+    }
+}
+
+// Count a finished transfer in the client-wide metrics, if they are enabled
+static void recordMetrics(HttpTransfer& transfer, long responseCode)
+{
+    std::shared_ptr<HttpMetrics> metrics = std::atomic_load(&s_metrics);
+    if (!metrics)
+    {
+        return;
+    }
+
+    CURL* handle = transfer.curl.getHandle();
+    long connects = 0;
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t sent = 0, received = 0;
+    curl_easy_getinfo(handle, CURLINFO_SIZE_UPLOAD_T, &sent);
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &received);
+#else
+    double sent = 0, received = 0;
+    curl_easy_getinfo(handle, CURLINFO_SIZE_UPLOAD, &sent);
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &received);
+#endif
+    long long latencyUs = transfer.response->getTimings().total;
+    metrics->recordRequest(HttpRequestScheduler::hostOf(transfer.request->getUrl()), methodName(transfer.request->getRequestType()),
+                           responseCode, latencyUs > 0 ? (uint64_t)latencyUs : 0, (uint64_t)sent, (uint64_t)received, connects == 0);
+}
+
+// Lay the phases libcurl timed out on the request's track of the trace
+static void traceTransfer(HttpTransfer& transfer)
+{
+    const void* id = transfer.request.get();
+    const HttpResponse::Timings& timings = transfer.response->getTimings();
+    std::chrono::steady_clock::time_point at = transfer.startedAt;
+    HttpTrace::asyncSpan("transfer", id, at, std::chrono::steady_clock::now());
+
+    const char* names[] = { "dns", "connect", "tls", "request", "first byte", "download" };
+    const long long durations[] = { timings.dns, timings.connect, timings.tls, timings.request, timings.firstByte, timings.transfer };
+    for (int i = 0; i < 6; ++i)
+    {
+        if (durations[i] < 0)
+        {
+            continue;
+        }
+        std::chrono::steady_clock::time_point end = at + std::chrono::microseconds(durations[i]);
+        HttpTrace::asyncSpan(names[i], id, at, end);
+        at = end;
+    }
+}
+
+// Write the outcome of a finished network transfer to its response and update the caches.
+// Disk cache writes go to cacheWorker, or are made on the calling thread when it is null
+static void finishTransfer(HttpTransfer& transfer, CURLcode result, HttpExecutor* cacheWorker)
+{
+    HttpRequest::pointer request = transfer.request;
+    HttpResponse::pointer response = transfer.response;
+    response->setTimings(transferTimings(transfer));
+    if (HttpTrace::isEnabled())
+    {
+        traceTransfer(transfer);
+    }
+
+    long responseCode = -1;
+    bool ok = transfer.curl.finish(result, &responseCode);
+    recordMetrics(transfer, responseCode);
+
+    // 304 Not Modified: the local copy is still good
+    if (transfer.revalidating && responseCode == 304)
+    {
+        // Revalidated here rather than on the cache worker, the memory cache needs the new expiry now
+        HttpCache::revalidate(transfer.cached, *response->getResponseHeader(), time(nullptr));
+        DiskCacheWrite* write = new DiskCacheWrite();
+        write->kind = DiskCacheWrite::REFRESH;
+        write->cache = transfer.cache;
+        write->request = request;
+        write->entry = transfer.cached;
+        serveFromCache(response, transfer.cached);
+        rememberResponse(transfer);
+        updateDiskCache(cacheWorker, write);
+        return;
+    }
+
+    // write data to HttpResponse
+    response->setResponseCode(responseCode);
+    
+    if (!ok) 
+    {
+        response->setSucceed(false);
+        const char* error = transfer.curl.getErrorBuffer();
+        if (result == CURLE_ABORTED_BY_CALLBACK && request->isCancelled())
+        {
+            error = "cancelled";
+        }
+        else if (result == CURLE_OPERATION_TIMEDOUT && request->getDeadline() <= std::chrono::steady_clock::now())
+        {
+            error = "deadline exceeded";
+        }
+        response->setErrorBuffer(error);
+        return;
+    }
+
+    response->setSucceed(true);
+    if (transfer.cache)
+    {
+        DiskCacheWrite* write = new DiskCacheWrite();
+        write->cache = transfer.cache;
+        write->request = request;
+        if (request->getRequestType() == HttpRequest::Type::GET)
+        {
+            write->kind = DiskCacheWrite::STORE;
+            write->responseCode = responseCode;
+            write->header = *response->getResponseHeader();
+            write->body = response->getSharedResponseData();
+        }
+        else
+        {
+            // unsafe methods invalidate whatever we hold for the url
+            write->kind = DiskCacheWrite::REMOVE;
+        }
+        updateDiskCache(cacheWorker, write);
+    }
+    rememberResponse(transfer);
+}
+
+// Queue response, plus the copies for requests coalesced onto it, for callback dispatch
+static void queueResponses(HttpRequest::pointer request, HttpResponse::pointer response)
+{
+    std::vector<HttpResponse::pointer> responses = completeInFlight(request, response);
+
+    // A request cancelled meanwhile, e.g. a leader kept alive for its followers, reports so
+    for (std::vector<HttpResponse::pointer>::iterator it = responses.begin(); it != responses.end(); ++it)
+    {
+        HttpRequest::pointer owner = (*it)->getHttpRequest();
+        if (owner->isCancelled())
+        {
+            HttpResponse::pointer cancelled(new HttpResponse(owner));
+            cancelled->setResponseCode(0);
+            cancelled->setErrorBuffer("cancelled");
+            *it = cancelled;
+        }
+    }
+
+    for (std::vector<HttpResponse::pointer>::iterator it = responses.begin(); it != responses.end(); ++it)
+    {
+        (*it)->markQueued();
+        HttpTrace::asyncBegin("dispatch", (*it)->getHttpRequest().get());
+    }
+
+    s_responseQueueMutex.lock();
+    s_responseQueue->insert(s_responseQueue->end(), responses.begin(), responses.end());
+    s_responseQueueMutex.unlock();
+}
+
+// Answer a request that never reached the network
+static void failRequest(HttpRequest::pointer request, const char* error)
+{
+    HttpResponse::pointer response(new HttpResponse(request));
+    response->setResponseCode(0);
+    response->setErrorBuffer(error);
+    queueResponses(request, response);
+}
+
+// Transport failures worth another try: the request may never have reached the server, or its answer got lost
+static bool isTransientError(CURLcode result)
+{
+    switch (result)
+    {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Transport failures that tell a host is overloaded: it timed out, refused or reset the connection.
+// A name that doesn't resolve says nothing about the host, neither does a body cut short
+static bool isOverloadError(CURLcode result)
+{
+    switch (result)
+    {
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isRetryable(const HttpRequest::RetryPolicy& policy, CURLcode result, long responseCode)
+{
+    if (result != CURLE_OK)
+    {
+        return (policy.retryTransportErrors && isTransientError(result))
+            || std::find(policy.curlErrors.begin(), policy.curlErrors.end(), (int)result) != policy.curlErrors.end();
+    }
+    return std::find(policy.statusCodes.begin(), policy.statusCodes.end(), responseCode) != policy.statusCodes.end();
+}
+
+// Wait before retry number retry, 1 for the first: full jitter, uniform up to an exponential ceiling
+static long backoffMs(const HttpRequest::RetryPolicy& policy, int retry)
+{
+    long ceiling = std::max(0L, policy.baseDelayMs);
+    for (int i = 1; i < retry && ceiling < policy.maxDelayMs; ++i)
+    {
+        ceiling *= 2;
+    }
+    ceiling = std::min(ceiling, policy.maxDelayMs);
+
+    std::lock_guard<std::mutex> lock(s_jitterMutex);
+    return std::uniform_int_distribution<long>(0, std::max(0L, ceiling))(s_jitter);
+}
+
+// Wait before sending a finished transfer's request again, -1 if its response is final.
+// Keeps the retry budget up to date on the way
+static long retryDelayMs(HttpTransfer& transfer, CURLcode result)
+{
+    HttpRequest::pointer request = transfer.request;
+    const HttpRequest::RetryPolicy& policy = request->getRetryPolicy();
+    if (policy.maxAttempts <= 1)
+    {
+        return -1;
+    }
+    if (transfer.response->isSucceed())
+    {
+        s_retryBudget.onSuccess();
+        return -1;
+    }
+    if (!isRetryable(policy, result, transfer.response->getResponseCode()))
+    {
+        return -1;
+    }
+    if (request->isCancelled() || request->getRetryCount() + 1 >= policy.maxAttempts)
+    {
+        return -1;
+    }
+
+    long delayMs = backoffMs(policy, request->getRetryCount() + 1);
+    if (request->hasDeadline() && std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs) >= request->getDeadline())
+    {
+        return -1;
+    }
+
+    // the budget pays only for retries that would actually be made
+    if (!s_retryBudget.onFailure())
+    {
+        return -1;
+    }
+    return delayMs;
+}
+
+static bool hasPendingResponses()
+{
+    std::lock_guard<std::mutex> lock(s_responseQueueMutex);
+    return !s_responseQueue->empty();
+}
+
+static void recordDispatchBatch(size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    int bucket = 0;
+    while (bucket < HttpClient::DispatchStats::BUCKETS - 1 && (size >> (bucket + 1)) != 0)
+    {
+        ++bucket;
+    }
+
+    std::lock_guard<std::mutex> lock(s_dispatchStatsMutex);
+    ++s_dispatchStats.batches;
+    s_dispatchStats.responses += size;
+    s_dispatchStats.largestBatch = std::max(s_dispatchStats.largestBatch, size);
+    ++s_dispatchStats.histogram[bucket];
+}
+
+// Responses the network thread still has to deliver, those a drain posted to the
+// callback executor will get to don't count
+static bool hasUndeliveredResponses()
+{
+    return !s_drainPosted && hasPendingResponses();
+}
+
+// Block until a transfer has socket activity, one of curl's timeouts is due,
+// wakeNetworkThread() announces new work, or at most timeoutMs
+static void waitForActivity(CURLM* multi, long timeoutMs)
+{
+#if LIBCURL_VERSION_NUM >= 0x074400
+    curl_multi_poll(multi, nullptr, 0, (int)timeoutMs, nullptr);
+#elif LIBCURL_VERSION_NUM >= 0x071C00
+    curl_multi_wait(multi, nullptr, 0, (int)std::min(timeoutMs, s_pollIntervalMs), nullptr);
+#else
+    fd_set readSet;
+    fd_set writeSet;
+    fd_set errorSet;
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    FD_ZERO(&errorSet);
+    int maxFd = -1;
+    curl_multi_fdset(multi, &readSet, &writeSet, &errorSet, &maxFd);
+
+    long timeout = -1;
+    curl_multi_timeout(multi, &timeout);
+    if (timeout < 0 || timeout > std::min(timeoutMs, s_pollIntervalMs))
+    {
+        timeout = std::min(timeoutMs, s_pollIntervalMs);
+    }
+    if (maxFd < 0)
+    {
+        // nothing to select on yet, e.g. during name resolution
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+        return;
+    }
+    struct timeval tv;
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    select(maxFd + 1, &readSet, &writeSet, &errorSet, &tv);
+#endif
+}
+
+// Wake the network thread, whether it sleeps waiting for requests or waits on its sockets
+static void wakeNetworkThread()
+{
+    s_requestQueueMutex.lock();
+#if LIBCURL_VERSION_NUM >= 0x074400
+    if (s_multiHandle)
+    {
+        curl_multi_wakeup(s_multiHandle);
+    }
+#endif
+    s_requestQueueMutex.unlock();
+    s_SleepCondition.notify_one();
+}
+
+// Give a prepared transfer to libcurl
+static void addTransfer(CURLM* multi, std::vector<HttpTransfer*>& running, HttpTransfer* transfer)
+{
+    transfer->curl.setOption(CURLOPT_PRIVATE, transfer);
+    transfer->startedAt = std::chrono::steady_clock::now();
+    transfer->firstStartedAt = transfer->partner ? transfer->partner->firstStartedAt : transfer->startedAt;
+    curl_multi_add_handle(multi, transfer->curl.getHandle());
+    running.push_back(transfer);
+}
+
+// Take a transfer back from libcurl, the caller deletes it. A hedge gives back its host slot
+static void removeTransfer(CURLM* multi, std::vector<HttpTransfer*>& running, HttpTransfer* transfer)
+{
+    curl_multi_remove_handle(multi, transfer->curl.getHandle());
+    running.erase(std::find(running.begin(), running.end(), transfer));
+    if (!transfer->slotHost.empty())
+    {
+        s_requestQueueMutex.lock();
+        s_requestQueue->release(transfer->slotHost);
+        s_requestQueueMutex.unlock();
+        transfer->slotHost.clear();
+    }
+}
+
+// Give back the host slot a request popped from the queue holds
+static void releaseSlot(HttpRequest::pointer request)
+{
+    s_requestQueueMutex.lock();
+    s_requestQueue->finished(request);
+    s_requestQueueMutex.unlock();
+}
+
+// When to send a second copy of a transfer just started, max() if its request isn't hedged
+static std::chrono::steady_clock::time_point hedgeTime(const HttpTransfer& transfer)
+{
+    HttpClient* client = HttpClient::getInstance();
+    HttpRequest::pointer request = transfer.request;
+    if (!client->isHedgingEnabled() || !request->isHedgingEnabled() || request->getRequestType() != HttpRequest::Type::GET)
+    {
+        return std::chrono::steady_clock::time_point::max();
+    }
+    long delayMs = s_latencies.percentile(HttpRequestScheduler::hostOf(request->getUrl()), client->getHedgePercentile(), 16);
+    delayMs = std::max(delayMs, client->getHedgeMinDelayMs());
+    return transfer.startedAt + std::chrono::milliseconds(delayMs);
+}
+
+// Send a second copy of transfer's request. The copy takes a slot and a token of the host it goes to,
+// like a queued request would. Returns false if that host has none free or the copy couldn't be set up
+static bool startHedge(CURLM* multi, std::vector<HttpTransfer*>& running, HttpTransfer* transfer)
+{
+    std::string url = transfer->request->getHedgeUrl();
+    std::string host = HttpRequestScheduler::hostOf(url.empty() ? transfer->request->getUrl() : url.c_str());
+    s_requestQueueMutex.lock();
+    bool admitted = s_requestQueue->acquire(host, std::chrono::steady_clock::now());
+    s_requestQueueMutex.unlock();
+    if (!admitted)
+    {
+        return false;
+    }
+
+    HttpTransfer* hedge = new HttpTransfer(transfer->request);
+    // the copy revalidates the disk cache entry the original read, if any
+    hedge->cache = transfer->cache;
+    hedge->noStore = transfer->noStore;
+    hedge->cached = transfer->cached;
+    hedge->cacheRead = transfer->cacheRead;
+    hedge->revalidating = transfer->revalidating;
+    if (!prepareTransfer(*hedge))
+    {
+        s_requestQueueMutex.lock();
+        s_requestQueue->release(host);
+        s_requestQueueMutex.unlock();
+        delete hedge;
+        return false;
+    }
+    hedge->slotHost = host;
+    hedge->url = url;
+    if (!hedge->url.empty())
+    {
+        hedge->curl.setOption(CURLOPT_URL, hedge->url.c_str());
+    }
+    hedge->partner = transfer;
+    transfer->partner = hedge;
+    addTransfer(multi, running, hedge);
+    return true;
+}
+
+// Send a transfer whose disk cache entry, if any, was read. Its request is answered instead
+// when the entry is fresh or the handle couldn't be set up
+static void startTransfer(CURLM* multi, std::vector<HttpTransfer*>& running, HttpTransfer* transfer)
+{
+    if (useDiskCache(*transfer) && prepareTransfer(*transfer))
+    {
+        addTransfer(multi, running, transfer);
+        transfer->hedgeAt = hedgeTime(*transfer);
+        return;
+    }
+    releaseSlot(transfer->request);
+    queueResponses(transfer->request, transfer->response);
+    delete transfer;
+}
+
+// Feed a finished transfer to the adaptive limiter and give the new limit of its host to the scheduler
+static void adaptHostLimit(HttpConcurrencyLimiter& limiter, const std::string& host, long latencyMs, HttpTransfer& transfer, CURLcode result)
+{
+    long responseCode = transfer.response->getResponseCode();
+    bool overloaded = isOverloadError(result) || responseCode == 429 || responseCode == 503;
+
+    std::lock_guard<std::mutex> lock(s_requestQueueMutex);
+    int limit = limiter.onResponse(host, latencyMs, overloaded, s_requestQueue->getInFlight(host));
+    s_requestQueue->setHostLimit(host, limit);
+}
+
+// Share of the bandwidth budget a transfer of this priority gets relative to the others
+static long long bandwidthWeight(HttpRequest::Priority priority)
+{
+    return 8LL >> (int)priority;
+}
+
+// A transfer's cap: its share of budget, or its request's own cap when that is lower
+static curl_off_t bandwidthShare(long long cap, long long budget, long long weight, long long totalWeight)
+{
+    if (budget <= 0 || totalWeight <= 0)
+    {
+        return (curl_off_t)cap;
+    }
+    long long share = std::max(1LL, budget * weight / totalWeight);
+    return (curl_off_t)(cap > 0 ? std::min(cap, share) : share);
+}
+
+static void applyBandwidthShare(CURLRaii& curl, HttpRequest::pointer request, long long weight, long long totalWeight)
+{
+    HttpClient* client = HttpClient::getInstance();
+    curl.setOption(CURLOPT_MAX_SEND_SPEED_LARGE, bandwidthShare(request->getMaxSendSpeed(), client->getSendBandwidthLimit(), weight, totalWeight));
+    curl.setOption(CURLOPT_MAX_RECV_SPEED_LARGE, bandwidthShare(request->getMaxRecvSpeed(), client->getRecvBandwidthLimit(), weight, totalWeight));
+}
+
+// Split the bandwidth budget among the running transfers and the synchronous ones in progress
+static void shareBandwidth(const std::vector<HttpTransfer*>& running)
+{
+    long long asyncWeight = 0;
+    for (std::vector<HttpTransfer*>::const_iterator it = running.begin(); it != running.end(); ++it)
+    {
+        asyncWeight += bandwidthWeight((*it)->request->getPriority());
+    }
+    s_asyncBandwidthWeight = asyncWeight;
+
+    long long totalWeight = asyncWeight + s_syncBandwidthWeight;
+    for (std::vector<HttpTransfer*>::const_iterator it = running.begin(); it != running.end(); ++it)
+    {
+        HttpRequest::pointer request = (*it)->request;
+        applyBandwidthShare((*it)->curl, request, bandwidthWeight(request->getPriority()), totalWeight);
+    }
+}
+
+// Hold a synchronous request back until its host's rate limit lets it start, or its deadline
+static void waitForRateLimit(HttpRequest::pointer request)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point startAt = now;
+    s_requestQueueMutex.lock();
+    if (s_requestQueue)
+    {
+        startAt = s_requestQueue->reserve(HttpRequestScheduler::hostOf(request->getUrl()), now);
+    }
+    s_requestQueueMutex.unlock();
+
+    if (startAt > now)
+    {
+        std::this_thread::sleep_until(std::min(startAt, request->getDeadline()));
+    }
+}
+
+// How long the network thread may wait on its sockets: until the next queued request
+// deadline or retry, or, when there is a free slot, the next hedge or rate limit token
+static long waitTimeoutMs(const std::vector<HttpTransfer*>& running, int maxConcurrentRequests, const HttpTimerWheel& retries)
+{
+    bool freeSlots = (int)running.size() < maxConcurrentRequests;
+    s_requestQueueMutex.lock();
+    std::chrono::steady_clock::time_point wakeAt = std::min(s_requestQueue->nextDeadline(), retries.nextDue());
+    if (freeSlots)
+    {
+        wakeAt = std::min(wakeAt, s_requestQueue->nextAdmission());
+    }
+    s_requestQueueMutex.unlock();
+
+    if (freeSlots)
+    {
+        for (std::vector<HttpTransfer*>::const_iterator it = running.begin(); it != running.end(); ++it)
+        {
+            wakeAt = std::min(wakeAt, (*it)->hedgeAt);
+        }
+    }
+
+    long timeoutMs = 1000;
+    if (wakeAt != std::chrono::steady_clock::time_point::max())
+    {
+        long untilWake = (long)std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - std::chrono::steady_clock::now()).count() + 1;
+        timeoutMs = std::max(0L, std::min(timeoutMs, untilWake));
+    }
+    return timeoutMs;
+}
+
+// Worker thread: drives every asynchronous transfer through one curl multi handle,
+// so connections are pooled across requests and up to getMaxConcurrentRequests() run at once
+void HttpClient::networkThread()
+{    
+    HttpRequest::pointer request = nullptr;
+    std::vector<HttpTransfer*> running;
+    bool multiplexing = false;
+    int maxConnections = 0;
+    int maxHostConnections = 0;
+    std::vector<HttpRequest::pointer> expired;
+    HttpTimerWheel retries;
+    bool adaptive = false;
+    HttpConcurrencyLimiter limiter;
+    bool shaping = false;
+    bool traceNamed = false;
+    std::unique_ptr<HttpThreadPoolExecutor> cacheWorker;   // disk cache reads and writes, once a request uses the disk cache
+    int cacheReads = 0;                                    // transfers waiting for their disk cache entry
+
+    CURLM* multi = curl_multi_init();
+    s_requestQueueMutex.lock();
+    s_multiHandle = multi;
+    s_requestQueueMutex.unlock();
+    
+    //auto scheduler = Director::getInstance()->getScheduler();
+    
+    while (true) 
+    {
+        if (s_need_quit)
+        {
+            break;
+        }
+        HttpAllocationScope allocations(HttpAllocations::SCHEDULE);
+
+        // the thread takes a trace ring only once tracing is on
+        if (!traceNamed && HttpTrace::isEnabled())
+        {
+            HttpTrace::setThreadName("HttpClient network");
+            traceNamed = true;
+        }
+
+#if LIBCURL_VERSION_NUM >= 0x073100
+        // HTTP/2 may be switched on or off while the thread runs
+        if (multiplexing != isHttp2Enabled())
+        {
+            multiplexing = isHttp2Enabled();
+            curl_multi_setopt(multi, CURLMOPT_PIPELINING, multiplexing ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+        }
+#endif
+
+        // Keep libcurl's connection caps in line with the scheduler's
+        if (maxConnections != getMaxConcurrentRequests() || maxHostConnections != getMaxConcurrentRequestsPerHost())
+        {
+            maxConnections = getMaxConcurrentRequests();
+            maxHostConnections = getMaxConcurrentRequestsPerHost();
+#if LIBCURL_VERSION_NUM >= 0x071E00
+            curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)maxConnections);
+            curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)maxHostConnections);
+#endif
+            // A host's adaptive limit is bound by the per host cap, the total one when there is none
+            limiter.setMaxLimit(maxHostConnections > 0 ? maxHostConnections : maxConnections);
+            s_requestQueueMutex.lock();
+            s_requestQueue->setMaxPerHost(maxHostConnections);
+            s_requestQueue->setDefaultHostLimit(adaptive ? limiter.getInitialLimit() : 0);
+            s_requestQueueMutex.unlock();
+        }
+
+        // Adaptive limits may be switched on or off while the thread runs, either way they start over.
+        // Hosts that haven't answered yet start at the initial limit
+        if (adaptive != isAdaptiveConcurrencyEnabled())
+        {
+            adaptive = isAdaptiveConcurrencyEnabled();
+            limiter = HttpConcurrencyLimiter(getAdaptiveConcurrencyInitialLimit(), 1, maxHostConnections > 0 ? maxHostConnections : maxConnections);
+            s_requestQueueMutex.lock();
+            s_requestQueue->clearHostLimits();
+            s_requestQueue->setDefaultHostLimit(adaptive ? limiter.getInitialLimit() : 0);
+            s_requestQueueMutex.unlock();
+        }
+        
+        // Retries whose backoff is over go back in the queue
+        std::vector<HttpRequest::pointer> due;
+        retries.advance(std::chrono::steady_clock::now(), due);
+        if (!due.empty())
+        {
+            s_requestQueueMutex.lock();
+            for (std::vector<HttpRequest::pointer>::iterator it = due.begin(); it != due.end(); ++it)
+            {
+                s_requestQueue->push(*it);
+                HttpTrace::asyncBegin("queued", it->get());
+            }
+            s_requestQueueMutex.unlock();
+        }
+
+        // Requests that waited past their deadline fail before they take a connection
+        s_requestQueueMutex.lock();
+        s_requestQueue->takeExpired(std::chrono::steady_clock::now(), expired);
+        s_requestQueueMutex.unlock();
+        for (std::vector<HttpRequest::pointer>::iterator it = expired.begin(); it != expired.end(); ++it)
+        {
+            failRequest(*it, "deadline exceeded while queued");
+        }
+        expired.clear();
+
+        // Drop cancelled requests, from the queue and from the running transfers
+        if (s_cancelPending.exchange(false))
+        {
+            std::vector<HttpRequest::pointer> cancelled;
+            retries.takeCancelled(cancelled);
+            s_requestQueueMutex.lock();
+            s_requestQueue->takeCancelled(cancelled);
+            s_requestQueueMutex.unlock();
+            for (std::vector<HttpRequest::pointer>::iterator it = cancelled.begin(); it != cancelled.end(); ++it)
+            {
+                if (isAbandoned(*it))
+                {
+                    failRequest(*it, "cancelled");
+                }
+                else
+                {
+                    // requests coalesced onto it still want the response
+                    s_requestQueueMutex.lock();
+                    s_requestQueue->push(*it);
+                    s_requestQueueMutex.unlock();
+                }
+            }
+
+            size_t i = 0;
+            while (i < running.size())
+            {
+                HttpTransfer* transfer = running[i];
+                if (!isAbandoned(transfer->request))
+                {
+                    ++i;
+                    continue;
+                }
+                if (transfer->partner)
+                {
+                    removeTransfer(multi, running, transfer->partner);
+                    delete transfer->partner;
+                }
+                removeTransfer(multi, running, transfer);
+                releaseSlot(transfer->request);
+                failRequest(transfer->request, "cancelled");
+                delete transfer;
+                i = 0;
+            }
+        }
+
+        // Transfers back from the cache worker are answered from their entry or sent
+        if (cacheReads > 0)
+        {
+            std::vector<HttpTransfer*> read;
+            s_requestQueueMutex.lock();
+            read.swap(s_cacheLookups);
+            s_requestQueueMutex.unlock();
+            cacheReads -= (int)read.size();
+            for (std::vector<HttpTransfer*>::iterator it = read.begin(); it != read.end(); ++it)
+            {
+                HttpTransfer* transfer = *it;
+                if (isAbandoned(transfer->request))
+                {
+                    releaseSlot(transfer->request);
+                    failRequest(transfer->request, "cancelled");
+                    delete transfer;
+                    continue;
+                }
+                HttpAllocationScope starting(HttpAllocations::START);
+                startTransfer(multi, running, transfer);
+            }
+        }
+
+        // step 1: start queued requests while there are free transfer slots, highest priority first.
+        // Transfers waiting for their disk cache entry hold a slot too
+        size_t stalled = std::string::npos;   // requests left queued by the last pop, npos if none was tried
+        while ((int)running.size() + cacheReads < getMaxConcurrentRequests())
+        {
+            //Get request task from queue, the next host in line that is under its limit
+            s_requestQueueMutex.lock();
+            request = s_requestQueue->pop();
+            stalled = request ? std::string::npos : s_requestQueue->size();
+            s_requestQueueMutex.unlock();
+
+            if (nullptr == request)
+            {
+                break;
+            }
+            HttpTrace::asyncEnd("queued", request.get());
+            HttpTraceScope trace("start request");
+            HttpAllocationScope starting(HttpAllocations::START);
+
+            // Create a transfer, its HttpResponse default setting is http access failed.
+            // bypassQueue() looked the first attempt up in the memory cache, retries are looked up again
+            HttpTransfer* transfer = new HttpTransfer(request);
+            transfer->memoryCacheChecked = request->getRetryCount() == 0;
+            if (!checkMemoryCache(*transfer))
+            {
+                releaseSlot(request);
+                queueResponses(transfer->request, transfer->response);
+                delete transfer;
+                continue;
+            }
+
+            // The disk is only touched on the cache worker, a slow read or write never holds up the transfers
+            if (transfer->cache && !cacheWorker)
+            {
+                cacheWorker.reset(new HttpThreadPoolExecutor(1));
+            }
+            if (needsDiskCacheRead(*transfer))
+            {
+                ++cacheReads;
+                cacheWorker->post(readDiskCacheWork, transfer);
+                continue;
+            }
+            startTransfer(multi, running, transfer);
+        }
+
+        // Hedge transfers slower than usual for their host, in the slots queued requests left free
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < running.size() && (int)running.size() < getMaxConcurrentRequests(); ++i)
+        {
+            HttpTransfer* transfer = running[i];
+            if (transfer->hedgeAt <= now)
+            {
+                // a host at its limit or out of tokens gets the hedge a little later
+                transfer->hedgeAt = startHedge(multi, running, transfer) ? std::chrono::steady_clock::time_point::max()
+                    : now + std::chrono::milliseconds(s_hedgeRecheckMs);
+            }
+        }
+
+        std::shared_ptr<HttpMetrics> metrics = std::atomic_load(&s_metrics);
+        if (metrics)
+        {
+            s_requestQueueMutex.lock();
+            size_t queued = s_requestQueue->size();
+            s_requestQueueMutex.unlock();
+            metrics->setQueueDepth(queued, running.size());
+        }
+
+        // Shift the bandwidth shares to the transfers now running, or back to their own caps
+        // once the budget is lifted
+        bool budget = getSendBandwidthLimit() > 0 || getRecvBandwidthLimit() > 0;
+        if (budget || shaping)
+        {
+            shareBandwidth(running);
+            shaping = budget;
+        }
+
+        // step 2: libcurl async access, collect the transfers that are done
+        bool slotsFreed = false;
+        if (!running.empty())
+        {
+            int stillRunning = 0;
+            {
+                HttpTraceScope trace("curl_multi_perform");
+                HttpAllocationScope transferring(HttpAllocations::TRANSFER);
+                curl_multi_perform(multi, &stillRunning);
+            }
+
+            CURLMsg* message = nullptr;
+            int messagesLeft = 0;
+            while ((message = curl_multi_info_read(multi, &messagesLeft)) != nullptr)
+            {
+                if (message->msg != CURLMSG_DONE)
+                {
+                    continue;
+                }
+                CURL* handle = message->easy_handle;
+                CURLcode result = message->data.result;
+                HttpTransfer* transfer = nullptr;
+                curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char**)&transfer);
+                removeTransfer(multi, running, transfer);
+                slotsFreed = true;
+                HttpTraceScope trace("finish transfer");
+                HttpAllocationScope finishing(HttpAllocations::FINISH);
+
+                finishTransfer(*transfer, result, cacheWorker.get());
+
+                HttpTransfer* partner = transfer->partner;
+                if (partner)
+                {
+                    partner->partner = nullptr;
+                    if (!transfer->response->isSucceed())
+                    {
+                        // the other copy may still make it
+                        delete transfer;
+                        continue;
+                    }
+                    // first copy to succeed wins, the other one is cancelled
+                    removeTransfer(multi, running, partner);
+                    delete partner;
+                }
+
+                // Learn from the outcome: hedging delays from latencies, adaptive limits from both
+                std::string host = HttpRequestScheduler::hostOf(transfer->request->getUrl());
+                std::chrono::steady_clock::time_point finishedAt = std::chrono::steady_clock::now();
+                long elapsedMs = (long)std::chrono::duration_cast<std::chrono::milliseconds>(finishedAt - transfer->startedAt).count();
+                if (transfer->response->isSucceed())
+                {
+                    // the request waited since its first copy went out, a winning hedge's own time
+                    // would pull the percentile its hedge delay comes from down
+                    s_latencies.record(host, (long)std::chrono::duration_cast<std::chrono::milliseconds>(finishedAt - transfer->firstStartedAt).count());
+                }
+                if (adaptive)
+                {
+                    adaptHostLimit(limiter, host, elapsedMs, *transfer, result);
+                }
+
+                long retryMs = retryDelayMs(*transfer, result);
+                if (retryMs >= 0)
+                {
+                    transfer->request->setRetryCount(transfer->request->getRetryCount() + 1);
+                    recordRetry();
+                    retries.schedule(transfer->request, std::chrono::steady_clock::now() + std::chrono::milliseconds(retryMs));
+                    releaseSlot(transfer->request);
+                    delete transfer;
+                    continue;
+                }
+
+                releaseSlot(transfer->request);
+                queueResponses(transfer->request, transfer->response);
+                delete transfer;
+            }
+        }
+        
+        if (nullptr != s_pHttpClient && hasUndeliveredResponses())
+        {
+            HttpTraceScope trace("deliver responses");
+            HttpAllocationScope delivering(HttpAllocations::DISPATCH);
+            deliverResponses();
+        }
+
+        // Refill freed slots right away instead of waiting on the remaining transfers
+        if (slotsFreed)
+        {
+            continue;
+        }
+
+        if (!running.empty())
+        {
+            // wake up in time for queued deadlines, hedges and tokens due meanwhile
+            waitForActivity(multi, waitTimeoutMs(running, getMaxConcurrentRequests(), retries));
+            continue;
+        }
+
+        // Wait for http request tasks from main thread, the next retry, or the next token of
+        // a rate limited host. Requests still queued now all wait for a token. Count them as of
+        // the last pop: one queued since then must wake the thread, not be taken for a waiting one
+        std::unique_lock<std::mutex> lk(s_requestQueueMutex);
+        size_t queued = stalled != std::string::npos ? stalled : s_requestQueue->size();
+        auto hasWork = [queued]() {
+            return s_need_quit || s_cancelPending || s_requestQueue->size() > queued || !s_cacheLookups.empty() || hasUndeliveredResponses();
+        };
+        std::chrono::steady_clock::time_point wakeAt = std::min(retries.nextDue(), std::min(s_requestQueue->nextAdmission(), s_requestQueue->nextDeadline()));
+        if (wakeAt == std::chrono::steady_clock::time_point::max())
+        {
+            s_SleepCondition.wait(lk, hasWork);
+        }
+        else
+        {
+            s_SleepCondition.wait_until(lk, wakeAt, hasWork);
+        }
+    }
+
+    // cleanup: abandon the transfers still running
+    for (std::vector<HttpTransfer*>::iterator it = running.begin(); it != running.end(); ++it)
+    {
+        curl_multi_remove_handle(multi, (*it)->curl.getHandle());
+        delete *it;
+    }
+
+    // the cache worker finishes the reads and writes posted to it before it goes
+    cacheWorker.reset();
+    s_requestQueueMutex.lock();
+    for (std::vector<HttpTransfer*>::iterator it = s_cacheLookups.begin(); it != s_cacheLookups.end(); ++it)
+    {
+        delete *it;
+    }
+    s_cacheLookups.clear();
+    s_requestQueueMutex.unlock();
+    s_requestQueueMutex.lock();
+    s_multiHandle = nullptr;
+    s_requestQueueMutex.unlock();
+    curl_multi_cleanup(multi);
+    
+    // cleanup: if worker thread received quit signal, clean up un-completed request queue
+    s_requestQueueMutex.lock();
+    s_requestQueue->clear();
+    s_requestQueueMutex.unlock();
+    
+    
+    if (s_requestQueue != nullptr) {
+        delete s_requestQueue;
+        s_requestQueue = nullptr;
+        delete s_responseQueue;
+        s_responseQueue = nullptr;
+    }
+    
+}
+
+// HttpClient implementation
+HttpClient* HttpClient::getInstance()
+{
+    if (s_pHttpClient== nullptr)
+    {
+        static HttpClient httpClient; // pointer to singleton
+        s_pHttpClient = &httpClient; 
+    }
+    return s_pHttpClient;
+}
+
+void HttpClient::destroyInstance()
+{
+    delete s_pHttpClient;
+    s_pHttpClient = nullptr;
+}
+
+void HttpClient::enableCookies(const char* cookieFile) {
+    if (cookieFile) {
+        s_cookieFilename = std::string(cookieFile);
+    }
+    else {
+        //s_cookieFilename = (FileUtils::getInstance()->getWritablePath() + "cookieFile.txt");
+        s_cookieFilename = "";
+    }
+}
+
+void HttpClient::enableRequestCoalescing(bool enable) {
+    s_coalesceRequests = enable;
+}
+
+void HttpClient::enableMemoryCache(size_t byteBudget) {
+    std::shared_ptr<HttpMemoryCache> memoryCache;
+    if (byteBudget > 0) {
+        memoryCache = std::make_shared<HttpMemoryCache>(byteBudget);
+    }
+    std::atomic_store(&s_memoryCache, memoryCache);
+}
+
+HttpClient::DispatchStats HttpClient::getDispatchStats() {
+    std::lock_guard<std::mutex> lock(s_dispatchStatsMutex);
+    return s_dispatchStats;
+}
+
+void HttpClient::enableMetrics(bool enable) {
+    std::shared_ptr<HttpMetrics> metrics;
+    if (enable) {
+        metrics = std::atomic_load(&s_metrics);
+        if (!metrics) {
+            metrics = std::make_shared<HttpMetrics>();
+        }
+    }
+    std::atomic_store(&s_metrics, metrics);
+}
+
+HttpMetrics::Snapshot HttpClient::getMetrics() {
+    std::shared_ptr<HttpMetrics> metrics = std::atomic_load(&s_metrics);
+    return metrics ? metrics->snapshot() : HttpMetrics::Snapshot();
+}
+
+std::string HttpClient::getMetricsPrometheus() {
+    std::shared_ptr<HttpMetrics> metrics = std::atomic_load(&s_metrics);
+    return metrics ? metrics->toPrometheus() : std::string();
+}
+
+HttpMemoryCache::Stats HttpClient::getMemoryCacheStats() {
+    HttpMemoryCache::Stats stats;
+    std::shared_ptr<HttpMemoryCache> memoryCache = std::atomic_load(&s_memoryCache);
+    if (memoryCache) {
+        stats = memoryCache->getStats();
+    }
+    return stats;
+}
+
+void HttpClient::enableCache(const char* cacheDirectory, size_t maxSize) {
+    std::shared_ptr<HttpCache> cache;
+    if (cacheDirectory) {
+        cache = std::make_shared<HttpCache>(cacheDirectory, maxSize);
+    }
+    std::atomic_store(&s_cache, cache);
+}
+
+HttpClient::HttpClient()
+: _timeoutForConnect(30)
+, _timeoutForRead(60)
+, _lowSpeedLimit(0)
+, _lowSpeedTime(0)
+, _maxConcurrentRequests(8)
+, _maxConcurrentRequestsPerHost(6)
+, _enableHttp2(false)
+, _http2PriorKnowledge(false)
+, _enableHedging(false)
+, _hedgePercentile(0.95)
+, _hedgeMinDelayMs(50)
+, _adaptiveConcurrency(false)
+, _adaptiveInitialLimit(4)
+, _sendBandwidth(0)
+, _recvBandwidth(0)
+, _callbackExecutor(nullptr)
+, _completionQueue(nullptr)
+{
+}
+
+HttpClient::~HttpClient()
+{
+    s_need_quit = true;
+    
+    if (s_requestQueue != nullptr) {
+    	wakeNetworkThread();
+    }
+    
+    s_pHttpClient = nullptr;
+}
+
+//Lazy create semaphore & mutex & thread
+bool HttpClient::lazyInitThreadSemphore()
+{
+    if (s_requestQueue != nullptr) {
+        return true;
+    } else {
+        
+        s_requestQueue = new HttpRequestScheduler();
+        s_responseQueue = new std::vector<HttpResponse::pointer>();
+        
+        auto t = std::thread(std::bind(&HttpClient::networkThread, this));
+        t.detach();
+        
+        s_need_quit = false;
+    }
+    
+    return true;
+}
+
+// Hot GETs answered from the memory cache skip the request queue and the network, their
+// response is appended to cached. Identical GETs join the one in flight. Returns false
+// when the request has to be queued
+static bool bypassQueue(HttpRequest::pointer request, std::vector<HttpResponse::pointer>& cached)
+{
+    HttpMemoryCache::Entry entry;
+    if (lookupMemoryCache(request, entry))
+    {
+        HttpResponse::pointer response = HttpResponse::pointer(new HttpResponse(request));
+        serveFromCache(response, entry);
+        cached.push_back(response);
+        return true;
+    }
+    return joinInFlight(request);
+}
+
+// Completion state of a batch, shared by the wrapped callbacks of its requests
+struct HttpBatch
+{
+    std::vector<HttpResponse::pointer>  responses;  /// by submission order, filled as they come
+    std::atomic<size_t>                 remaining;
+    ccHttpBatchCallback                 callback;
+};
+
+// Wrap the callback of each request so the last one to complete calls the batch callback
+static void trackBatch(const std::vector<HttpRequest::pointer>& requests, const ccHttpBatchCallback& callback)
+{
+    std::shared_ptr<HttpBatch> batch(new HttpBatch());
+    batch->responses.resize(requests.size());
+    batch->remaining = requests.size();
+    batch->callback = callback;
+
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        ccHttpRequestCallback original = requests[i]->getCallback();
+        requests[i]->setResponseCallback([batch, i, original](HttpClient* client, HttpResponse::pointer response) {
+            if (original)
+            {
+                original(client, response);
+            }
+            batch->responses[i] = response;
+            if (--batch->remaining == 0)
+            {
+                batch->callback(client, batch->responses);
+                // the responses hold the requests, which hold this callback
+                batch->responses.clear();
+            }
+        });
+    }
+}
+
+//Add a get task to queue
+bool HttpClient::sendAsynchronousRequest(HttpRequest::pointer request)
+{    
+    if (false == lazyInitThreadSemphore()) 
+    {
+        return false;
+    }
+    
+    if (!request)
+    {
+        return false;
+    }
+    HttpAllocationScope allocations(HttpAllocations::SUBMIT);
+    HttpAllocations::recordRequests(1);
+    request->setRetryCount(0);
+    request->setSubmittedAt(std::chrono::steady_clock::now());
+        
+    if (!s_requestQueue) 
+    {
+        return false;
+    }
+
+    std::vector<HttpResponse::pointer> cached;
+    if (bypassQueue(request, cached))
+    {
+        if (!cached.empty())
+        {
+            HttpTrace::asyncBegin("dispatch", request.get());
+            s_responseQueueMutex.lock();
+            s_responseQueue->push_back(cached[0]);
+            s_responseQueueMutex.unlock();
+            wakeNetworkThread();
+        }
+        return true;
+    }
+
+    HttpTrace::asyncBegin("queued", request.get());
+    s_requestQueueMutex.lock();
+    s_requestQueue->push(request);
+    s_requestQueueMutex.unlock();
+    // Notify thread start to work
+    wakeNetworkThread();
+    return true;
+}
+
+bool HttpClient::sendBatch(const std::vector<HttpRequest::pointer>& requests, const ccHttpBatchCallback& callback)
+{
+    if (false == lazyInitThreadSemphore() || !s_requestQueue)
+    {
+        return false;
+    }
+    if (std::find(requests.begin(), requests.end(), nullptr) != requests.end())
+    {
+        return false;
+    }
+    if (requests.empty())
+    {
+        if (callback)
+        {
+            callback(this, std::vector<HttpResponse::pointer>());
+        }
+        return true;
+    }
+    HttpAllocationScope allocations(HttpAllocations::SUBMIT);
+    HttpAllocations::recordRequests(requests.size());
+
+    if (callback)
+    {
+        trackBatch(requests, callback);
+    }
+
+    std::vector<HttpRequest::pointer> queued;
+    std::vector<HttpResponse::pointer> cached;
+    queued.reserve(requests.size());
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (std::vector<HttpRequest::pointer>::const_iterator it = requests.begin(); it != requests.end(); ++it)
+    {
+        (*it)->setRetryCount(0);
+        (*it)->setSubmittedAt(now);
+        if (!bypassQueue(*it, cached))
+        {
+            queued.push_back(*it);
+        }
+    }
+
+    if (!cached.empty())
+    {
+        for (std::vector<HttpResponse::pointer>::iterator it = cached.begin(); it != cached.end(); ++it)
+        {
+            HttpTrace::asyncBegin("dispatch", (*it)->getHttpRequest().get());
+        }
+        s_responseQueueMutex.lock();
+        s_responseQueue->insert(s_responseQueue->end(), cached.begin(), cached.end());
+        s_responseQueueMutex.unlock();
+    }
+
+    s_requestQueueMutex.lock();
+    for (std::vector<HttpRequest::pointer>::iterator it = queued.begin(); it != queued.end(); ++it)
+    {
+        s_requestQueue->push(*it);
+        HttpTrace::asyncBegin("queued", it->get());
+    }
+    s_requestQueueMutex.unlock();
+    // One wakeup for the whole batch
+    wakeNetworkThread();
+    return true;
+}
+
+HttpFuture<HttpResponse::pointer> HttpClient::sendAsync(HttpRequest::pointer request)
+{
+    typedef HttpFutureState<HttpResponse::pointer> State;
+    if (nullptr == request)
+    {
+        HttpResponse::pointer response(new HttpResponse(nullptr));
+        response->setErrorBuffer("request is null");
+        std::shared_ptr<State> failed(new State());
+        failed->setValue(response);
+        return HttpFuture<HttpResponse::pointer>(failed);
+    }
+    HttpAllocationScope allocations(HttpAllocations::SUBMIT);
+
+    std::shared_ptr<State> state(new State());
+    // The callback lets go of the state once it fired, the response held by the state
+    // refers to the request, which keeps the callback
+    std::shared_ptr<std::shared_ptr<State> > pending(new std::shared_ptr<State>(state));
+    ccHttpRequestCallback original = request->getCallback();
+    request->setResponseCallback([pending, original](HttpClient* client, HttpResponse::pointer response) {
+        if (original)
+        {
+            original(client, response);
+        }
+        std::shared_ptr<State> fired;
+        fired.swap(*pending);
+        if (fired)
+        {
+            fired->setValue(response);
+        }
+    });
+
+    if (!sendAsynchronousRequest(request))
+    {
+        HttpResponse::pointer response(new HttpResponse(request));
+        response->setErrorBuffer("request not sent");
+        pending->reset();
+        state->setValue(response);
+    }
+    return HttpFuture<HttpResponse::pointer>(state);
+}
+
+void HttpClient::setRetryBudget(double maxTokens, double tokenRatio)
+{
+    s_retryBudget.reset(maxTokens, tokenRatio);
+}
+
+void HttpClient::setHostRateLimit(const std::string& host, double requestsPerSecond, double burst)
+{
+    // the limits live in the scheduler, which comes with the network thread
+    lazyInitThreadSemphore();
+
+    std::string key(host);
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    s_requestQueueMutex.lock();
+    s_requestQueue->setHostRateLimit(key, requestsPerSecond, burst);
+    s_requestQueueMutex.unlock();
+    wakeNetworkThread();
+}
+
+void HttpClient::cancelRequest(HttpRequest::pointer request)
+{
+    if (nullptr == request || request->isCancelled())
+    {
+        return;
+    }
+    request->cancel();
+
+    // A coalesced follower has no transfer of its own, answer it right away
+    if (leaveInFlight(request))
+    {
+        failRequest(request, "cancelled");
+    }
+
+    s_cancelPending = true;
+    if (s_requestQueue)
+    {
+        wakeNetworkThread();
+    }
+}
+
+// Poll and notify main thread if responses exists in queue
+void HttpClient::dispatchResponseCallbacks()
+{
+    // log("CCHttpClient::dispatchResponseCallbacks is running");
+    //occurs when cocos thread fires but the network thread has already quited
+    if (nullptr == s_responseQueue) {
+        return;
+    }
+
+    // Take every queued response at once, the callbacks run outside the lock
+    HttpAllocationScope allocations(HttpAllocations::DISPATCH);
+    std::vector<HttpResponse::pointer> responses;
+    s_responseQueueMutex.lock();
+    responses.swap(*s_responseQueue);
+    s_responseQueueMutex.unlock();
+
+    if (responses.empty())
+    {
+        return;
+    }
+    recordDispatchBatch(responses.size());
+
+    for (std::vector<HttpResponse::pointer>::iterator it = responses.begin(); it != responses.end(); ++it)
+    {
+        HttpRequest::pointer request = (*it)->getHttpRequest();
+        const ccHttpRequestCallback& callback = request->getCallback();
+        (*it)->markDispatched();
+        HttpTrace::asyncEnd("dispatch", request.get());
+        if (callback != nullptr)
+        {
+            HttpTraceScope trace("callback");
+            HttpAllocationScope calling(HttpAllocations::CALLBACK);
+            callback(this, *it);
+        }
+    }
+}
+
+void HttpClient::deliverResponses()
+{
+    // The application's loop takes every response queued so far in one go
+    HttpCompletionQueue* completions = getCompletionQueue();
+    if (nullptr != completions)
+    {
+        std::vector<HttpResponse::pointer> responses;
+        s_responseQueueMutex.lock();
+        responses.swap(*s_responseQueue);
+        s_responseQueueMutex.unlock();
+        recordDispatchBatch(responses.size());
+        completions->push(responses);
+        return;
+    }
+
+    HttpExecutor* executor = getCallbackExecutor();
+    if (nullptr == executor)
+    {
+        while (hasPendingResponses())
+        {
+            dispatchResponseCallbacks();
+        }
+        return;
+    }
+
+    // A single drain at a time keeps the callbacks in completion order and off each other's toes
+    if (!s_drainPosted.exchange(true))
+    {
+        executor->post(&HttpClient::drainResponses, this);
+    }
+}
+
+// Runs on the callback executor
+void HttpClient::drainResponses(void* client)
+{
+    do
+    {
+        while (hasPendingResponses())
+        {
+            static_cast<HttpClient*>(client)->dispatchResponseCallbacks();
+        }
+        s_drainPosted = false;
+        // unless the network thread posted a new drain, pick up what came in meanwhile
+    } while (hasPendingResponses() && !s_drainPosted.exchange(true));
+}
+
+std::string HttpClient::sendSynchronousRequest( HttpRequest::pointer request, int& error)
+{
+    if (nullptr == request)
+    {
+        return "";
+    }
+
+    // step 2: libcurl sync access
+
+    HttpAllocationScope allocations(HttpAllocations::SUBMIT);
+    HttpAllocations::recordRequests(1);
+    HttpResponse::pointer response;
+    request->setRetryCount(0);
+    request->setSubmittedAt(std::chrono::steady_clock::now());
+    while (true)
+    {
+        waitForRateLimit(request);
+
+        // Create a transfer, its HttpResponse default setting is http access failed
+        HttpAllocationScope starting(HttpAllocations::START);
+        HttpTransfer transfer(request);
+        response = transfer.response;
+        if (!beginTransfer(transfer))
+        {
+            break;
+        }
+
+        // A synchronous transfer takes its share of the bandwidth budget as it stands now
+        long long weight = bandwidthWeight(request->getPriority());
+        s_syncBandwidthWeight += weight;
+        applyBandwidthShare(transfer.curl, request, weight, s_asyncBandwidthWeight + s_syncBandwidthWeight);
+
+        // cancelRequest() from another thread aborts the transfer through the progress callback
+#if LIBCURL_VERSION_NUM >= 0x072000
+        transfer.curl.setOption(CURLOPT_XFERINFOFUNCTION, abortIfCancelled);
+        transfer.curl.setOption(CURLOPT_XFERINFODATA, request.get());
+        transfer.curl.setOption(CURLOPT_NOPROGRESS, 0L);
+#endif
+        transfer.startedAt = std::chrono::steady_clock::now();
+        CURLcode result = CURLE_OK;
+        {
+            HttpAllocationScope transferring(HttpAllocations::TRANSFER);
+            result = curl_easy_perform(transfer.curl.getHandle());
+        }
+        s_syncBandwidthWeight -= weight;
+        HttpAllocationScope finishing(HttpAllocations::FINISH);
+        finishTransfer(transfer, result, nullptr);
+
+        // The caller's own thread waits out the backoff
+        long retryMs = retryDelayMs(transfer, result);
+        if (retryMs < 0)
+        {
+            break;
+        }
+        request->setRetryCount(request->getRetryCount() + 1);
+        recordRetry();
+        std::this_thread::sleep_for(std::chrono::milliseconds(retryMs));
+    }
+
+    std::shared_ptr<const std::vector<char> > pResponseData = response->getSharedResponseData();
     std::string strResponseData(pResponseData->begin(), pResponseData->end());
-    error = retValue;
+    error = response->isSucceed() ? 0 : 1;
     return strResponseData;
 }
 
@@ -26,24 +26,67 @@
 #ifndef __CCHTTPREQUEST_H__
 #define __CCHTTPREQUEST_H__
 
+#include <stdint.h>
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 #include "HttpClient.h"
+#include "HttpCache.h"
+#include "HttpMemoryCache.h"
+#include "HttpMetrics.h"
+#include "HttpFuture.h"
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define HTTP_CLIENT_HAS_COROUTINES 1
+#else
+#define HTTP_CLIENT_HAS_COROUTINES 0
+#endif
 
 namespace network {
 
+class HttpExecutor;
+class HttpCompletionQueue;
+class HttpRequestAwaiter;
+
 /**
  * @addtogroup Network
  * @{
  */
 
 
+/** Called once every request of a batch has its response, the responses in submission order */
+typedef std::function<void(HttpClient* client, const std::vector<HttpResponse::pointer>& responses)> ccHttpBatchCallback;
+
 /** @brief Singleton that handles asynchrounous http requests
  * Once the request completed, a callback will issued in main thread when it provided during make request
  */
 class HttpClient
 {
 public:
+    /** How completed responses left the response queue, in batches, since the client started */
+    struct DispatchStats
+    {
+        enum
+        {
+            BUCKETS = 12
+        };
+
+        DispatchStats()
+        : batches(0)
+        , responses(0)
+        , largestBatch(0)
+        {
+            for (int i = 0; i < BUCKETS; ++i)
+            {
+                histogram[i] = 0;
+            }
+        }
+
+        uint64_t batches;
+        uint64_t responses;
+        size_t   largestBatch;
+        uint64_t histogram[BUCKETS];  /// batches of 1, 2-3, 4-7, ... responses, the last bucket takes all larger ones
+    };
+
     /** Return the shared instance **/
     static HttpClient *getInstance();
     
@@ -52,6 +95,50 @@ public:
 
     /** Enable cookie support. **/
     void enableCookies(const char* cookieFile);
+
+    /**
+     * Enable the disk cache for GET requests.
+     * Fresh responses are served from cacheDirectory, stale ones are revalidated
+     * with If-None-Match/If-Modified-Since. Pass nullptr to disable the cache.
+     * Asynchronous requests read and write the disk on a thread of their own, so a slow disk
+     * doesn't hold up the other transfers. Synchronous ones do it on the caller's thread.
+     * @param maxSize bytes the cache may take on disk, the least recently used files are deleted beyond it
+     */
+    void enableCache(const char* cacheDirectory, size_t maxSize = HttpCache::DEFAULT_MAX_SIZE);
+
+    /**
+     * Enable the in-memory cache for small, hot GET responses.
+     * It is consulted before the request queue, the disk cache and the network.
+     * @param byteBudget memory the cached entries may use, 0 disables the cache
+     */
+    void enableMemoryCache(size_t byteBudget);
+
+    /** Get hit/miss/eviction counters of the memory cache, all zero when it is disabled */
+    HttpMemoryCache::Stats getMemoryCacheStats();
+
+    /** Get the sizes of the batches responses were dispatched in, to tune for high completion rates */
+    DispatchStats getDispatchStats();
+
+    /**
+     * Keep client-wide metrics: transfers, bytes, retries, connection reuse and queue depth,
+     * and latency histograms per host, method and status class.
+     * Disabling drops what was recorded so far.
+     */
+    void enableMetrics(bool enable);
+
+    /** Get the metrics recorded since they were enabled, all zero when they are disabled */
+    HttpMetrics::Snapshot getMetrics();
+
+    /** Get the metrics in the Prometheus text exposition format, empty when they are disabled */
+    std::string getMetricsPrometheus();
+
+    /**
+     * Coalesce identical asynchronous GET requests.
+     * A GET with the same url, headers and priority as one already queued or in flight is not
+     * sent again, its callback receives a copy of the in-flight request's response.
+     * Requests with a deadline or timeouts of their own are always sent on their own.
+     */
+    void enableRequestCoalescing(bool enable);
         
     /**
      * Add a get request to task queue
@@ -60,6 +147,44 @@ public:
      */
     bool sendAsynchronousRequest(HttpRequest::pointer request);
 
+    /**
+     * Add many requests to the task queue at once, taking the queue lock and waking
+     * the network thread once for all of them instead of once per request.
+     * Each request's own callback still runs as its response comes in.
+     * @param requests Distinct requests, none of them null
+     * @param callback Optional, called after the last request's callback. The requests'
+     *        callbacks are wrapped to track the batch, so a request belongs to one batch only
+     */
+    bool sendBatch(const std::vector<HttpRequest::pointer>& requests, const ccHttpBatchCallback& callback = nullptr);
+
+    /**
+     * Add a request to the task queue and get a future of its response, to compose
+     * requests with then(), whenAll() and whenAny(). The request's own callback, if any,
+     * runs first. Continuations run on the thread that dispatches the callbacks.
+     * @param request The request to send. When it is null the future is ready right away, with a failed response
+     */
+    HttpFuture<HttpResponse::pointer> sendAsync(HttpRequest::pointer request);
+
+#if HTTP_CLIENT_HAS_COROUTINES
+    /**
+     * Send a request from a C++20 coroutine: HttpResponse::pointer response = co_await client->send(request).
+     * The request's own callback, if any, runs first and is back in place when the coroutine
+     * resumes, so the request can be sent again. Include HttpAwaitable.h.
+     * @param executor Where the coroutine resumes, null to resume on the thread that dispatches the callbacks
+     */
+    HttpRequestAwaiter send(HttpRequest::pointer request, HttpExecutor* executor = nullptr);
+#endif
+
+    /**
+     * Withdraw a request given to sendAsynchronousRequest or sendSynchronousRequest.
+     * A queued request is dropped, a transfer in progress is aborted and its connection
+     * released. The callback still runs once, with a failed response whose error is
+     * "cancelled", unless the response was already on its way.
+     * A request coalesced with others keeps its transfer going until all of them are cancelled.
+     * @param request the request to cancel, cancellation is final
+     */
+    void cancelRequest(HttpRequest::pointer request);
+
     std::string sendSynchronousRequest(HttpRequest::pointer request, int& error);
   
     
@@ -88,6 +213,162 @@ public:
      * @return int
      */
     inline int getTimeoutForRead() {return _timeoutForRead;};
+
+    /**
+     * Abort transfers that stay slower than bytesPerSecond for seconds in a row,
+     * so a stalled connection fails long before the read timeout.
+     * @param bytesPerSecond The minimum average speed, 0 disables the check.
+     * @param seconds How long a transfer may stay below it.
+     */
+    inline void setLowSpeedLimit(long bytesPerSecond, long seconds) {_lowSpeedLimit = bytesPerSecond; _lowSpeedTime = seconds;};
+
+    /** Get the low speed limit in bytes per second, 0 if disabled */
+    inline long getLowSpeedLimit() {return _lowSpeedLimit;};
+
+    /** Get how many seconds a transfer may stay below the low speed limit */
+    inline long getLowSpeedTime() {return _lowSpeedTime;};
+
+    /**
+     * Change how many asynchronous requests may be transferred at the same time
+     * @param value The desired number of concurrent transfers.
+     */
+    inline void setMaxConcurrentRequests(int value) {_maxConcurrentRequests = value > 0 ? value : 1;};
+
+    /**
+     * Get the maximum number of concurrent transfers
+     * @return int
+     */
+    inline int getMaxConcurrentRequests() {return _maxConcurrentRequests;};
+
+    /**
+     * Change how many asynchronous requests to one host may be transferred at the same time.
+     * Queued requests are started round robin across hosts, so a backlog for one host
+     * doesn't hold up the others. Also caps the connections kept open to a host.
+     * @param value The desired number of concurrent transfers per host, 0 for no limit.
+     */
+    inline void setMaxConcurrentRequestsPerHost(int value) {_maxConcurrentRequestsPerHost = value > 0 ? value : 0;};
+
+    /**
+     * Get the maximum number of concurrent transfers per host
+     * @return int
+     */
+    inline int getMaxConcurrentRequestsPerHost() {return _maxConcurrentRequestsPerHost;};
+
+    /**
+     * Opt into HTTP/2. Asynchronous requests to one host are then multiplexed
+     * over a single pooled connection instead of opening one connection each.
+     * Needs libcurl 7.49 or newer built with HTTP/2 support, ignored otherwise.
+     * @param enable Use HTTP/2 where the server supports it
+     * @param priorKnowledge Also speak HTTP/2 over cleartext without an Upgrade round trip,
+     *        for servers known to accept it, e.g. a local h2c server
+     */
+    inline void enableHttp2(bool enable, bool priorKnowledge = false) {_enableHttp2 = enable; _http2PriorKnowledge = priorKnowledge;};
+
+    /** Is HTTP/2 enabled */
+    inline bool isHttp2Enabled() {return _enableHttp2;};
+
+    /** Is HTTP/2 spoken over cleartext without negotiation */
+    inline bool isHttp2PriorKnowledge() {return _http2PriorKnowledge;};
+
+    /**
+     * Hedge slow GET requests that opted in with HttpRequest::setHedgingEnabled().
+     * A request still unanswered after the given percentile of recent latencies to its host
+     * gets a second copy, sent in a free transfer slot to HttpRequest::getHedgeUrl() if set.
+     * The copy counts against the per-host limit and rate limit of the host it goes to,
+     * it waits while that host has no slot or token free.
+     * The first copy to succeed answers the request, the other one is cancelled,
+     * so the callback still runs once.
+     * @param enable Hedge requests that opted in
+     * @param percentile Fraction of the host's recent latencies to wait for, e.g. 0.95
+     * @param minDelayMs Lower bound of the wait, also used until the host has enough samples
+     */
+    inline void enableHedging(bool enable, double percentile = 0.95, long minDelayMs = 50) {_enableHedging = enable; _hedgePercentile = percentile; _hedgeMinDelayMs = minDelayMs;};
+
+    /** Is hedging enabled */
+    inline bool isHedgingEnabled() {return _enableHedging;};
+
+    /** Get the latency percentile after which a request is hedged */
+    inline double getHedgePercentile() {return _hedgePercentile;};
+
+    /** Get the minimum delay before a request is hedged */
+    inline long getHedgeMinDelayMs() {return _hedgeMinDelayMs;};
+
+    /**
+     * Size the retry budget shared by all requests with a retry policy. Each retryable
+     * failure takes a token, each success gives back tokenRatio of one, and retries are
+     * only made while more than half of maxTokens are left.
+     * @param maxTokens Size of the budget, 100 by default
+     * @param tokenRatio Tokens a success gives back, 0.1 by default
+     */
+    void setRetryBudget(double maxTokens, double tokenRatio);
+
+    /**
+     * Adjust how many requests may be in flight to each host from the responses it gets.
+     * The limit of a host grows while its responses come back as fast as usual and shrinks
+     * on timeouts, refused or reset connections, 429/503 responses or latencies well above
+     * the host's baseline. Requests over the limit wait in the queue. The limit stays within 1
+     * and getMaxConcurrentRequestsPerHost(), or getMaxConcurrentRequests() when that isn't set.
+     * @param enable Adapt the per host limits
+     * @param initialLimit Limit of a host before its first response
+     */
+    inline void enableAdaptiveConcurrency(bool enable, int initialLimit = 4) {_adaptiveConcurrency = enable; _adaptiveInitialLimit = initialLimit;};
+
+    /** Are per host limits adapted */
+    inline bool isAdaptiveConcurrencyEnabled() {return _adaptiveConcurrency;};
+
+    /** Get the limit of a host before its first response */
+    inline int getAdaptiveConcurrencyInitialLimit() {return _adaptiveInitialLimit;};
+
+    /**
+     * Limit the rate requests to a host are started at, for upstreams with strict QPS quotas.
+     * Asynchronous requests over the rate wait in the queue, synchronous ones on the caller's
+     * thread. Retries count against the rate too.
+     * @param host Host as the urls give it, with the port when they give one, e.g. "api.example.com:8443"
+     * @param requestsPerSecond Average rate, 0 removes the limit
+     * @param burst Requests that may start back to back after the host was quiet
+     */
+    void setHostRateLimit(const std::string& host, double requestsPerSecond, double burst = 1);
+
+    /**
+     * Share a bandwidth budget among the transfers in progress, weighted by request priority:
+     * a HIGH transfer gets twice the share of a NORMAL one, which gets twice that of a LOW one,
+     * and so on down to BACKGROUND. Shares are shifted whenever an asynchronous transfer starts
+     * or ends, a synchronous transfer keeps the share it got when it started. A request's own
+     * caps, HttpRequest::setMaxSendSpeed() and setMaxRecvSpeed(), still apply within its share.
+     * @param sendBytesPerSecond Upload budget, 0 for none
+     * @param recvBytesPerSecond Download budget, 0 for none
+     */
+    inline void setBandwidthLimit(long long sendBytesPerSecond, long long recvBytesPerSecond) {_sendBandwidth = sendBytesPerSecond; _recvBandwidth = recvBytesPerSecond;};
+
+    /** Get the upload budget */
+    inline long long getSendBandwidthLimit() {return _sendBandwidth;};
+
+    /** Get the download budget */
+    inline long long getRecvBandwidthLimit() {return _recvBandwidth;};
+
+    /**
+     * Choose where response callbacks run. By default, null, the network thread runs them,
+     * so a slow callback holds up every transfer. Given an executor, the network thread only
+     * hands the callbacks over: use an HttpThreadPoolExecutor for threads of their own, an
+     * HttpEventLoopExecutor to run them from the application's loop, or an executor of your own.
+     * Callbacks still run one at a time, in completion order. Set it before sending requests,
+     * the executor must outlive the client.
+     */
+    inline void setCallbackExecutor(HttpExecutor* executor) {_callbackExecutor = executor;};
+
+    /** Get the executor response callbacks run on, null for the network thread */
+    inline HttpExecutor* getCallbackExecutor() {return _callbackExecutor;};
+
+    /**
+     * Hand completed responses to a completion queue instead of running their callbacks,
+     * for applications with an event loop of their own. The loop polls the queue's descriptor
+     * and drains all waiting responses at once. Takes precedence over the callback executor.
+     * Set it before sending requests, the queue must outlive the client. Null to stop.
+     */
+    inline void setCompletionQueue(HttpCompletionQueue* queue) {_completionQueue = queue;};
+
+    /** Get the completion queue responses go to, null when callbacks run */
+    inline HttpCompletionQueue* getCompletionQueue() {return _completionQueue;};
         
 private:
     HttpClient();
@@ -102,10 +383,28 @@ private:
     void networkThread();
     /** Poll function called from main thread to dispatch callbacks when http requests finished **/
     void dispatchResponseCallbacks();
+    /** Run the callbacks of the queued responses, or hand them to the callback executor **/
+    void deliverResponses();
+    static void drainResponses(void* client);
     
 private:
     int _timeoutForConnect;
     int _timeoutForRead;
+    long _lowSpeedLimit;
+    long _lowSpeedTime;
+    int _maxConcurrentRequests;
+    int _maxConcurrentRequestsPerHost;
+    bool _enableHttp2;
+    bool _http2PriorKnowledge;
+    bool _enableHedging;
+    double _hedgePercentile;
+    long _hedgeMinDelayMs;
+    bool _adaptiveConcurrency;
+    int _adaptiveInitialLimit;
+    long long _sendBandwidth;
+    long long _recvBandwidth;
+    HttpExecutor* _callbackExecutor;
+    HttpCompletionQueue* _completionQueue;
 };
 
 }
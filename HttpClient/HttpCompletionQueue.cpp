@@ -0,0 +1,177 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#include "HttpCompletionQueue.h"
+#include "HttpClient.h"
+#include "HttpTrace.h"
+#include "HttpAllocations.h"
+
+#if defined(__linux__) || defined(__ANDROID__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdint.h>
+#define HTTP_COMPLETION_EVENTFD 1
+#elif !defined(_WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#define HTTP_COMPLETION_PIPE 1
+#endif
+
+namespace network {
+
+HttpCompletionQueue::HttpCompletionQueue()
+: _readFd(-1)
+, _writeFd(-1)
+{
+#if defined(HTTP_COMPLETION_EVENTFD)
+    _readFd = _writeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#elif defined(HTTP_COMPLETION_PIPE)
+    int fds[2];
+    if (pipe(fds) == 0)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        }
+        _readFd = fds[0];
+        _writeFd = fds[1];
+    }
+#endif
+}
+
+HttpCompletionQueue::~HttpCompletionQueue()
+{
+#if defined(HTTP_COMPLETION_EVENTFD) || defined(HTTP_COMPLETION_PIPE)
+    if (_readFd >= 0)
+    {
+        close(_readFd);
+    }
+    if (_writeFd >= 0 && _writeFd != _readFd)
+    {
+        close(_writeFd);
+    }
+#endif
+}
+
+void HttpCompletionQueue::signal()
+{
+#if defined(HTTP_COMPLETION_EVENTFD)
+    uint64_t one = 1;
+    ssize_t written = write(_writeFd, &one, sizeof(one));
+    (void)written;
+#elif defined(HTTP_COMPLETION_PIPE)
+    char one = 1;
+    ssize_t written = write(_writeFd, &one, 1);
+    (void)written;
+#endif
+}
+
+void HttpCompletionQueue::clearSignal()
+{
+#if defined(HTTP_COMPLETION_EVENTFD)
+    uint64_t count;
+    ssize_t got = read(_readFd, &count, sizeof(count));
+    (void)got;
+#elif defined(HTTP_COMPLETION_PIPE)
+    char bytes[64];
+    while (read(_readFd, bytes, sizeof(bytes)) > 0)
+    {
+    }
+#endif
+}
+
+void HttpCompletionQueue::push(std::vector<HttpResponse::pointer>& responses)
+{
+    if (responses.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Only the first batch after a drain signals, the descriptor stays readable until the next drain
+    bool wasEmpty = _responses.empty();
+    if (wasEmpty)
+    {
+        _responses.swap(responses);
+    }
+    else
+    {
+        _responses.insert(_responses.end(), responses.begin(), responses.end());
+    }
+    responses.clear();
+    if (wasEmpty && _writeFd >= 0)
+    {
+        signal();
+    }
+}
+
+size_t HttpCompletionQueue::drain(std::vector<HttpResponse::pointer>& responses)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t count = _responses.size();
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (responses.empty())
+    {
+        responses.swap(_responses);
+    }
+    else
+    {
+        responses.insert(responses.end(), _responses.begin(), _responses.end());
+        _responses.clear();
+    }
+    if (_readFd >= 0)
+    {
+        clearSignal();
+    }
+    // the application has the responses now, that ends their dispatch
+    for (size_t i = responses.size() - count; i < responses.size(); ++i)
+    {
+        responses[i]->markDispatched();
+        HttpTrace::asyncEnd("dispatch", responses[i]->getHttpRequest().get());
+    }
+    return count;
+}
+
+size_t HttpCompletionQueue::dispatch(HttpClient* client)
+{
+    HttpAllocationScope allocations(HttpAllocations::DISPATCH);
+    std::vector<HttpResponse::pointer> responses;
+    drain(responses);
+    for (std::vector<HttpResponse::pointer>::iterator it = responses.begin(); it != responses.end(); ++it)
+    {
+        const ccHttpRequestCallback& callback = (*it)->getHttpRequest()->getCallback();
+        if (callback != nullptr)
+        {
+            HttpTraceScope trace("callback");
+            HttpAllocationScope calling(HttpAllocations::CALLBACK);
+            callback(client, *it);
+        }
+    }
+    return responses.size();
+}
+
+}
@@ -0,0 +1,83 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_COMPLETION_QUEUE_H__
+#define __HTTP_COMPLETION_QUEUE_H__
+
+#include <vector>
+#include <mutex>
+#include "HttpResponse.h"
+
+namespace network {
+
+class HttpClient;
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Completed responses waiting for an application's own event loop.
+ * Give the queue to HttpClient::setCompletionQueue() and register getFd() with epoll/poll/select:
+ * it turns readable once responses are waiting, and drain() hands them all over at once.
+ * The descriptor is an eventfd on Linux and Android, a pipe on other POSIX systems.
+ * Windows has no such descriptor, drain() has to be polled there.
+ */
+class HttpCompletionQueue
+{
+public:
+    HttpCompletionQueue();
+    ~HttpCompletionQueue();
+
+    /** Descriptor that polls readable while responses are waiting, -1 where there is none */
+    inline int getFd() const
+    {
+        return _readFd;
+    }
+
+    /** Queue responses, leaving the vector empty, and signal the descriptor. HttpClient's network thread calls this */
+    void push(std::vector<HttpResponse::pointer>& responses);
+
+    /** Move every waiting response to the end of responses and reset the descriptor, returns how many were moved */
+    size_t drain(std::vector<HttpResponse::pointer>& responses);
+
+    /** Drain, then run each response's request callback on the calling thread. Returns how many ran */
+    size_t dispatch(HttpClient* client);
+
+private:
+    void signal();
+    void clearSignal();
+
+private:
+    std::mutex                          _mutex;
+    std::vector<HttpResponse::pointer>  _responses;
+    int                                 _readFd;
+    int                                 _writeFd;   /// same as _readFd for an eventfd
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_COMPLETION_QUEUE_H__
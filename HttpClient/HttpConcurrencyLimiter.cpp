@@ -0,0 +1,114 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#include <algorithm>
+#include "HttpConcurrencyLimiter.h"
+
+namespace network {
+
+// Responses per baseline window, the baseline follows a host whose latency changes for good
+static const int s_baselineWindow = 500;
+
+// Latency jitter below this many milliseconds is never taken for overload, whatever the baseline
+static const long s_latencySlackMs = 10;
+
+HttpConcurrencyLimiter::HttpConcurrencyLimiter(int initialLimit, int minLimit, int maxLimit, double backoffRatio, double tolerance)
+: _initialLimit(initialLimit)
+, _minLimit(std::max(1, minLimit))
+, _maxLimit(std::max(std::max(1, minLimit), maxLimit))
+, _backoffRatio(backoffRatio)
+, _tolerance(tolerance)
+{
+}
+
+int HttpConcurrencyLimiter::onResponse(const std::string& host, long latencyMs, bool overloaded, int inFlight)
+{
+    Host& state = _hosts[host];
+    if (state.limit == 0)
+    {
+        state.limit = getInitialLimit();
+    }
+
+    // Failures say nothing about how fast the host answers, only responses feed the baseline.
+    // The lowest latency of the previous window stays the baseline while the next one is collected
+    if (!overloaded)
+    {
+        if (state.baselineMs < 0)
+        {
+            state.baselineMs = latencyMs;
+            state.nextBaselineMs = latencyMs;
+        }
+        state.baselineMs = std::min(state.baselineMs, latencyMs);
+        state.nextBaselineMs = std::min(state.nextBaselineMs, latencyMs);
+        if (++state.samples >= s_baselineWindow)
+        {
+            state.baselineMs = state.nextBaselineMs;
+            state.nextBaselineMs = latencyMs;
+            state.samples = 0;
+        }
+        overloaded = latencyMs > state.baselineMs * _tolerance && latencyMs > state.baselineMs + s_latencySlackMs;
+    }
+
+    if (overloaded)
+    {
+        // requests sent under the limit in force before the last decrease don't count again
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - std::chrono::milliseconds(latencyMs) >= state.lastDecrease)
+        {
+            state.limit = std::max((double)_minLimit, state.limit * _backoffRatio);
+            state.lastDecrease = now;
+        }
+    }
+    else if (inFlight * 2 >= (int)state.limit)
+    {
+        // only grow a limit that is actually in use
+        state.limit = std::min((double)_maxLimit, state.limit + 1.0 / state.limit);
+    }
+    return (int)state.limit;
+}
+
+int HttpConcurrencyLimiter::getLimit(const std::string& host) const
+{
+    std::unordered_map<std::string, Host>::const_iterator it = _hosts.find(host);
+    if (it == _hosts.end())
+    {
+        return getInitialLimit();
+    }
+    return (int)it->second.limit;
+}
+
+int HttpConcurrencyLimiter::getInitialLimit() const
+{
+    return std::min(std::max(_initialLimit, _minLimit), _maxLimit);
+}
+
+void HttpConcurrencyLimiter::setMaxLimit(int maxLimit)
+{
+    _maxLimit = std::max(_minLimit, maxLimit);
+    for (std::unordered_map<std::string, Host>::iterator it = _hosts.begin(); it != _hosts.end(); ++it)
+    {
+        it->second.limit = std::min(it->second.limit, (double)_maxLimit);
+    }
+}
+
+}
@@ -0,0 +1,115 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_CONCURRENCY_LIMITER_H__
+#define __HTTP_CONCURRENCY_LIMITER_H__
+
+#include <string>
+#include <unordered_map>
+#include <chrono>
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Per host concurrency limit adjusted from the responses it gets (AIMD).
+ * Every response below the overload threshold raises the limit of its host by 1/limit,
+ * about one more request per round of responses, as long as the host actually uses its
+ * limit. A response that shows overload, a connection failure, a timeout, 429/503, or a
+ * latency well above the host's baseline, multiplies the limit by the backoff ratio,
+ * once per round: requests sent before the last decrease don't decrease it again.
+ * The baseline is the lowest latency seen recently, so the limiter settles where the
+ * host answers as fast as it can while as many requests as possible are in flight.
+ * The limiter isn't thread safe, HttpClient only touches it from its network thread.
+ */
+class HttpConcurrencyLimiter
+{
+public:
+    /**
+     * @param initialLimit limit of a host not seen before
+     * @param minLimit the limit never goes below
+     * @param maxLimit the limit never goes above
+     * @param backoffRatio factor applied to the limit on overload
+     * @param tolerance latency above tolerance times the baseline counts as overload
+     */
+    HttpConcurrencyLimiter(int initialLimit = 4, int minLimit = 1, int maxLimit = 64, double backoffRatio = 0.9, double tolerance = 2.0);
+
+    /** Account for a response from host.
+     @param latencyMs time the request took
+     @param overloaded the response itself signals overload, e.g. a timeout or 503
+     @param inFlight requests to host still in flight
+     @return the new limit of host
+     */
+    int onResponse(const std::string& host, long latencyMs, bool overloaded, int inFlight);
+
+    /** Current limit of host */
+    int getLimit(const std::string& host) const;
+
+    /** Limit of a host not seen before, within the bounds */
+    int getInitialLimit() const;
+
+    /** Change the upper bound, e.g. when the client allows more transfers */
+    void setMaxLimit(int maxLimit);
+
+    /** Forget everything learned about every host */
+    inline void clear()
+    {
+        _hosts.clear();
+    }
+
+private:
+    struct Host
+    {
+        Host()
+        : limit(0)
+        , baselineMs(-1)
+        , nextBaselineMs(-1)
+        , samples(0)
+        {
+        }
+
+        double                                  limit;
+        std::chrono::steady_clock::time_point   lastDecrease;   /// when the limit was last cut
+        long                                    baselineMs;     /// lowest latency of the current window, -1 before the first response
+        long                                    nextBaselineMs; /// lowest latency of the window being collected
+        int                                     samples;        /// responses in the window being collected
+    };
+
+private:
+    std::unordered_map<std::string, Host>   _hosts;
+    int                                     _initialLimit;
+    int                                     _minLimit;
+    int                                     _maxLimit;
+    double                                  _backoffRatio;
+    double                                  _tolerance;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_CONCURRENCY_LIMITER_H__
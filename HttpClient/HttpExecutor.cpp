@@ -0,0 +1,100 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#include "HttpExecutor.h"
+
+namespace network {
+
+HttpThreadPoolExecutor::HttpThreadPoolExecutor(size_t threadCount)
+: _stopping(false)
+{
+    if (threadCount == 0)
+    {
+        threadCount = 1;
+    }
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        _threads.push_back(std::thread(&HttpThreadPoolExecutor::run, this));
+    }
+}
+
+HttpThreadPoolExecutor::~HttpThreadPoolExecutor()
+{
+    _mutex.lock();
+    _stopping = true;
+    _mutex.unlock();
+    _condition.notify_all();
+    for (std::vector<std::thread>::iterator it = _threads.begin(); it != _threads.end(); ++it)
+    {
+        it->join();
+    }
+}
+
+void HttpThreadPoolExecutor::post(Work work, void* context)
+{
+    _mutex.lock();
+    _queue.push_back(std::make_pair(work, context));
+    _mutex.unlock();
+    _condition.notify_one();
+}
+
+void HttpThreadPoolExecutor::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _condition.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+        if (_queue.empty())
+        {
+            return;
+        }
+        std::pair<Work, void*> next = _queue.front();
+        _queue.pop_front();
+
+        lock.unlock();
+        next.first(next.second);
+        lock.lock();
+    }
+}
+
+void HttpEventLoopExecutor::post(Work work, void* context)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _queue.push_back(std::make_pair(work, context));
+}
+
+size_t HttpEventLoopExecutor::runPending()
+{
+    std::vector<std::pair<Work, void*> > pending;
+    _mutex.lock();
+    pending.swap(_queue);
+    _mutex.unlock();
+
+    for (std::vector<std::pair<Work, void*> >::iterator it = pending.begin(); it != pending.end(); ++it)
+    {
+        it->first(it->second);
+    }
+    return pending.size();
+}
+
+}
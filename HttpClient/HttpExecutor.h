@@ -0,0 +1,98 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_EXECUTOR_H__
+#define __HTTP_EXECUTOR_H__
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Somewhere to run work handed over by HttpClient, e.g. a thread pool or a game loop.
+ * Work is a plain function and a context pointer, so handing it over allocates nothing.
+ * Implementations must be thread safe, work is posted from HttpClient's network thread.
+ */
+class HttpExecutor
+{
+public:
+    typedef void (*Work)(void* context);
+
+    virtual ~HttpExecutor()
+    {
+    }
+
+    /** Run work(context) once, on the executor's thread(s), later or right away */
+    virtual void post(Work work, void* context) = 0;
+};
+
+/** @brief Runs posted work on a fixed set of threads of its own */
+class HttpThreadPoolExecutor : public HttpExecutor
+{
+public:
+    explicit HttpThreadPoolExecutor(size_t threadCount = 1);
+
+    /** Runs the work still queued, then joins the threads */
+    virtual ~HttpThreadPoolExecutor();
+
+    virtual void post(Work work, void* context);
+
+private:
+    void run();
+
+private:
+    std::mutex                                  _mutex;
+    std::condition_variable                     _condition;
+    std::deque<std::pair<Work, void*> >         _queue;
+    std::vector<std::thread>                    _threads;
+    bool                                        _stopping;
+};
+
+/** @brief Keeps posted work until the application's own loop runs it, e.g. once per frame */
+class HttpEventLoopExecutor : public HttpExecutor
+{
+public:
+    virtual void post(Work work, void* context);
+
+    /** Run the work posted so far on the calling thread, returns how much there was */
+    size_t runPending();
+
+private:
+    std::mutex                                  _mutex;
+    std::vector<std::pair<Work, void*> >        _queue;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_EXECUTOR_H__
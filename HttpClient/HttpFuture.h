@@ -0,0 +1,323 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_FUTURE_H__
+#define __HTTP_FUTURE_H__
+
+#include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <utility>
+#include <future>
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Shared state of an HttpPromise and its futures.
+ * Holds the value once set, and the continuations waiting for it. Only the first
+ * value set counts. Continuations run on the thread that sets the value, or on the
+ * thread that adds them when the value is already there.
+ */
+template <class T>
+class HttpFutureState
+{
+public:
+    typedef std::function<void(const T&)> Continuation;
+
+    HttpFutureState()
+    : _ready(false)
+    {
+    }
+
+    /** Set the value and run the continuations. Returns false if a value was already set */
+    bool setValue(const T& value)
+    {
+        std::vector<Continuation> continuations;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_ready)
+            {
+                return false;
+            }
+            _value = value;
+            _ready = true;
+            continuations.swap(_continuations);
+        }
+        _condition.notify_all();
+        for (typename std::vector<Continuation>::iterator it = continuations.begin(); it != continuations.end(); ++it)
+        {
+            (*it)(_value);
+        }
+        return true;
+    }
+
+    /** Run continuation once the value is set, right away if it already is */
+    void onReady(const Continuation& continuation)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_ready)
+            {
+                _continuations.push_back(continuation);
+                return;
+            }
+        }
+        continuation(_value);
+    }
+
+    bool isReady()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _ready;
+    }
+
+    /** Block until the value is set */
+    const T& wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition.wait(lock, [this]() { return _ready; });
+        return _value;
+    }
+
+    /** Block until the value is set or milliseconds passed, returns whether it is set */
+    bool waitFor(long milliseconds)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _condition.wait_for(lock, std::chrono::milliseconds(milliseconds), [this]() { return _ready; });
+    }
+
+private:
+    std::mutex                  _mutex;
+    std::condition_variable     _condition;
+    bool                        _ready;
+    T                           _value;          /// never changes once _ready
+    std::vector<Continuation>   _continuations;  /// run, then dropped, when the value is set
+};
+
+template <class T> class HttpFuture;
+
+/** What then() turns a continuation's result into: a value becomes the value of the
+    next future, a future is waited for, so continuations that send requests chain flat */
+template <class R>
+struct HttpFutureResult
+{
+    typedef R type;
+
+    static void forward(const R& result, const std::shared_ptr<HttpFutureState<R> >& next)
+    {
+        next->setValue(result);
+    }
+};
+
+template <class U>
+struct HttpFutureResult<HttpFuture<U> >
+{
+    typedef U type;
+
+    static void forward(const HttpFuture<U>& result, const std::shared_ptr<HttpFutureState<U> >& next)
+    {
+        result.onReady([next](const U& value) {
+            next->setValue(value);
+        });
+    }
+};
+
+/** @brief Handle on a value that becomes available later, e.g. the response of an asynchronous request.
+ * Handles are cheap to copy and all share the same state. Compose them with then(), whenAll()
+ * and whenAny() rather than blocking on get(): get() must not be called from the thread
+ * that sets the value, for HttpClient's futures the thread that runs the callbacks.
+ * An invalid future never becomes ready: continuations added to it never run, then() on it
+ * gives another invalid future, and get() on it throws.
+ */
+template <class T>
+class HttpFuture
+{
+public:
+    /** An invalid future, that never becomes ready */
+    HttpFuture()
+    {
+    }
+
+    explicit HttpFuture(const std::shared_ptr<HttpFutureState<T> >& state)
+    : _state(state)
+    {
+    }
+
+    inline bool isValid() const
+    {
+        return _state != nullptr;
+    }
+
+    inline bool isReady() const
+    {
+        return _state && _state->isReady();
+    }
+
+    /** Block until the value is available and return it.
+     Throws std::future_error with std::future_errc::no_state if the future is invalid */
+    inline const T& get() const
+    {
+        if (!_state)
+        {
+            throwNoState();
+        }
+        return _state->wait();
+    }
+
+    /** Block until the value is available or milliseconds passed, returns whether it is available */
+    inline bool waitFor(long milliseconds) const
+    {
+        return _state && _state->waitFor(milliseconds);
+    }
+
+    /** Run continuation with the value once it is available */
+    inline void onReady(const std::function<void(const T&)>& continuation) const
+    {
+        if (_state)
+        {
+            _state->onReady(continuation);
+        }
+    }
+
+    /**
+     * Future of what continuation makes of the value. continuation takes a const T& and returns
+     * either a value, or an HttpFuture, e.g. of the next request, which then() waits for.
+     */
+    template <class F>
+    HttpFuture<typename HttpFutureResult<typename std::decay<decltype(std::declval<F&>()(std::declval<const T&>()))>::type>::type> then(F continuation) const
+    {
+        typedef typename std::decay<decltype(std::declval<F&>()(std::declval<const T&>()))>::type Result;
+        typedef typename HttpFutureResult<Result>::type U;
+
+        if (!_state)
+        {
+            return HttpFuture<U>();
+        }
+        std::shared_ptr<HttpFutureState<U> > next(new HttpFutureState<U>());
+        _state->onReady([continuation, next](const T& value) mutable {
+            HttpFutureResult<Result>::forward(continuation(value), next);
+        });
+        return HttpFuture<U>(next);
+    }
+
+private:
+    /** std::future_error only gets a public error code constructor in C++17, before that
+     the library has to throw it: setting the value of a promise that has no state does */
+    static void throwNoState()
+    {
+        std::promise<void> moved;
+        std::promise<void> owner(std::move(moved));
+        moved.set_value();
+    }
+
+    std::shared_ptr<HttpFutureState<T> > _state;
+};
+
+/** @brief Producer side of an HttpFuture */
+template <class T>
+class HttpPromise
+{
+public:
+    HttpPromise()
+    : _state(new HttpFutureState<T>())
+    {
+    }
+
+    inline HttpFuture<T> getFuture() const
+    {
+        return HttpFuture<T>(_state);
+    }
+
+    /** Make the value available, returns false if it already was */
+    inline bool setValue(const T& value) const
+    {
+        return _state->setValue(value);
+    }
+
+private:
+    std::shared_ptr<HttpFutureState<T> > _state;
+};
+
+/** Future of all the futures' values, in their order. Ready right away for no futures,
+    never ready if one of them is invalid */
+template <class T>
+HttpFuture<std::vector<T> > whenAll(const std::vector<HttpFuture<T> >& futures)
+{
+    struct Gather
+    {
+        std::vector<T>      values;
+        std::atomic<size_t> remaining;
+    };
+
+    HttpPromise<std::vector<T> > promise;
+    if (futures.empty())
+    {
+        promise.setValue(std::vector<T>());
+        return promise.getFuture();
+    }
+
+    std::shared_ptr<Gather> gather(new Gather());
+    gather->values.resize(futures.size());
+    gather->remaining = futures.size();
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        futures[i].onReady([gather, i, promise](const T& value) {
+            gather->values[i] = value;
+            if (--gather->remaining == 0)
+            {
+                promise.setValue(gather->values);
+            }
+        });
+    }
+    return promise.getFuture();
+}
+
+/** Future of the first value available among futures, with its index. Never ready for no futures,
+    invalid ones are never the first */
+template <class T>
+HttpFuture<std::pair<size_t, T> > whenAny(const std::vector<HttpFuture<T> >& futures)
+{
+    HttpPromise<std::pair<size_t, T> > promise;
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        futures[i].onReady([i, promise](const T& value) {
+            promise.setValue(std::make_pair(i, value));
+        });
+    }
+    return promise.getFuture();
+}
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_FUTURE_H__
@@ -0,0 +1,68 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#include <algorithm>
+#include "HttpLatencyTracker.h"
+
+namespace network {
+
+HttpLatencyTracker::HttpLatencyTracker(size_t window)
+: _window(window > 0 ? window : 1)
+{
+}
+
+void HttpLatencyTracker::record(const std::string& host, long milliseconds)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Window& window = _hosts[host];
+    if (window.samples.size() < _window)
+    {
+        window.samples.push_back(milliseconds);
+        return;
+    }
+    window.samples[window.next] = milliseconds;
+    window.next = (window.next + 1) % _window;
+}
+
+long HttpLatencyTracker::percentile(const std::string& host, double fraction, size_t minSamples) const
+{
+    std::vector<long> samples;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        std::unordered_map<std::string, Window>::const_iterator it = _hosts.find(host);
+        if (it == _hosts.end() || it->second.samples.empty() || it->second.samples.size() < minSamples)
+        {
+            return -1;
+        }
+        samples = it->second.samples;
+    }
+
+    fraction = std::min(1.0, std::max(0.0, fraction));
+    std::vector<long>::iterator nth = samples.begin() + (size_t)(fraction * (samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), nth, samples.end());
+    return *nth;
+}
+
+}
@@ -0,0 +1,80 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_LATENCY_TRACKER_H__
+#define __HTTP_LATENCY_TRACKER_H__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Recent response latencies, per host.
+ * Keeps a sliding window of the last samples of each host, so percentiles follow
+ * the host's current behaviour rather than its whole history.
+ */
+class HttpLatencyTracker
+{
+public:
+    /** @param window number of samples kept per host */
+    explicit HttpLatencyTracker(size_t window = 128);
+
+    /** Add a latency sample for host */
+    void record(const std::string& host, long milliseconds);
+
+    /** Latency under which the given fraction of host's recent samples fall, e.g. 0.95.
+     @return -1 if fewer than minSamples were recorded for host
+     */
+    long percentile(const std::string& host, double fraction, size_t minSamples) const;
+
+private:
+    struct Window
+    {
+        Window()
+        : next(0)
+        {
+        }
+
+        std::vector<long> samples;
+        size_t            next;     /// slot the next sample overwrites once the window is full
+    };
+
+private:
+    size_t                                  _window;
+    std::unordered_map<std::string, Window> _hosts;
+    mutable std::mutex                      _mutex;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_LATENCY_TRACKER_H__
@@ -0,0 +1,190 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include <algorithm>
+#include "HttpMemoryCache.h"
+
+namespace network {
+
+// Rough per entry bookkeeping cost: list node, hash node and the vectors' headers
+static const size_t s_entryOverhead = 128;
+
+HttpMemoryCache::HttpMemoryCache(size_t byteBudget, size_t shardCount)
+: _byteBudget(byteBudget)
+, _hits(0)
+, _misses(0)
+, _insertions(0)
+, _evictions(0)
+, _expirations(0)
+{
+    if (shardCount == 0)
+    {
+        shardCount = 1;
+    }
+    _shardBudget = byteBudget / shardCount;
+    for (size_t i = 0; i < shardCount; ++i)
+    {
+        _shards.push_back(std::unique_ptr<Shard>(new Shard()));
+    }
+}
+
+std::string HttpMemoryCache::keyFor(HttpRequest::pointer request)
+{
+    std::vector<std::string> headers = request->getHeaders();
+    std::sort(headers.begin(), headers.end());
+
+    std::string key(request->getUrl());
+    for (std::vector<std::string>::iterator it = headers.begin(); it != headers.end(); ++it)
+    {
+        key.append("\n").append(*it);
+    }
+    return key;
+}
+
+HttpMemoryCache::Shard& HttpMemoryCache::shardFor(const std::string& key)
+{
+    // Shard on the url part only, so all variants of a url live in the same shard
+    size_t urlLength = key.find('\n');
+    std::hash<std::string> hasher;
+    size_t hash = hasher(urlLength == std::string::npos ? key : key.substr(0, urlLength));
+    return *_shards[hash % _shards.size()];
+}
+
+size_t HttpMemoryCache::entrySize(const std::string& key, const Entry& entry)
+{
+    return s_entryOverhead + key.size() + (entry.header ? entry.header->size() : 0) + (entry.body ? entry.body->size() : 0);
+}
+
+void HttpMemoryCache::erase(Shard& shard, LruList::iterator it)
+{
+    shard.bytes -= entrySize(it->first, it->second);
+    shard.index.erase(it->first);
+    shard.lru.erase(it);
+}
+
+bool HttpMemoryCache::lookup(const std::string& key, Entry& entry)
+{
+    Shard& shard = shardFor(key);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        std::unordered_map<std::string, LruList::iterator>::iterator found = shard.index.find(key);
+        if (found != shard.index.end())
+        {
+            LruList::iterator it = found->second;
+            if (it->second.expiresAt > time(nullptr))
+            {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it);
+                entry = it->second;
+                ++_hits;
+                return true;
+            }
+            erase(shard, it);
+            ++_expirations;
+        }
+    }
+    ++_misses;
+    return false;
+}
+
+void HttpMemoryCache::store(const std::string& key, const Entry& entry)
+{
+    size_t size = entrySize(key, entry);
+    if (size > _shardBudget)
+    {
+        return;
+    }
+
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    std::unordered_map<std::string, LruList::iterator>::iterator found = shard.index.find(key);
+    if (found != shard.index.end())
+    {
+        erase(shard, found->second);
+    }
+
+    while (!shard.lru.empty() && shard.bytes + size > _shardBudget)
+    {
+        erase(shard, --shard.lru.end());
+        ++_evictions;
+    }
+
+    shard.lru.push_front(std::make_pair(key, entry));
+    shard.index[key] = shard.lru.begin();
+    shard.bytes += size;
+    ++_insertions;
+}
+
+void HttpMemoryCache::remove(const std::string& key)
+{
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    std::unordered_map<std::string, LruList::iterator>::iterator found = shard.index.find(key);
+    if (found != shard.index.end())
+    {
+        erase(shard, found->second);
+    }
+}
+
+void HttpMemoryCache::removeUrl(const char* url)
+{
+    std::string prefix(url);
+    Shard& shard = shardFor(prefix);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    LruList::iterator it = shard.lru.begin();
+    while (it != shard.lru.end())
+    {
+        const std::string& key = it->first;
+        bool sameUrl = key.compare(0, prefix.size(), prefix) == 0
+                    && (key.size() == prefix.size() || key[prefix.size()] == '\n');
+        if (sameUrl)
+        {
+            erase(shard, it++);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+HttpMemoryCache::Stats HttpMemoryCache::getStats()
+{
+    Stats stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.insertions = _insertions;
+    stats.evictions = _evictions;
+    stats.expirations = _expirations;
+    for (size_t i = 0; i < _shards.size(); ++i)
+    {
+        std::lock_guard<std::mutex> lock(_shards[i]->mutex);
+        stats.bytes += _shards[i]->bytes;
+        stats.entries += _shards[i]->lru.size();
+    }
+    return stats;
+}
+
+}
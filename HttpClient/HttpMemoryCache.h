@@ -0,0 +1,161 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __HTTP_MEMORY_CACHE_H__
+#define __HTTP_MEMORY_CACHE_H__
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <ctime>
+#include <stdint.h>
+#include "HttpRequest.h"
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Sharded in-memory LRU cache for small, hot GET responses.
+ * The cache sits in front of the disk cache and the network. Bodies are kept as
+ * refcounted immutable buffers, a hit hands the same buffers to every reader.
+ * Only responses that are fresh according to their Cache-Control/Expires headers
+ * are kept, and an entry is dropped as soon as it goes stale.
+ */
+class HttpMemoryCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<char> > Body;
+    typedef std::shared_ptr<const std::vector<char> > Header;
+
+    /** A cached response, never modified once stored */
+    struct Entry
+    {
+        Entry()
+        : responseCode(0)
+        , expiresAt(0)
+        {
+        }
+
+        long                responseCode;
+        time_t              expiresAt;   /// local time the entry stops being fresh
+        Header              header;      /// shared raw header block
+        Body                body;        /// shared response body
+    };
+
+    /** Counters, all of them since the cache was created */
+    struct Stats
+    {
+        Stats()
+        : hits(0)
+        , misses(0)
+        , insertions(0)
+        , evictions(0)
+        , expirations(0)
+        , bytes(0)
+        , entries(0)
+        {
+        }
+
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t insertions;
+        uint64_t evictions;      /// entries pushed out to stay within the byte budget
+        uint64_t expirations;    /// entries dropped because they went stale
+        size_t   bytes;          /// bytes currently held
+        size_t   entries;        /// entries currently held
+    };
+
+    /**
+     * @param byteBudget upper bound of the memory held by all entries
+     * @param shardCount number of independently locked shards, the budget is split evenly
+     */
+    explicit HttpMemoryCache(size_t byteBudget, size_t shardCount = 16);
+
+    /** Cache key of a request: url plus every custom header, so Vary never mixes variants */
+    static std::string keyFor(HttpRequest::pointer request);
+
+    /** Find a fresh entry, stale entries are removed on the way */
+    bool lookup(const std::string& key, Entry& entry);
+
+    /** Insert or replace the entry for key, evicting least recently used entries as needed */
+    void store(const std::string& key, const Entry& entry);
+
+    /** Remove the entry for key, if any */
+    void remove(const std::string& key);
+
+    /** Drop every variant cached for url, used when an unsafe method hits the resource */
+    void removeUrl(const char* url);
+
+    /** Get the budget given at construction */
+    inline size_t getByteBudget() const
+    {
+        return _byteBudget;
+    }
+
+    /** Snapshot of the counters and current occupancy */
+    Stats getStats();
+
+private:
+    typedef std::list<std::pair<std::string, Entry> > LruList;
+
+    struct Shard
+    {
+        Shard()
+        : bytes(0)
+        {
+        }
+
+        std::mutex                                          mutex;
+        LruList                                             lru;     /// most recently used first
+        std::unordered_map<std::string, LruList::iterator>  index;
+        size_t                                              bytes;
+    };
+
+    Shard& shardFor(const std::string& key);
+    static size_t entrySize(const std::string& key, const Entry& entry);
+    void erase(Shard& shard, LruList::iterator it);
+
+private:
+    size_t                                  _byteBudget;
+    size_t                                  _shardBudget;
+    std::vector<std::unique_ptr<Shard> >    _shards;
+
+    std::atomic<uint64_t>                   _hits;
+    std::atomic<uint64_t>                   _misses;
+    std::atomic<uint64_t>                   _insertions;
+    std::atomic<uint64_t>                   _evictions;
+    std::atomic<uint64_t>                   _expirations;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_MEMORY_CACHE_H__
@@ -0,0 +1,384 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#include <stdio.h>
+#include <thread>
+#include <algorithm>
+#include "HttpMetrics.h"
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
+namespace network {
+
+// Bucket bounds of the exported Prometheus histograms, in microseconds
+static const uint64_t s_exportBounds[] = { 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000 };
+
+uint64_t HttpMetrics::Histogram::bucketLowerBound(size_t index)
+{
+    // below SUB_BUCKETS every value has its own bucket, above each power of two is split in SUB_BUCKETS
+    if (index < SUB_BUCKETS)
+    {
+        return index;
+    }
+    size_t exponent = index / SUB_BUCKETS + 3;
+    return (uint64_t)(SUB_BUCKETS + index % SUB_BUCKETS) << (exponent - 4);
+}
+
+size_t HttpMetrics::Histogram::bucketOf(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+    {
+        return (size_t)value;
+    }
+    size_t exponent = 4;
+    while (exponent < 63 && (value >> (exponent + 1)) != 0)
+    {
+        ++exponent;
+    }
+    size_t index = (exponent - 3) * SUB_BUCKETS + (size_t)((value >> (exponent - 4)) & (SUB_BUCKETS - 1));
+    return std::min(index, (size_t)BUCKETS - 1);
+}
+
+uint64_t HttpMetrics::Histogram::percentile(double fraction) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(fraction * count);
+    rank = std::min(std::max(rank, (uint64_t)1), count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            // report the middle of the bucket
+            uint64_t lower = bucketLowerBound(i);
+            uint64_t upper = i + 1 < buckets.size() ? bucketLowerBound(i + 1) : lower;
+            return lower + (upper - lower) / 2;
+        }
+    }
+    return bucketLowerBound(buckets.size() - 1);
+}
+
+double HttpMetrics::Snapshot::connectionReuseRatio() const
+{
+    uint64_t connections = connectionsOpened + connectionsReused;
+    return connections == 0 ? 0 : (double)connectionsReused / connections;
+}
+
+HttpMetrics::HttpMetrics()
+: _queueDepth(0)
+, _peakQueueDepth(0)
+, _inFlight(0)
+{
+    for (int i = 0; i < SHARDS; ++i)
+    {
+        _shards.push_back(std::unique_ptr<Shard>(new Shard()));
+    }
+}
+
+HttpMetrics::~HttpMetrics()
+{
+}
+
+HttpMetrics::Shard& HttpMetrics::currentShard()
+{
+    std::hash<std::thread::id> hasher;
+    return *_shards[hasher(std::this_thread::get_id()) % SHARDS];
+}
+
+const char* HttpMetrics::statusClassOf(long statusCode)
+{
+    static const char* classes[] = { "1xx", "2xx", "3xx", "4xx", "5xx" };
+    if (statusCode < 100 || statusCode >= 600)
+    {
+        return "error";
+    }
+    return classes[statusCode / 100 - 1];
+}
+
+std::string HttpMetrics::seriesKey(const std::string& host, const char* method, const char* statusClass)
+{
+    std::string key(host);
+    key.append("\n").append(method).append("\n").append(statusClass);
+    return key;
+}
+
+// FNV-1a over the three parts, the status class is one of statusClassOf()'s strings
+size_t HttpMetrics::seriesHash(const std::string& host, const char* method, const char* statusClass)
+{
+    uint32_t hash = 2166136261u;
+    for (std::string::const_iterator it = host.begin(); it != host.end(); ++it)
+    {
+        hash = (hash ^ (unsigned char)*it) * 16777619u;
+    }
+    for (const char* c = method; *c; ++c)
+    {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    for (const char* c = statusClass; *c; ++c)
+    {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return hash;
+}
+
+// Look a series up in the shard's index, without the lock and without allocating. Null if it isn't there
+HttpMetrics::SeriesData* HttpMetrics::findSeries(Shard& shard, size_t hash, const std::string& host, const char* method, const char* statusClass)
+{
+    for (size_t i = 0; i < SERIES_INDEX; ++i)
+    {
+        SeriesData* series = shard.index[(hash + i) % SERIES_INDEX].load(std::memory_order_acquire);
+        if (nullptr == series)
+        {
+            return nullptr;
+        }
+        if (series->statusClass == statusClass && series->host == host && series->method == method)
+        {
+            return series;
+        }
+    }
+    return nullptr;
+}
+
+// Find or create a series under the lock. Series beyond the index's capacity are only found here
+HttpMetrics::SeriesData* HttpMetrics::addSeries(Shard& shard, size_t hash, const std::string& host, const char* method, const char* statusClass)
+{
+    std::lock_guard<std::mutex> lock(shard.seriesMutex);
+    std::unique_ptr<SeriesData>& slot = shard.series[seriesKey(host, method, statusClass)];
+    if (slot)
+    {
+        return slot.get();
+    }
+    slot.reset(new SeriesData());
+    slot->host = host;
+    slot->method = method;
+    slot->statusClass = statusClass;
+
+    // published once complete, the index only ever gains entries
+    for (size_t i = 0; i < SERIES_INDEX; ++i)
+    {
+        std::atomic<SeriesData*>& entry = shard.index[(hash + i) % SERIES_INDEX];
+        if (nullptr == entry.load(std::memory_order_relaxed))
+        {
+            entry.store(slot.get(), std::memory_order_release);
+            break;
+        }
+    }
+    return slot.get();
+}
+
+void HttpMetrics::recordRequest(const std::string& host, const char* method, long statusCode, uint64_t latencyUs,
+                                uint64_t bytesSent, uint64_t bytesReceived, bool reused)
+{
+    Shard& shard = currentShard();
+    shard.requests.fetch_add(1, std::memory_order_relaxed);
+    shard.bytesSent.fetch_add(bytesSent, std::memory_order_relaxed);
+    shard.bytesReceived.fetch_add(bytesReceived, std::memory_order_relaxed);
+    if (statusCode <= 0)
+    {
+        shard.failures.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (reused)
+    {
+        shard.connectionsReused.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        shard.connectionsOpened.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // A series seen before is found without the lock, only the first request of a series takes it
+    const char* statusClass = statusClassOf(statusCode);
+    size_t hash = seriesHash(host, method, statusClass);
+    SeriesData* series = findSeries(shard, hash, host, method, statusClass);
+    if (nullptr == series)
+    {
+        series = addSeries(shard, hash, host, method, statusClass);
+    }
+    // series are never removed, the pointer outlives the lock
+    series->requests.fetch_add(1, std::memory_order_relaxed);
+    series->count.fetch_add(1, std::memory_order_relaxed);
+    series->sum.fetch_add(latencyUs, std::memory_order_relaxed);
+    series->buckets[Histogram::bucketOf(latencyUs)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void HttpMetrics::recordRetry()
+{
+    currentShard().retries.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HttpMetrics::setQueueDepth(size_t queued, size_t inFlight)
+{
+    _queueDepth.store(queued, std::memory_order_relaxed);
+    _inFlight.store(inFlight, std::memory_order_relaxed);
+    if (queued > _peakQueueDepth.load(std::memory_order_relaxed))
+    {
+        _peakQueueDepth.store(queued, std::memory_order_relaxed);
+    }
+}
+
+HttpMetrics::Snapshot HttpMetrics::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.queueDepth = _queueDepth.load(std::memory_order_relaxed);
+    snapshot.peakQueueDepth = _peakQueueDepth.load(std::memory_order_relaxed);
+    snapshot.inFlight = _inFlight.load(std::memory_order_relaxed);
+
+    std::unordered_map<std::string, size_t> seriesIndex;
+    for (size_t i = 0; i < _shards.size(); ++i)
+    {
+        Shard& shard = *_shards[i];
+        snapshot.requests += shard.requests.load(std::memory_order_relaxed);
+        snapshot.failures += shard.failures.load(std::memory_order_relaxed);
+        snapshot.bytesSent += shard.bytesSent.load(std::memory_order_relaxed);
+        snapshot.bytesReceived += shard.bytesReceived.load(std::memory_order_relaxed);
+        snapshot.retries += shard.retries.load(std::memory_order_relaxed);
+        snapshot.connectionsOpened += shard.connectionsOpened.load(std::memory_order_relaxed);
+        snapshot.connectionsReused += shard.connectionsReused.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(shard.seriesMutex);
+        for (std::unordered_map<std::string, std::unique_ptr<SeriesData> >::const_iterator it = shard.series.begin(); it != shard.series.end(); ++it)
+        {
+            // threads sharing a series land in different shards, their histograms add up
+            std::unordered_map<std::string, size_t>::iterator found = seriesIndex.find(it->first);
+            if (found == seriesIndex.end())
+            {
+                found = seriesIndex.insert(std::make_pair(it->first, snapshot.series.size())).first;
+                Series series;
+                series.host = it->second->host;
+                series.method = it->second->method;
+                series.statusClass = it->second->statusClass;
+                series.requests = 0;
+                snapshot.series.push_back(series);
+            }
+            Series& series = snapshot.series[found->second];
+            const SeriesData& data = *it->second;
+            series.requests += data.requests.load(std::memory_order_relaxed);
+            series.latency.count += data.count.load(std::memory_order_relaxed);
+            series.latency.sum += data.sum.load(std::memory_order_relaxed);
+            for (int bucket = 0; bucket < BUCKETS; ++bucket)
+            {
+                series.latency.buckets[bucket] += data.buckets[bucket].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return snapshot;
+}
+
+// Escape a Prometheus label value
+static std::string labelValue(const std::string& value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (std::string::const_iterator it = value.begin(); it != value.end(); ++it)
+    {
+        switch (*it)
+        {
+            case '\\': escaped.append("\\\\"); break;
+            case '"':  escaped.append("\\\""); break;
+            case '\n': escaped.append("\\n"); break;
+            default:   escaped.push_back(*it); break;
+        }
+    }
+    return escaped;
+}
+
+static void appendMetric(std::string& out, const char* name, const std::string& labels, uint64_t value)
+{
+    char number[32];
+    snprintf(number, sizeof(number), "%llu", (unsigned long long)value);
+    out.append(name);
+    if (!labels.empty())
+    {
+        out.append("{").append(labels).append("}");
+    }
+    out.append(" ").append(number).append("\n");
+}
+
+static void appendHeader(std::string& out, const char* name, const char* type, const char* help)
+{
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+std::string HttpMetrics::toPrometheus() const
+{
+    Snapshot metrics = snapshot();
+    std::string out;
+    char number[64];
+
+    appendHeader(out, "http_client_requests_total", "counter", "Transfers by host, method and status class, each retry counted again.");
+    for (std::vector<Series>::const_iterator it = metrics.series.begin(); it != metrics.series.end(); ++it)
+    {
+        std::string labels = "host=\"" + labelValue(it->host) + "\",method=\"" + labelValue(it->method) + "\",status_class=\"" + it->statusClass + "\"";
+        appendMetric(out, "http_client_requests_total", labels, it->requests);
+    }
+
+    appendHeader(out, "http_client_request_duration_seconds", "histogram", "Transfer latency by host, method and status class, queue time excluded.");
+    for (std::vector<Series>::const_iterator it = metrics.series.begin(); it != metrics.series.end(); ++it)
+    {
+        std::string labels = "host=\"" + labelValue(it->host) + "\",method=\"" + labelValue(it->method) + "\",status_class=\"" + it->statusClass + "\"";
+        // a bucket counts toward a bound only if all of it lies below, so the exported counts never flatter
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        for (size_t bound = 0; bound < sizeof(s_exportBounds) / sizeof(s_exportBounds[0]); ++bound)
+        {
+            while (bucket + 1 < it->latency.buckets.size() && Histogram::bucketLowerBound(bucket + 1) - 1 <= s_exportBounds[bound])
+            {
+                cumulative += it->latency.buckets[bucket++];
+            }
+            snprintf(number, sizeof(number), "%g", s_exportBounds[bound] / 1e6);
+            appendMetric(out, "http_client_request_duration_seconds_bucket", labels + ",le=\"" + number + "\"", cumulative);
+        }
+        appendMetric(out, "http_client_request_duration_seconds_bucket", labels + ",le=\"+Inf\"", it->latency.count);
+        snprintf(number, sizeof(number), "%.6f", it->latency.sum / 1e6);
+        out.append("http_client_request_duration_seconds_sum{").append(labels).append("} ").append(number).append("\n");
+        appendMetric(out, "http_client_request_duration_seconds_count", labels, it->latency.count);
+    }
+
+    appendHeader(out, "http_client_failures_total", "counter", "Transfers that got no response.");
+    appendMetric(out, "http_client_failures_total", "", metrics.failures);
+    appendHeader(out, "http_client_sent_bytes_total", "counter", "Request body bytes sent.");
+    appendMetric(out, "http_client_sent_bytes_total", "", metrics.bytesSent);
+    appendHeader(out, "http_client_received_bytes_total", "counter", "Response body bytes received.");
+    appendMetric(out, "http_client_received_bytes_total", "", metrics.bytesReceived);
+    appendHeader(out, "http_client_retries_total", "counter", "Requests sent again after a failure.");
+    appendMetric(out, "http_client_retries_total", "", metrics.retries);
+    appendHeader(out, "http_client_connections_total", "counter", "Transfers by whether their connection was already open.");
+    appendMetric(out, "http_client_connections_total", "reused=\"false\"", metrics.connectionsOpened);
+    appendMetric(out, "http_client_connections_total", "reused=\"true\"", metrics.connectionsReused);
+    appendHeader(out, "http_client_queue_depth", "gauge", "Requests waiting for a transfer slot.");
+    appendMetric(out, "http_client_queue_depth", "", metrics.queueDepth);
+    appendHeader(out, "http_client_queue_depth_peak", "gauge", "Most requests ever waiting for a transfer slot.");
+    appendMetric(out, "http_client_queue_depth_peak", "", metrics.peakQueueDepth);
+    appendHeader(out, "http_client_in_flight", "gauge", "Asynchronous transfers running.");
+    appendMetric(out, "http_client_in_flight", "", metrics.inFlight);
+    return out;
+}
+
+}
@@ -0,0 +1,228 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_METRICS_H__
+#define __HTTP_METRICS_H__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Client-wide counters and latency histograms, cheap enough to leave on in production.
+ * Recording threads are spread over shards by thread id, so the network thread and the
+ * threads sending synchronous requests each bump their own counters with relaxed atomics.
+ * Latencies go to log-linear histograms, 16 buckets per power of two of microseconds,
+ * i.e. within about 6% of the recorded value, one histogram per host, method and status class.
+ * A snapshot sums the shards, it may be a few requests behind the recording threads.
+ */
+class HttpMetrics
+{
+public:
+    enum
+    {
+        SUB_BUCKETS = 16,                       /// buckets per power of two
+        BUCKETS = SUB_BUCKETS * 37              /// values up to 2^40 microseconds, about 12 days
+    };
+
+    /** Latency distribution, in microseconds */
+    struct Histogram
+    {
+        Histogram()
+        : count(0)
+        , sum(0)
+        , buckets(BUCKETS, 0)
+        {
+        }
+
+        /** Smallest value that goes to bucket index */
+        static uint64_t bucketLowerBound(size_t index);
+
+        /** Bucket a value goes to */
+        static size_t bucketOf(uint64_t value);
+
+        /** Value under which the given fraction of the samples fall, e.g. 0.99. 0 when empty */
+        uint64_t percentile(double fraction) const;
+
+        uint64_t              count;
+        uint64_t              sum;      /// of every sample, for the mean
+        std::vector<uint64_t> buckets;
+    };
+
+    /** Requests to one host with one method that ended in one status class */
+    struct Series
+    {
+        std::string host;
+        std::string method;
+        std::string statusClass;        /// "2xx" to "5xx", "1xx", or "error" when no status came back
+        uint64_t    requests;
+        Histogram   latency;            /// of the transfers, queue time excluded
+    };
+
+    struct Snapshot
+    {
+        Snapshot()
+        : requests(0)
+        , failures(0)
+        , bytesSent(0)
+        , bytesReceived(0)
+        , retries(0)
+        , connectionsOpened(0)
+        , connectionsReused(0)
+        , queueDepth(0)
+        , peakQueueDepth(0)
+        , inFlight(0)
+        {
+        }
+
+        /** Fraction of the transfers that went over a connection already open, 0 before any */
+        double connectionReuseRatio() const;
+
+        uint64_t            requests;           /// transfers, each retry counted again
+        uint64_t            failures;           /// transfers that got no response
+        uint64_t            bytesSent;          /// request bodies
+        uint64_t            bytesReceived;      /// response bodies
+        uint64_t            retries;
+        uint64_t            connectionsOpened;
+        uint64_t            connectionsReused;
+        size_t              queueDepth;         /// requests waiting for a transfer slot
+        size_t              peakQueueDepth;
+        size_t              inFlight;           /// asynchronous transfers running
+        std::vector<Series> series;
+    };
+
+    HttpMetrics();
+    ~HttpMetrics();
+
+    /** Count a finished transfer.
+     @param statusCode HTTP status, 0 or less if the transfer failed before one came back
+     @param reused true if the transfer went over a connection that was already open
+     */
+    void recordRequest(const std::string& host, const char* method, long statusCode, uint64_t latencyUs,
+                       uint64_t bytesSent, uint64_t bytesReceived, bool reused);
+
+    /** Count a request that is sent again */
+    void recordRetry();
+
+    /** Update the queue gauges, from the network thread */
+    void setQueueDepth(size_t queued, size_t inFlight);
+
+    /** Sum of every shard */
+    Snapshot snapshot() const;
+
+    /** The snapshot in the Prometheus text exposition format, names prefixed with http_client_ */
+    std::string toPrometheus() const;
+
+    /** Status class label of a status code */
+    static const char* statusClassOf(long statusCode);
+
+private:
+    enum
+    {
+        SHARDS = 16,
+        SERIES_INDEX = 256                      /// series per shard found without the lock
+    };
+
+    struct SeriesData
+    {
+        SeriesData()
+        : statusClass("")
+        , requests(0)
+        , count(0)
+        , sum(0)
+        {
+            for (int i = 0; i < BUCKETS; ++i)
+            {
+                buckets[i] = 0;
+            }
+        }
+
+        std::string           host;
+        std::string           method;
+        const char*           statusClass;
+        std::atomic<uint64_t> requests;
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> buckets[BUCKETS];
+    };
+
+    struct Shard
+    {
+        Shard()
+        : requests(0)
+        , failures(0)
+        , bytesSent(0)
+        , bytesReceived(0)
+        , retries(0)
+        , connectionsOpened(0)
+        , connectionsReused(0)
+        {
+            for (int i = 0; i < SERIES_INDEX; ++i)
+            {
+                index[i] = nullptr;
+            }
+        }
+
+        std::atomic<uint64_t> requests;
+        std::atomic<uint64_t> failures;
+        std::atomic<uint64_t> bytesSent;
+        std::atomic<uint64_t> bytesReceived;
+        std::atomic<uint64_t> retries;
+        std::atomic<uint64_t> connectionsOpened;
+        std::atomic<uint64_t> connectionsReused;
+
+        std::mutex                                                    seriesMutex;  /// taken by the shard's threads to add a series, and by snapshots
+        std::unordered_map<std::string, std::unique_ptr<SeriesData> > series;       /// by host, method and status class
+        std::atomic<SeriesData*>                                      index[SERIES_INDEX];  /// open addressed by seriesHash(), filled under seriesMutex, read without it
+        char                                                          padding[64];  /// keeps shards off each other's cache lines
+    };
+
+    Shard& currentShard();
+    static std::string seriesKey(const std::string& host, const char* method, const char* statusClass);
+    static size_t seriesHash(const std::string& host, const char* method, const char* statusClass);
+    static SeriesData* findSeries(Shard& shard, size_t hash, const std::string& host, const char* method, const char* statusClass);
+    static SeriesData* addSeries(Shard& shard, size_t hash, const std::string& host, const char* method, const char* statusClass);
+
+private:
+    std::vector<std::unique_ptr<Shard> > _shards;
+    std::atomic<size_t>                  _queueDepth;
+    std::atomic<size_t>                  _peakQueueDepth;
+    std::atomic<size_t>                  _inFlight;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_METRICS_H__
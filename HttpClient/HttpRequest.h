@@ -29,6 +29,8 @@
 #include <vector>
 #include <functional>
 #include <memory>
+#include <chrono>
+#include <atomic>
 
 namespace network {
 
@@ -58,6 +60,36 @@ public:
         DELETE,
         UNKNOWN,
     };
+
+    /** Scheduling class, queued requests are started in this order */
+    enum class Priority
+    {
+        HIGH,           /// something the user is waiting on
+        NORMAL,
+        LOW,
+        BACKGROUND,     /// telemetry, prefetching, bulk uploads
+    };
+
+    /** When and how often a failed request is sent again, see setRetryPolicy() */
+    struct RetryPolicy
+    {
+        RetryPolicy()
+        : maxAttempts(1)
+        , baseDelayMs(100)
+        , maxDelayMs(10000)
+        , retryTransportErrors(true)
+        {
+            static const long transientStatuses[] = {408, 429, 500, 502, 503, 504};
+            statusCodes.assign(transientStatuses, transientStatuses + sizeof(transientStatuses) / sizeof(transientStatuses[0]));
+        }
+
+        int                 maxAttempts;            /// attempts in total, the default 1 never retries
+        long                baseDelayMs;            /// backoff ceiling of the first retry, doubled for each further one
+        long                maxDelayMs;             /// cap of the backoff ceiling
+        bool                retryTransportErrors;   /// retry failed name lookups and connects, timeouts, dropped connections
+        std::vector<int>    curlErrors;             /// further CURLcode values worth retrying
+        std::vector<long>   statusCodes;            /// HTTP statuses worth retrying
+    };
     
     static pointer create()
     {
@@ -78,6 +110,16 @@ public:
         _tag.clear();
         _pCallback = nullptr;
         _pUserData = nullptr;
+        _priority = Priority::NORMAL;
+        _deadline = std::chrono::steady_clock::time_point::max();
+        _cancelled = false;
+        _timeoutMs = 0;
+        _connectTimeoutMs = 0;
+        _maxSendSpeed = 0;
+        _maxRecvSpeed = 0;
+        _hedging = false;
+        _retryCount = 0;
+        _submittedAt = std::chrono::steady_clock::now();
     };
     
     /** Destructor */
@@ -86,6 +128,56 @@ public:
 
     };
 
+    /** Copy a request, e.g. to send it again. std::atomic can't be copied, so the
+        cancellation flag is copied by value: a copy of a cancelled request is cancelled too
+     */
+    HttpRequest(const HttpRequest& other)
+    : _requestType(other._requestType)
+    , _url(other._url)
+    , _requestData(other._requestData)
+    , _tag(other._tag)
+    , _pCallback(other._pCallback)
+    , _pUserData(other._pUserData)
+    , _headers(other._headers)
+    , _priority(other._priority)
+    , _deadline(other._deadline)
+    , _cancelled(other._cancelled.load())
+    , _timeoutMs(other._timeoutMs)
+    , _connectTimeoutMs(other._connectTimeoutMs)
+    , _maxSendSpeed(other._maxSendSpeed)
+    , _maxRecvSpeed(other._maxRecvSpeed)
+    , _hedging(other._hedging)
+    , _hedgeUrl(other._hedgeUrl)
+    , _retryPolicy(other._retryPolicy)
+    , _retryCount(other._retryCount)
+    , _submittedAt(other._submittedAt)
+    {
+    }
+
+    HttpRequest& operator=(const HttpRequest& other)
+    {
+        _requestType = other._requestType;
+        _url = other._url;
+        _requestData = other._requestData;
+        _tag = other._tag;
+        _pCallback = other._pCallback;
+        _pUserData = other._pUserData;
+        _headers = other._headers;
+        _priority = other._priority;
+        _deadline = other._deadline;
+        _cancelled = other._cancelled.load();
+        _timeoutMs = other._timeoutMs;
+        _connectTimeoutMs = other._connectTimeoutMs;
+        _maxSendSpeed = other._maxSendSpeed;
+        _maxRecvSpeed = other._maxRecvSpeed;
+        _hedging = other._hedging;
+        _hedgeUrl = other._hedgeUrl;
+        _retryPolicy = other._retryPolicy;
+        _retryCount = other._retryCount;
+        _submittedAt = other._submittedAt;
+        return *this;
+    }
+
     // setter/getters for properties
      
     /** Required field for HttpRequest object before being sent.
@@ -183,6 +275,158 @@ public:
    	{
    		return _headers;
    	}
+
+    /** Set the scheduling class, NORMAL by default */
+    inline void setPriority(Priority priority)
+    {
+        _priority = priority;
+    }
+
+    inline Priority getPriority()
+    {
+        return _priority;
+    }
+
+    /** Set the time by which the response is needed. Among requests of the same priority
+        the earliest deadline starts first, and a request still queued when its deadline
+        passes fails without using a connection */
+    inline void setDeadline(const std::chrono::steady_clock::time_point& deadline)
+    {
+        _deadline = deadline;
+    }
+
+    /** Set the deadline milliseconds from now */
+    inline void setDeadlineFromNow(long milliseconds)
+    {
+        _deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+    }
+
+    inline const std::chrono::steady_clock::time_point& getDeadline()
+    {
+        return _deadline;
+    }
+
+    inline bool hasDeadline()
+    {
+        return _deadline != std::chrono::steady_clock::time_point::max();
+    }
+
+    /** Limit the whole transfer to milliseconds, 0 to use HttpClient::getTimeoutForRead().
+        A deadline set on the request shortens it further by the time spent queued */
+    inline void setTimeoutMs(long milliseconds)
+    {
+        _timeoutMs = milliseconds;
+    }
+
+    inline long getTimeoutMs()
+    {
+        return _timeoutMs;
+    }
+
+    /** Limit the connection phase to milliseconds, 0 to use HttpClient::getTimeoutForConnect() */
+    inline void setConnectTimeoutMs(long milliseconds)
+    {
+        _connectTimeoutMs = milliseconds;
+    }
+
+    inline long getConnectTimeoutMs()
+    {
+        return _connectTimeoutMs;
+    }
+
+    /** Cap the upload rate of this request, 0 for no cap of its own.
+        A bandwidth budget set with HttpClient::setBandwidthLimit() may slow it further */
+    inline void setMaxSendSpeed(long long bytesPerSecond)
+    {
+        _maxSendSpeed = bytesPerSecond;
+    }
+
+    inline long long getMaxSendSpeed()
+    {
+        return _maxSendSpeed;
+    }
+
+    /** Cap the download rate of this request, 0 for no cap of its own */
+    inline void setMaxRecvSpeed(long long bytesPerSecond)
+    {
+        _maxRecvSpeed = bytesPerSecond;
+    }
+
+    inline long long getMaxRecvSpeed()
+    {
+        return _maxRecvSpeed;
+    }
+
+    /** Let HttpClient send a second copy of this request when it is slow, see HttpClient::enableHedging().
+        Only honoured for GET, as the request may reach the server twice */
+    inline void setHedgingEnabled(bool enable)
+    {
+        _hedging = enable;
+    }
+
+    inline bool isHedgingEnabled()
+    {
+        return _hedging;
+    }
+
+    /** Send the second copy to another endpoint serving the same content, e.g. a replica.
+        Empty, the default, sends it to the request's own url */
+    inline void setHedgeUrl(const char* url)
+    {
+        _hedgeUrl = url;
+    }
+
+    inline const char* getHedgeUrl()
+    {
+        return _hedgeUrl.c_str();
+    }
+
+    /** Let HttpClient send the request again when it fails in a way the policy covers.
+        The wait before each retry is drawn at random up to an exponentially growing ceiling,
+        and retries stop when HttpClient's retry budget runs low or the deadline would pass.
+        Only retry requests that are safe to repeat */
+    inline void setRetryPolicy(const RetryPolicy& policy)
+    {
+        _retryPolicy = policy;
+    }
+
+    inline const RetryPolicy& getRetryPolicy()
+    {
+        return _retryPolicy;
+    }
+
+    /** Number of times the request was sent again since it was submitted, set by HttpClient */
+    inline void setRetryCount(int count)
+    {
+        _retryCount = count;
+    }
+
+    inline int getRetryCount()
+    {
+        return _retryCount;
+    }
+
+    /** Time the request was handed to HttpClient, set by HttpClient. A response's queue timing counts from it */
+    inline void setSubmittedAt(const std::chrono::steady_clock::time_point& time)
+    {
+        _submittedAt = time;
+    }
+
+    inline const std::chrono::steady_clock::time_point& getSubmittedAt()
+    {
+        return _submittedAt;
+    }
+
+    /** Flag the request as cancelled, see HttpClient::cancelRequest() which also stops its transfer */
+    inline void cancel()
+    {
+        _cancelled = true;
+    }
+
+    inline bool isCancelled()
+    {
+        return _cancelled;
+    }
     
 protected:
     // properties
@@ -193,6 +437,18 @@ protected:
     ccHttpRequestCallback       _pCallback;      /// C++11 style callbacks
     void*                       _pUserData;      /// You can add your customed data here 
     std::vector<std::string>    _headers;		      /// custom http headers
+    Priority                    _priority;       /// scheduling class
+    std::chrono::steady_clock::time_point _deadline; /// time the response is needed by, max() if none
+    std::atomic<bool>           _cancelled;      /// set once the caller withdrew the request
+    long                        _timeoutMs;      /// transfer timeout in milliseconds, 0 for the client's
+    long                        _connectTimeoutMs; /// connect timeout in milliseconds, 0 for the client's
+    long long                   _maxSendSpeed;   /// upload cap in bytes per second, 0 for none
+    long long                   _maxRecvSpeed;   /// download cap in bytes per second, 0 for none
+    bool                        _hedging;        /// a second copy may be sent when the first is slow
+    std::string                 _hedgeUrl;       /// where the second copy goes, empty for _url
+    RetryPolicy                 _retryPolicy;    /// when to send the request again after a failure
+    int                         _retryCount;     /// retries made since the request was submitted
+    std::chrono::steady_clock::time_point _submittedAt; /// when the request was handed to HttpClient
 };
 
 }
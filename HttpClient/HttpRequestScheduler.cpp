@@ -0,0 +1,372 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include <ctype.h>
+#include <algorithm>
+#include "HttpRequestScheduler.h"
+
+namespace network {
+
+HttpRequestScheduler::HttpRequestScheduler()
+: _defaultHostLimit(0)
+, _size(0)
+, _maxPerHost(0)
+{
+}
+
+std::string HttpRequestScheduler::hostOf(const char* url)
+{
+    std::string str(url ? url : "");
+    size_t begin = str.find("://");
+    begin = begin == std::string::npos ? 0 : begin + 3;
+    size_t end = str.find_first_of("/?#", begin);
+    std::string host = str.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+
+    // drop user:password@
+    size_t at = host.rfind('@');
+    if (at != std::string::npos)
+    {
+        host.erase(0, at + 1);
+    }
+    std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+    return host;
+}
+
+// Orders a host's queue by deadline, equal deadlines (no deadline included) keep submission order
+static bool earlierDeadline(const HttpRequest::pointer& left, const HttpRequest::pointer& right)
+{
+    return left->getDeadline() < right->getDeadline();
+}
+
+void HttpRequestScheduler::push(HttpRequest::pointer request)
+{
+    std::string host = hostOf(request->getUrl());
+    int priority = (int)request->getPriority();
+    HostQueue& queue = _hosts[host];
+    std::deque<HttpRequest::pointer>& requests = queue.requests[priority];
+    if (requests.empty())
+    {
+        _rotation[priority].push_back(host);
+    }
+    requests.insert(std::upper_bound(requests.begin(), requests.end(), request, earlierDeadline), request);
+    ++queue.queued;
+    ++_size;
+}
+
+HttpRequest::pointer HttpRequestScheduler::pop()
+{
+    TimePoint now = std::chrono::steady_clock::now();
+    for (int priority = 0; priority < PRIORITY_COUNT; ++priority)
+    {
+        std::list<std::string>& rotation = _rotation[priority];
+
+        // Visit each waiting host at most once, starting where the last pop left off
+        for (size_t visited = 0, count = rotation.size(); visited < count; ++visited)
+        {
+            std::string host = rotation.front();
+            rotation.pop_front();
+
+            HostQueue& queue = _hosts[host];
+            int limit = limitOf(host);
+            if ((limit > 0 && queue.inFlight >= limit) || !takeToken(host, now))
+            {
+                rotation.push_back(host);
+                continue;
+            }
+
+            std::deque<HttpRequest::pointer>& requests = queue.requests[priority];
+            HttpRequest::pointer request = requests.front();
+            requests.pop_front();
+            ++queue.inFlight;
+            --queue.queued;
+            --_size;
+            if (!requests.empty())
+            {
+                rotation.push_back(host);
+            }
+            return request;
+        }
+    }
+    return nullptr;
+}
+
+void HttpRequestScheduler::takeExpired(const TimePoint& now, std::vector<HttpRequest::pointer>& expired)
+{
+    for (int priority = 0; priority < PRIORITY_COUNT; ++priority)
+    {
+        std::list<std::string>& rotation = _rotation[priority];
+        std::list<std::string>::iterator it = rotation.begin();
+        while (it != rotation.end())
+        {
+            HostQueue& queue = _hosts[*it];
+            std::deque<HttpRequest::pointer>& requests = queue.requests[priority];
+
+            // queues are ordered by deadline, expired requests are at the front
+            while (!requests.empty() && requests.front()->getDeadline() < now)
+            {
+                expired.push_back(requests.front());
+                requests.pop_front();
+                --queue.queued;
+                --_size;
+            }
+            it = requests.empty() ? leaveRotation(rotation, it) : ++it;
+        }
+    }
+}
+
+void HttpRequestScheduler::takeCancelled(std::vector<HttpRequest::pointer>& cancelled)
+{
+    for (int priority = 0; priority < PRIORITY_COUNT; ++priority)
+    {
+        std::list<std::string>& rotation = _rotation[priority];
+        std::list<std::string>::iterator it = rotation.begin();
+        while (it != rotation.end())
+        {
+            HostQueue& queue = _hosts[*it];
+            std::deque<HttpRequest::pointer>& requests = queue.requests[priority];
+
+            std::deque<HttpRequest::pointer>::iterator request = requests.begin();
+            while (request != requests.end())
+            {
+                if (!(*request)->isCancelled())
+                {
+                    ++request;
+                    continue;
+                }
+                cancelled.push_back(*request);
+                request = requests.erase(request);
+                --queue.queued;
+                --_size;
+            }
+            it = requests.empty() ? leaveRotation(rotation, it) : ++it;
+        }
+    }
+}
+
+// Take a host whose queue for one priority ran empty out of that priority's rotation
+std::list<std::string>::iterator HttpRequestScheduler::leaveRotation(std::list<std::string>& rotation, std::list<std::string>::iterator it)
+{
+    std::unordered_map<std::string, HostQueue>::iterator found = _hosts.find(*it);
+    if (found->second.inFlight == 0 && found->second.queued == 0)
+    {
+        _hosts.erase(found);
+    }
+    return rotation.erase(it);
+}
+
+HttpRequestScheduler::TimePoint HttpRequestScheduler::nextDeadline() const
+{
+    TimePoint next = TimePoint::max();
+    for (std::unordered_map<std::string, HostQueue>::const_iterator it = _hosts.begin(); it != _hosts.end(); ++it)
+    {
+        for (int priority = 0; priority < PRIORITY_COUNT; ++priority)
+        {
+            const std::deque<HttpRequest::pointer>& requests = it->second.requests[priority];
+            if (!requests.empty() && requests.front()->getDeadline() < next)
+            {
+                next = requests.front()->getDeadline();
+            }
+        }
+    }
+    return next;
+}
+
+int HttpRequestScheduler::limitOf(const std::string& host) const
+{
+    std::unordered_map<std::string, int>::const_iterator it = _hostLimits.find(host);
+    int limit = it == _hostLimits.end() ? _defaultHostLimit : it->second;
+    if (limit == 0 || (_maxPerHost > 0 && _maxPerHost < limit))
+    {
+        return _maxPerHost;
+    }
+    return limit;
+}
+
+void HttpRequestScheduler::setHostLimit(const std::string& host, int limit)
+{
+    if (limit > 0)
+    {
+        _hostLimits[host] = limit;
+    }
+    else
+    {
+        _hostLimits.erase(host);
+    }
+}
+
+int HttpRequestScheduler::getInFlight(const std::string& host) const
+{
+    std::unordered_map<std::string, HostQueue>::const_iterator it = _hosts.find(host);
+    return it == _hosts.end() ? 0 : it->second.inFlight;
+}
+
+void HttpRequestScheduler::setHostRateLimit(const std::string& host, double requestsPerSecond, double burst)
+{
+    if (requestsPerSecond <= 0)
+    {
+        _rateLimits.erase(host);
+        return;
+    }
+
+    TimePoint now = std::chrono::steady_clock::now();
+    std::unordered_map<std::string, RateLimit>::iterator it = _rateLimits.find(host);
+    if (it == _rateLimits.end())
+    {
+        // a new bucket starts full
+        RateLimit bucket;
+        bucket.tokens = std::max(1.0, burst);
+        bucket.refilledAt = now;
+        it = _rateLimits.insert(std::make_pair(host, bucket)).first;
+    }
+    refill(it->second, now);
+    it->second.rate = requestsPerSecond;
+    it->second.burst = std::max(1.0, burst);
+    it->second.tokens = std::min(it->second.tokens, it->second.burst);
+}
+
+void HttpRequestScheduler::refill(RateLimit& bucket, const TimePoint& now)
+{
+    if (now > bucket.refilledAt)
+    {
+        double seconds = std::chrono::duration<double>(now - bucket.refilledAt).count();
+        bucket.tokens = std::min(bucket.burst, bucket.tokens + seconds * bucket.rate);
+        bucket.refilledAt = now;
+    }
+}
+
+bool HttpRequestScheduler::takeToken(const std::string& host, const TimePoint& now)
+{
+    std::unordered_map<std::string, RateLimit>::iterator it = _rateLimits.find(host);
+    if (it == _rateLimits.end())
+    {
+        return true;
+    }
+    refill(it->second, now);
+    if (it->second.tokens < 1)
+    {
+        return false;
+    }
+    it->second.tokens -= 1;
+    return true;
+}
+
+HttpRequestScheduler::TimePoint HttpRequestScheduler::reserve(const std::string& host, const TimePoint& now)
+{
+    std::unordered_map<std::string, RateLimit>::iterator it = _rateLimits.find(host);
+    if (it == _rateLimits.end())
+    {
+        return now;
+    }
+    RateLimit& bucket = it->second;
+    refill(bucket, now);
+    bucket.tokens -= 1;
+    if (bucket.tokens >= 0)
+    {
+        return now;
+    }
+    // the token is taken ahead of time, the request waits until the bucket has paid it back
+    return now + std::chrono::duration_cast<TimePoint::duration>(std::chrono::duration<double>(-bucket.tokens / bucket.rate));
+}
+
+HttpRequestScheduler::TimePoint HttpRequestScheduler::nextAdmission() const
+{
+    TimePoint next = TimePoint::max();
+    for (std::unordered_map<std::string, RateLimit>::const_iterator it = _rateLimits.begin(); it != _rateLimits.end(); ++it)
+    {
+        std::unordered_map<std::string, HostQueue>::const_iterator host = _hosts.find(it->first);
+        if (host == _hosts.end() || host->second.queued == 0 || it->second.tokens >= 1)
+        {
+            continue;
+        }
+        // a host at its concurrency limit waits for a slot, not for a token
+        int limit = limitOf(it->first);
+        if (limit > 0 && host->second.inFlight >= limit)
+        {
+            continue;
+        }
+        const RateLimit& bucket = it->second;
+        TimePoint refilled = bucket.refilledAt + std::chrono::duration_cast<TimePoint::duration>(std::chrono::duration<double>((1 - bucket.tokens) / bucket.rate));
+        next = std::min(next, refilled);
+    }
+    return next;
+}
+
+bool HttpRequestScheduler::acquire(const std::string& host, const TimePoint& now)
+{
+    std::unordered_map<std::string, HostQueue>::iterator it = _hosts.find(host);
+    int limit = limitOf(host);
+    if ((limit > 0 && it != _hosts.end() && it->second.inFlight >= limit) || !takeToken(host, now))
+    {
+        return false;
+    }
+    ++_hosts[host].inFlight;
+    return true;
+}
+
+void HttpRequestScheduler::release(const std::string& host)
+{
+    std::unordered_map<std::string, HostQueue>::iterator it = _hosts.find(host);
+    if (it == _hosts.end())
+    {
+        return;
+    }
+    if (it->second.inFlight > 0)
+    {
+        --it->second.inFlight;
+    }
+    if (it->second.inFlight == 0 && it->second.queued == 0)
+    {
+        _hosts.erase(it);
+    }
+}
+
+void HttpRequestScheduler::finished(HttpRequest::pointer request)
+{
+    release(hostOf(request->getUrl()));
+}
+
+void HttpRequestScheduler::clear()
+{
+    for (std::unordered_map<std::string, HostQueue>::iterator it = _hosts.begin(); it != _hosts.end(); )
+    {
+        for (int priority = 0; priority < PRIORITY_COUNT; ++priority)
+        {
+            it->second.requests[priority].clear();
+        }
+        it->second.queued = 0;
+        if (it->second.inFlight == 0)
+        {
+            it = _hosts.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    for (int priority = 0; priority < PRIORITY_COUNT; ++priority)
+    {
+        _rotation[priority].clear();
+    }
+    _size = 0;
+}
+
+}
@@ -0,0 +1,195 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __HTTP_REQUEST_SCHEDULER_H__
+#define __HTTP_REQUEST_SCHEDULER_H__
+
+#include <string>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <chrono>
+#include "HttpRequest.h"
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Queue of asynchronous requests waiting for a transfer slot.
+ * Higher priority requests always go first. Within a priority, requests are queued
+ * per host and handed out round robin across hosts, skipping hosts that already have
+ * their maximum number of requests in flight, so a backlog for one slow upstream
+ * can't starve the others. Each host's queue is ordered by earliest deadline, requests
+ * without a deadline keep their submission order behind those with one.
+ * A host may also have a rate limit, a token bucket each started request takes a token from.
+ * The scheduler isn't thread safe, HttpClient guards it with its request queue mutex.
+ */
+class HttpRequestScheduler
+{
+public:
+    HttpRequestScheduler();
+
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    /** Queue a request behind the others for the same host, priority and deadline */
+    void push(HttpRequest::pointer request);
+
+    /** Take the next request to start, null if nothing is queued or every host with
+        queued requests is at its limit or out of tokens. The request counts as in flight until finished() */
+    HttpRequest::pointer pop();
+
+    /** Release the host slot taken by a request returned from pop() */
+    void finished(HttpRequest::pointer request);
+
+    /** Remove the queued requests whose deadline is before now, appending them to expired */
+    void takeExpired(const TimePoint& now, std::vector<HttpRequest::pointer>& expired);
+
+    /** Remove the queued requests that were cancelled, appending them to cancelled */
+    void takeCancelled(std::vector<HttpRequest::pointer>& cancelled);
+
+    /** Earliest deadline among the queued requests, TimePoint::max() if none has one */
+    TimePoint nextDeadline() const;
+
+    /** Drop every queued request */
+    void clear();
+
+    /** Number of queued requests, in flight ones excluded */
+    inline size_t size() const
+    {
+        return _size;
+    }
+
+    inline bool empty() const
+    {
+        return _size == 0;
+    }
+
+    /** Change how many requests to one host may be in flight at once, 0 means no limit */
+    inline void setMaxPerHost(int value)
+    {
+        _maxPerHost = value > 0 ? value : 0;
+    }
+
+    inline int getMaxPerHost() const
+    {
+        return _maxPerHost;
+    }
+
+    /** Lower the limit of one host below the per host maximum, e.g. from an adaptive limiter.
+        0 removes the override */
+    void setHostLimit(const std::string& host, int limit);
+
+    /** Remove every host limit override */
+    inline void clearHostLimits()
+    {
+        _hostLimits.clear();
+    }
+
+    /** Limit of the hosts without an override, e.g. the starting limit of an adaptive limiter,
+        so the first requests to a host are capped before it answered any. Still bounded by
+        the per host maximum, 0 for none */
+    inline void setDefaultHostLimit(int limit)
+    {
+        _defaultHostLimit = limit > 0 ? limit : 0;
+    }
+
+    /** Number of requests to host in flight */
+    int getInFlight(const std::string& host) const;
+
+    /** Let no more than requestsPerSecond requests to host start per second on average, and at
+        most burst of them back to back after host was quiet. 0 requests per second removes the limit */
+    void setHostRateLimit(const std::string& host, double requestsPerSecond, double burst = 1);
+
+    /** Remove every host rate limit */
+    inline void clearHostRateLimits()
+    {
+        _rateLimits.clear();
+    }
+
+    /** Take a token of host for a request that doesn't go through the queue, e.g. a synchronous one.
+        Returns when that request may start: now, unless host is over its rate */
+    TimePoint reserve(const std::string& host, const TimePoint& now);
+
+    /** Take a slot and a token of host for a transfer that doesn't go through the queue and may
+        be skipped, e.g. a hedge. Returns false, taking nothing, if host is at its limit or out of tokens */
+    bool acquire(const std::string& host, const TimePoint& now);
+
+    /** Give back a slot taken by acquire() */
+    void release(const std::string& host);
+
+    /** Earliest time a host whose queued requests wait only for a token gets one, TimePoint::max() if none waits */
+    TimePoint nextAdmission() const;
+
+    /** The scheduling key of a url: its lower cased host and port */
+    static std::string hostOf(const char* url);
+
+private:
+    enum
+    {
+        PRIORITY_COUNT = (int)HttpRequest::Priority::BACKGROUND + 1
+    };
+
+    struct HostQueue
+    {
+        HostQueue()
+        : inFlight(0)
+        , queued(0)
+        {
+        }
+
+        std::deque<HttpRequest::pointer> requests[PRIORITY_COUNT];  /// per priority, earliest deadline first
+        int                              inFlight;
+        size_t                           queued;
+    };
+
+    struct RateLimit
+    {
+        double      rate;       /// tokens added per second
+        double      burst;      /// most tokens the bucket holds
+        double      tokens;     /// below zero while reserve() has handed out tokens ahead of time
+        TimePoint   refilledAt; /// time tokens was last brought up to date
+    };
+
+    static void refill(RateLimit& bucket, const TimePoint& now);
+    bool takeToken(const std::string& host, const TimePoint& now);
+    int limitOf(const std::string& host) const;
+    std::list<std::string>::iterator leaveRotation(std::list<std::string>& rotation, std::list<std::string>::iterator it);
+
+private:
+    std::unordered_map<std::string, HostQueue> _hosts;
+    std::list<std::string>                     _rotation[PRIORITY_COUNT];   /// per priority, hosts with queued requests, next in line first
+    std::unordered_map<std::string, int>       _hostLimits;  /// overrides of _maxPerHost, kept while hosts are idle
+    int                                        _defaultHostLimit;  /// limit of hosts without an override, 0 for none
+    std::unordered_map<std::string, RateLimit> _rateLimits;
+    size_t                                     _size;
+    int                                        _maxPerHost;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_REQUEST_SCHEDULER_H__
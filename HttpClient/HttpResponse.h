@@ -25,6 +25,7 @@
 #ifndef __HTTP_RESPONSE__
 #define __HTTP_RESPONSE__
 
+#include <chrono>
 #include "HttpRequest.h"
 
 namespace network {
@@ -39,6 +40,35 @@ class HttpResponse
 public:
     typedef std::shared_ptr<HttpResponse> pointer;
 
+    /** Where the time of a request went, in microseconds. A phase that didn't happen is -1,
+        e.g. the network phases of a response served from the memory cache, or tls over plain http
+     */
+    struct Timings
+    {
+        Timings()
+        : queue(-1)
+        , dns(-1)
+        , connect(-1)
+        , tls(-1)
+        , request(-1)
+        , firstByte(-1)
+        , transfer(-1)
+        , total(-1)
+        , dispatch(-1)
+        {
+        }
+
+        long long queue;     /// from submission to the start of the transfer that answered, earlier attempts and their backoff included
+        long long dns;       /// name resolution, 0 on a reused connection
+        long long connect;   /// TCP connect, 0 on a reused connection
+        long long tls;       /// TLS handshake
+        long long request;   /// from the connection being ready to the request being ready to send
+        long long firstByte; /// from the request being ready to send to the first byte of the answer: upload plus server time
+        long long transfer;  /// from the first byte of the answer to the last
+        long long total;     /// the whole transfer, as libcurl measured it
+        long long dispatch;  /// from the response being queued to its callback, or its completion queue drain
+    };
+
     static pointer create(HttpRequest::pointer request)
     {
         return pointer(new HttpResponse(request));
@@ -51,8 +81,10 @@ public:
     {
         _pHttpRequest = request;
         _succeed = false;
+        _fromCache = false;
         _responseData.clear();
         _errorBuffer.clear();
+        _queuedAt = std::chrono::steady_clock::now();
     }
     
     /** Destructor, it will be called in HttpClient internal,
@@ -81,11 +113,38 @@ public:
         return _succeed;
     };
     
+    /** To see if the response was served from the local cache rather than the network */
+    inline bool isFromCache()
+    {
+        return _fromCache;
+    }
+
     /** Get the http response raw data */
     inline std::vector<char>* getResponseData()
     {
+        if (_sharedResponseData)
+        {
+            // the caller may modify the buffer, so it gets its own copy of a shared body
+            _responseData = *_sharedResponseData;
+            _sharedResponseData.reset();
+        }
         return &_responseData;
     }
+
+    /** Get the http response raw data as an immutable refcounted buffer.
+        Responses served from the memory cache share one buffer between every reader,
+        this getter hands it out without copying
+     */
+    inline std::shared_ptr<const std::vector<char> > getSharedResponseData()
+    {
+        if (!_sharedResponseData)
+        {
+            std::shared_ptr<std::vector<char> > data = std::make_shared<std::vector<char> >();
+            data->swap(_responseData);
+            _sharedResponseData = data;
+        }
+        return _sharedResponseData;
+    }
     
     /** get the Rawheader **/
     inline std::vector<char>* getResponseHeader()
@@ -108,6 +167,12 @@ public:
         return _errorBuffer.c_str();
     }
     
+    /** Get the time spent in each phase of the request */
+    inline const Timings& getTimings()
+    {
+        return _timings;
+    }
+
     // setters, will be called by HttpClient
     // users should avoid invoking these methods
     
@@ -122,6 +187,13 @@ public:
     };
     
     
+    /** Mark the response as served from the local cache, is used by HttpClient
+     */
+    inline void setFromCache(bool value)
+    {
+        _fromCache = value;
+    }
+
     /** Set the http response raw buffer, is used by HttpClient
      */
     inline void setResponseData(std::vector<char>* data)
@@ -129,6 +201,14 @@ public:
         _responseData = *data;
     }
     
+    /** Set the http response raw data to a shared immutable buffer, is used by HttpClient
+     */
+    inline void setSharedResponseData(const std::shared_ptr<const std::vector<char> >& data)
+    {
+        _responseData.clear();
+        _sharedResponseData = data;
+    }
+
     /** Set the http response Header raw buffer, is used by HttpClient
      */
     inline void setResponseHeader(std::vector<char>* data)
@@ -152,15 +232,40 @@ public:
         _errorBuffer.clear();
         _errorBuffer.assign(value);
     };
+
+    /** Set the time spent in each phase of the request, is used by HttpClient
+     */
+    inline void setTimings(const Timings& timings)
+    {
+        _timings = timings;
+    }
+
+    /** Note that the response was queued for dispatch, is used by HttpClient
+     */
+    inline void markQueued()
+    {
+        _queuedAt = std::chrono::steady_clock::now();
+    }
+
+    /** Note that the response is being handed to the application, is used by HttpClient
+     */
+    inline void markDispatched()
+    {
+        _timings.dispatch = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _queuedAt).count();
+    }
     
 protected:
     // properties
     HttpRequest::pointer _pHttpRequest;  /// the corresponding HttpRequest pointer who leads to this response 
     bool                 _succeed;       /// to indecate if the http reqeust is successful simply
+    bool                 _fromCache;     /// true if the response came from the local cache
     std::vector<char>    _responseData;  /// the returned raw data. You can also dump it as a string
+    std::shared_ptr<const std::vector<char> > _sharedResponseData; /// body shared with the memory cache, replaces _responseData when set
     std::vector<char>    _responseHeader;  /// the returned raw header data. You can also dump it as a string
     long                 _responseCode;    /// the status code returned from libcurl, e.g. 200, 404
     std::string          _errorBuffer;   /// if _responseCode != 200, please read _errorBuffer to find the reason 
+    Timings              _timings;       /// time spent in each phase of the request
+    std::chrono::steady_clock::time_point _queuedAt; /// when the response was queued for dispatch
     
 };
 
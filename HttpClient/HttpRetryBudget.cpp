@@ -0,0 +1,63 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#include <algorithm>
+#include "HttpRetryBudget.h"
+
+namespace network {
+
+HttpRetryBudget::HttpRetryBudget(double maxTokens, double tokenRatio)
+: _maxTokens(maxTokens)
+, _tokenRatio(tokenRatio)
+, _tokens(maxTokens)
+{
+}
+
+void HttpRetryBudget::reset(double maxTokens, double tokenRatio)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxTokens = maxTokens;
+    _tokenRatio = tokenRatio;
+    _tokens = maxTokens;
+}
+
+void HttpRetryBudget::onSuccess()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tokens = std::min(_maxTokens, _tokens + _tokenRatio);
+}
+
+bool HttpRetryBudget::onFailure()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tokens = std::max(0.0, _tokens - 1);
+    return _tokens > _maxTokens / 2;
+}
+
+double HttpRetryBudget::getTokens()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _tokens;
+}
+
+}
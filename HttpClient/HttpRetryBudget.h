@@ -0,0 +1,76 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_RETRY_BUDGET_H__
+#define __HTTP_RETRY_BUDGET_H__
+
+#include <mutex>
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Token bucket that throttles retries once an upstream keeps failing.
+ * Every retryable failure takes a token and every success gives back a fraction of
+ * one. Retries are allowed only while more than half the tokens are left, so when most
+ * requests fail, retries stop and don't add to the load on the struggling server.
+ */
+class HttpRetryBudget
+{
+public:
+    /**
+     * @param maxTokens size of the bucket, it starts full
+     * @param tokenRatio tokens a success gives back
+     */
+    HttpRetryBudget(double maxTokens = 100, double tokenRatio = 0.1);
+
+    /** Change the bucket size and refill ratio, the bucket is refilled */
+    void reset(double maxTokens, double tokenRatio);
+
+    /** Account for a successful response */
+    void onSuccess();
+
+    /** Account for a retryable failure.
+     @return true if the budget still allows retrying it
+     */
+    bool onFailure();
+
+    /** Tokens currently left */
+    double getTokens();
+
+private:
+    std::mutex  _mutex;
+    double      _maxTokens;
+    double      _tokenRatio;
+    double      _tokens;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_RETRY_BUDGET_H__
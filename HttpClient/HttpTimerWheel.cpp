@@ -0,0 +1,159 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#include <algorithm>
+#include "HttpTimerWheel.h"
+
+namespace network {
+
+HttpTimerWheel::HttpTimerWheel(long tickMs, size_t slotCount)
+: _origin(std::chrono::steady_clock::now())
+, _tickMs(tickMs > 0 ? tickMs : 1)
+, _slots(slotCount > 0 ? slotCount : 1)
+, _currentTick(0)
+, _count(0)
+{
+}
+
+long long HttpTimerWheel::tickOf(const TimePoint& time) const
+{
+    long long elapsedMs = (long long)std::chrono::duration_cast<std::chrono::milliseconds>(time - _origin).count();
+    return elapsedMs <= 0 ? 0 : elapsedMs / _tickMs;
+}
+
+void HttpTimerWheel::schedule(HttpRequest::pointer request, const TimePoint& due)
+{
+    // Round up so a timer never fires early, and never into a tick already expired
+    long long tick = tickOf(due - std::chrono::milliseconds(1)) + 1;
+    tick = std::max(tick, _currentTick + 1);
+
+    Timer timer;
+    timer.request = request;
+    timer.tick = tick;
+    _slots[(size_t)(tick % (long long)_slots.size())].push_back(timer);
+    ++_count;
+}
+
+void HttpTimerWheel::advance(const TimePoint& now, std::vector<HttpRequest::pointer>& due)
+{
+    long long target = tickOf(now);
+    if (target <= _currentTick)
+    {
+        return;
+    }
+
+    // Visit the slots of the ticks that went by, each slot at most once
+    long long slotCount = (long long)_slots.size();
+    long long first = std::max(_currentTick + 1, target - slotCount + 1);
+    for (long long tick = first; tick <= target && _count > 0; ++tick)
+    {
+        std::vector<Timer>& slot = _slots[(size_t)(tick % slotCount)];
+        size_t kept = 0;
+        for (size_t i = 0; i < slot.size(); ++i)
+        {
+            if (slot[i].tick <= target)
+            {
+                due.push_back(slot[i].request);
+                --_count;
+            }
+            else
+            {
+                slot[kept++] = slot[i];
+            }
+        }
+        slot.resize(kept);
+    }
+    _currentTick = target;
+}
+
+void HttpTimerWheel::takeCancelled(std::vector<HttpRequest::pointer>& cancelled)
+{
+    for (size_t s = 0; s < _slots.size() && _count > 0; ++s)
+    {
+        std::vector<Timer>& slot = _slots[s];
+        size_t kept = 0;
+        for (size_t i = 0; i < slot.size(); ++i)
+        {
+            if (slot[i].request->isCancelled())
+            {
+                cancelled.push_back(slot[i].request);
+                --_count;
+            }
+            else
+            {
+                slot[kept++] = slot[i];
+            }
+        }
+        slot.resize(kept);
+    }
+}
+
+HttpTimerWheel::TimePoint HttpTimerWheel::nextDue() const
+{
+    if (_count == 0)
+    {
+        return TimePoint::max();
+    }
+
+    // The first slot ahead holding a timer of the current turn has the earliest one,
+    // failing that every timer is at least a turn away and the earliest is searched for
+    long long slotCount = (long long)_slots.size();
+    long long earliest = -1;
+    for (long long tick = _currentTick + 1; tick <= _currentTick + slotCount && earliest < 0; ++tick)
+    {
+        const std::vector<Timer>& slot = _slots[(size_t)(tick % slotCount)];
+        for (size_t i = 0; i < slot.size(); ++i)
+        {
+            if (slot[i].tick <= tick)
+            {
+                earliest = tick;
+                break;
+            }
+        }
+    }
+    if (earliest < 0)
+    {
+        for (size_t s = 0; s < _slots.size(); ++s)
+        {
+            for (size_t i = 0; i < _slots[s].size(); ++i)
+            {
+                if (earliest < 0 || _slots[s][i].tick < earliest)
+                {
+                    earliest = _slots[s][i].tick;
+                }
+            }
+        }
+    }
+    return _origin + std::chrono::milliseconds(earliest * _tickMs);
+}
+
+void HttpTimerWheel::clear()
+{
+    for (size_t s = 0; s < _slots.size(); ++s)
+    {
+        _slots[s].clear();
+    }
+    _count = 0;
+}
+
+}
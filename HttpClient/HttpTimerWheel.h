@@ -0,0 +1,103 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_TIMER_WHEEL_H__
+#define __HTTP_TIMER_WHEEL_H__
+
+#include <vector>
+#include <chrono>
+#include "HttpRequest.h"
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Hashed timer wheel holding requests until a point in time, e.g. a retry backoff.
+ * Time is cut in ticks and each tick maps to a slot of the wheel, so scheduling and
+ * expiring a timer cost O(1) however many are pending. Timers further away than one
+ * turn of the wheel stay in their slot until their turn comes.
+ * The wheel isn't thread safe, HttpClient only touches it from its network thread.
+ */
+class HttpTimerWheel
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    /**
+     * @param tickMs resolution of the wheel, timers fire at most this late
+     * @param slotCount number of ticks in one turn of the wheel
+     */
+    explicit HttpTimerWheel(long tickMs = 10, size_t slotCount = 512);
+
+    /** Hold request until due */
+    void schedule(HttpRequest::pointer request, const TimePoint& due);
+
+    /** Remove the requests due at or before now, appending them to due */
+    void advance(const TimePoint& now, std::vector<HttpRequest::pointer>& due);
+
+    /** Remove the requests that were cancelled, appending them to cancelled */
+    void takeCancelled(std::vector<HttpRequest::pointer>& cancelled);
+
+    /** When the earliest timer fires, TimePoint::max() if there is none */
+    TimePoint nextDue() const;
+
+    /** Number of pending timers */
+    inline size_t size() const
+    {
+        return _count;
+    }
+
+    inline bool empty() const
+    {
+        return _count == 0;
+    }
+
+    /** Drop every pending timer */
+    void clear();
+
+private:
+    struct Timer
+    {
+        HttpRequest::pointer    request;
+        long long               tick;       /// absolute tick the timer fires at
+    };
+
+    long long tickOf(const TimePoint& time) const;
+
+private:
+    TimePoint                           _origin;    /// time of tick 0
+    long                                _tickMs;
+    std::vector<std::vector<Timer> >    _slots;
+    long long                           _currentTick; /// ticks up to this one have been expired
+    size_t                              _count;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_TIMER_WHEEL_H__
@@ -0,0 +1,372 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#include <stdio.h>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX    // std::max below
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include "HttpTrace.h"
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
+namespace network {
+
+namespace {
+
+struct TraceEvent
+{
+    const char* name;
+    const void* id;
+    int64_t     timestamp;  /// microseconds since s_epoch
+    int64_t     duration;   /// microseconds, complete events only
+    char        phase;      /// Chrome's event type: b, e, i or X
+};
+
+// Events of one thread, only that thread writes them
+struct TraceRing
+{
+    TraceRing()
+    : state(0)
+    , retiredAt(0)
+    , head(0)
+    , name(nullptr)
+    {
+    }
+
+    std::atomic<int>            state;      /// RING_FREE, RING_OWNED or RING_RETIRED
+    uint64_t                    retiredAt;  /// value of s_retireClock when its thread exited, guarded by s_claimMutex
+    std::atomic<uint64_t>       head;       /// events ever written, the next one goes to head % size
+    std::vector<TraceEvent>     events;     /// sized once, when the ring is first claimed
+    std::atomic<const char*>    name;
+};
+
+enum
+{
+    RING_FREE = 0,
+    RING_OWNED,
+    RING_RETIRED     /// its thread is gone, the events stay for export until the ring is claimed again
+};
+
+}
+
+enum
+{
+    MAX_THREADS = 64
+};
+
+std::atomic<bool> HttpTrace::s_enabled(false);
+static TraceRing s_rings[MAX_THREADS];
+static std::mutex s_claimMutex;                 // serializes claiming and retiring rings, never taken to record
+static size_t s_eventsPerThread = 65536;        // guarded by s_claimMutex
+static uint64_t s_retireClock = 0;              // guarded by s_claimMutex
+static std::atomic<uint64_t> s_droppedEvents(0);
+static const HttpTrace::TimePoint s_epoch = std::chrono::steady_clock::now();
+
+// Hand the ring of an exiting thread back, its events are kept until another thread needs it
+static void retireRing(void* ring)
+{
+    TraceRing* retired = static_cast<TraceRing*>(ring);
+    std::lock_guard<std::mutex> lock(s_claimMutex);
+    retired->retiredAt = ++s_retireClock;
+    retired->state.store(RING_RETIRED, std::memory_order_release);
+}
+
+#ifdef _WIN32
+static void NTAPI retireRingAtExit(void* ring)
+{
+    if (ring)
+    {
+        retireRing(ring);
+    }
+}
+#endif
+
+// Per thread pointer to the thread's ring, retiring it when the thread exits
+class RingSlot
+{
+public:
+    RingSlot()
+    {
+#ifdef _WIN32
+        _key = FlsAlloc(&retireRingAtExit);
+#else
+        pthread_key_create(&_key, &retireRing);
+#endif
+    }
+
+    inline TraceRing* get() const
+    {
+#ifdef _WIN32
+        return static_cast<TraceRing*>(FlsGetValue(_key));
+#else
+        return static_cast<TraceRing*>(pthread_getspecific(_key));
+#endif
+    }
+
+    inline void set(TraceRing* ring)
+    {
+#ifdef _WIN32
+        FlsSetValue(_key, ring);
+#else
+        pthread_setspecific(_key, ring);
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    DWORD           _key;
+#else
+    pthread_key_t   _key;
+#endif
+};
+
+static RingSlot s_ringSlot;
+
+// Take a free ring, or else the one retired the longest ago. Null while every ring has a live thread
+static TraceRing* claimRing()
+{
+    // threads left without a ring record often, only lock when there may be one to take
+    bool available = false;
+    for (size_t i = 0; i < MAX_THREADS && !available; ++i)
+    {
+        available = s_rings[i].state.load(std::memory_order_relaxed) != RING_OWNED;
+    }
+    if (!available)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(s_claimMutex);
+    TraceRing* claimed = nullptr;
+    for (size_t i = 0; i < MAX_THREADS; ++i)
+    {
+        TraceRing& ring = s_rings[i];
+        int state = ring.state.load(std::memory_order_relaxed);
+        if (state == RING_FREE)
+        {
+            claimed = &ring;
+            break;
+        }
+        if (state == RING_RETIRED && (!claimed || ring.retiredAt < claimed->retiredAt))
+        {
+            claimed = &ring;
+        }
+    }
+    if (claimed)
+    {
+        // a recycled ring keeps its size, an export may be reading it
+        if (claimed->events.empty())
+        {
+            claimed->events.resize(s_eventsPerThread);
+        }
+        claimed->head.store(0, std::memory_order_relaxed);
+        claimed->name.store(nullptr, std::memory_order_relaxed);
+        claimed->state.store(RING_OWNED, std::memory_order_release);
+    }
+    return claimed;
+}
+
+// The calling thread's ring, claimed on its first event. Null while every ring is taken
+static TraceRing* currentRing()
+{
+    TraceRing* ring = s_ringSlot.get();
+    if (nullptr == ring)
+    {
+        ring = claimRing();
+        if (ring)
+        {
+            s_ringSlot.set(ring);
+        }
+    }
+    return ring;
+}
+
+void HttpTrace::enable(size_t eventsPerThread)
+{
+    {
+        // rings claimed earlier keep their size
+        std::lock_guard<std::mutex> lock(s_claimMutex);
+        s_eventsPerThread = std::max(eventsPerThread, (size_t)1);
+    }
+    s_enabled.store(true, std::memory_order_relaxed);
+}
+
+void HttpTrace::disable()
+{
+    s_enabled.store(false, std::memory_order_relaxed);
+}
+
+void HttpTrace::clear()
+{
+    std::lock_guard<std::mutex> lock(s_claimMutex);
+    for (size_t i = 0; i < MAX_THREADS; ++i)
+    {
+        s_rings[i].head.store(0, std::memory_order_release);
+        // nothing left to keep in the rings of exited threads
+        if (s_rings[i].state.load(std::memory_order_relaxed) == RING_RETIRED)
+        {
+            s_rings[i].state.store(RING_FREE, std::memory_order_release);
+        }
+    }
+    s_droppedEvents.store(0, std::memory_order_relaxed);
+}
+
+uint64_t HttpTrace::getDroppedEvents()
+{
+    return s_droppedEvents.load(std::memory_order_relaxed);
+}
+
+void HttpTrace::setThreadName(const char* name)
+{
+    TraceRing* ring = currentRing();
+    if (ring)
+    {
+        ring->name.store(name, std::memory_order_release);
+    }
+}
+
+void HttpTrace::record(const char* name, char phase, const void* id, const TimePoint& at, int64_t durationUs)
+{
+    TraceRing* ring = currentRing();
+    if (nullptr == ring)
+    {
+        s_droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    TraceEvent& event = ring->events[head % ring->events.size()];
+    event.name = name;
+    event.id = id;
+    event.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(at - s_epoch).count();
+    event.duration = durationUs;
+    event.phase = phase;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void HttpTrace::asyncSpan(const char* name, const void* id, const TimePoint& begin, const TimePoint& end)
+{
+    if (isEnabled())
+    {
+        record(name, 'b', id, begin, 0);
+        record(name, 'e', id, end, 0);
+    }
+}
+
+static void appendEscaped(std::string& out, const char* text)
+{
+    for (; *text; ++text)
+    {
+        if (*text == '"' || *text == '\\')
+        {
+            out.push_back('\\');
+        }
+        if ((unsigned char)*text >= 0x20)
+        {
+            out.push_back(*text);
+        }
+    }
+}
+
+std::string HttpTrace::toChromeJson()
+{
+    std::string out("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    char fields[160];
+    std::vector<TraceEvent> events;
+    for (size_t thread = 0; thread < MAX_THREADS; ++thread)
+    {
+        TraceRing& ring = s_rings[thread];
+        if (ring.state.load(std::memory_order_acquire) == RING_FREE)
+        {
+            continue;
+        }
+
+        const char* name = ring.name.load(std::memory_order_acquire);
+        if (name)
+        {
+            snprintf(fields, sizeof(fields), "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"", first ? "" : ",", (unsigned)thread + 1);
+            out.append(fields);
+            appendEscaped(out, name);
+            out.append("\"}}");
+            first = false;
+        }
+
+        uint64_t head = ring.head.load(std::memory_order_acquire);
+        uint64_t count = std::min(head, (uint64_t)ring.events.size());
+        events.clear();
+        for (uint64_t i = head - count; i < head; ++i)
+        {
+            events.push_back(ring.events[i % ring.events.size()]);
+        }
+
+        for (std::vector<TraceEvent>::iterator it = events.begin(); it != events.end(); ++it)
+        {
+            snprintf(fields, sizeof(fields), "%s{\"ph\":\"%c\",\"cat\":\"http\",\"pid\":1,\"tid\":%u,\"ts\":%lld", first ? "" : ",", it->phase, (unsigned)thread + 1, (long long)it->timestamp);
+            out.append(fields);
+            if (it->phase == 'X')
+            {
+                snprintf(fields, sizeof(fields), ",\"dur\":%lld", (long long)it->duration);
+                out.append(fields);
+            }
+            else if (it->phase == 'i')
+            {
+                out.append(",\"s\":\"t\"");
+            }
+            else
+            {
+                snprintf(fields, sizeof(fields), ",\"id\":\"0x%llx\"", (unsigned long long)(uintptr_t)it->id);
+                out.append(fields);
+            }
+            out.append(",\"name\":\"");
+            appendEscaped(out, it->name);
+            out.append("\"}");
+            first = false;
+        }
+    }
+    out.append("]}\n");
+    return out;
+}
+
+bool HttpTrace::writeChromeJson(const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    std::string json = toChromeJson();
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    return fclose(file) == 0 && ok;
+}
+
+}
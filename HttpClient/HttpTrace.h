@@ -0,0 +1,154 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+#ifndef __HTTP_TRACE_H__
+#define __HTTP_TRACE_H__
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+namespace network {
+
+/**
+ * @addtogroup Network
+ * @{
+ */
+
+/** @brief Optional tracing of request lifecycles, exported as Chrome trace JSON.
+ * Events go to a ring buffer of the thread recording them, so threads never wait on each
+ * other, and the oldest events are overwritten once a ring is full. There are 64 rings: the
+ * ring of a thread that exited keeps its events until a new thread needs it, and the events
+ * of threads finding none free are dropped and counted. Load the output of
+ * toChromeJson() in chrome://tracing or ui.perfetto.dev.
+ * While tracing is disabled every trace point costs one relaxed load and a branch.
+ * Event names are kept by pointer and must be string literals.
+ */
+class HttpTrace
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    /** Start recording, each thread keeping its last eventsPerThread events */
+    static void enable(size_t eventsPerThread = 65536);
+
+    /** Stop recording, the recorded events are kept for export */
+    static void disable();
+
+    inline static bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    /** Drop every recorded event */
+    static void clear();
+
+    /** Events not recorded since the last clear() because every ring had a live thread */
+    static uint64_t getDroppedEvents();
+
+    /** Name the calling thread in the trace */
+    static void setThreadName(const char* name);
+
+    /** Open a span of the object id, e.g. a request, which may end on another thread */
+    inline static void asyncBegin(const char* name, const void* id)
+    {
+        if (isEnabled())
+        {
+            record(name, 'b', id, std::chrono::steady_clock::now(), 0);
+        }
+    }
+
+    /** Close the span opened by asyncBegin() with the same name and id */
+    inline static void asyncEnd(const char* name, const void* id)
+    {
+        if (isEnabled())
+        {
+            record(name, 'e', id, std::chrono::steady_clock::now(), 0);
+        }
+    }
+
+    /** Record a span of id that is already over, e.g. a transfer phase libcurl timed */
+    static void asyncSpan(const char* name, const void* id, const TimePoint& begin, const TimePoint& end);
+
+    /** Record a point in time on the calling thread */
+    inline static void instant(const char* name)
+    {
+        if (isEnabled())
+        {
+            record(name, 'i', nullptr, std::chrono::steady_clock::now(), 0);
+        }
+    }
+
+    /** The recorded events in Chrome's trace event format. Stop tracing first for
+        an exact copy, otherwise the oldest events may be overwritten while they are read */
+    static std::string toChromeJson();
+
+    /** Write toChromeJson() to path */
+    static bool writeChromeJson(const char* path);
+
+    /** Append an event to the calling thread's ring, use the inline helpers instead */
+    static void record(const char* name, char phase, const void* id, const TimePoint& at, int64_t durationUs);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+/** @brief Records the lifetime of a scope as one event on the calling thread */
+class HttpTraceScope
+{
+public:
+    explicit HttpTraceScope(const char* name)
+    : _name(name)
+    , _active(HttpTrace::isEnabled())
+    {
+        if (_active)
+        {
+            _begin = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~HttpTraceScope()
+    {
+        if (_active)
+        {
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            HttpTrace::record(_name, 'X', nullptr, _begin, std::chrono::duration_cast<std::chrono::microseconds>(end - _begin).count());
+        }
+    }
+
+private:
+    HttpTraceScope(const HttpTraceScope&);
+    HttpTraceScope& operator=(const HttpTraceScope&);
+
+    const char*                             _name;
+    bool                                    _active;
+    std::chrono::steady_clock::time_point   _begin;
+};
+
+// end of Network group
+/// @}
+
+}
+
+#endif //__HTTP_TRACE_H__
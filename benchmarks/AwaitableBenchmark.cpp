@@ -0,0 +1,233 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+// Requests per second, and per second of CPU time, of the callback API against
+// co_await HttpClient::send(), plus heap allocations per request of each.
+//
+//   AwaitableBenchmark [url] [requests] [concurrency]
+//
+// Point it at a fast local server, e.g. a static file behind nginx on loopback,
+// so the client is what is measured.
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string>
+#include "HttpClient/HttpAwaitable.h"
+
+using namespace network;
+
+static std::atomic<unsigned long long> s_allocations(0);
+
+void* operator new(std::size_t size)
+{
+    ++s_allocations;
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+struct Options
+{
+    std::string url;
+    int         requests;
+    int         concurrency;
+};
+
+struct Result
+{
+    double              seconds;
+    double              cpuSeconds;
+    unsigned long long  allocations;
+    int                 failures;
+};
+
+static HttpRequest::pointer makeRequest(const Options& options)
+{
+    HttpRequest::pointer request = HttpRequest::create();
+    request->setUrl(options.url.c_str());
+    request->setRequestType(HttpRequest::Type::GET);
+    return request;
+}
+
+class Run
+{
+public:
+    explicit Run(const Options& options)
+    : _options(options)
+    , _started(0)
+    , _finished(0)
+    , _failures(0)
+    {
+    }
+
+    template <class Start>
+    Result measure(Start start)
+    {
+        unsigned long long allocations = s_allocations;
+        std::clock_t cpu = std::clock();
+        std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+
+        start();
+        while (_finished < _options.requests)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        Result result;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+        result.cpuSeconds = double(std::clock() - cpu) / CLOCKS_PER_SEC;
+        result.allocations = s_allocations - allocations;
+        result.failures = _failures;
+        return result;
+    }
+
+    // Claim the next request to send, false once all are sent
+    bool claim()
+    {
+        return _started++ < _options.requests;
+    }
+
+    void finished(const HttpResponse::pointer& response)
+    {
+        if (!response->isSucceed())
+        {
+            ++_failures;
+        }
+        ++_finished;
+    }
+
+    const Options& options() const
+    {
+        return _options;
+    }
+
+private:
+    Options             _options;
+    std::atomic<int>    _started;
+    std::atomic<int>    _finished;
+    std::atomic<int>    _failures;
+};
+
+// Callback API: each completion sends the next request
+static void sendNext(Run& run)
+{
+    if (!run.claim())
+    {
+        return;
+    }
+    HttpRequest::pointer request = makeRequest(run.options());
+    request->setResponseCallback([&run](HttpClient*, HttpResponse::pointer response) {
+        run.finished(response);
+        sendNext(run);
+    });
+    HttpClient::getInstance()->sendAsynchronousRequest(request);
+}
+
+// Coroutine that never suspends at its start or end, the benchmark waits on the counters
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object() { return Detached(); }
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+static Detached worker(Run& run)
+{
+    while (run.claim())
+    {
+        HttpResponse::pointer response = co_await HttpClient::getInstance()->send(makeRequest(run.options()));
+        run.finished(response);
+    }
+}
+
+static void report(const char* name, const Options& options, const Result& result)
+{
+    printf("%-10s %8.0f req/s %10.0f req/cpu-s %8.1f allocs/req %6d failed\n", name,
+           options.requests / result.seconds,
+           result.cpuSeconds > 0 ? options.requests / result.cpuSeconds : 0.0,
+           double(result.allocations) / options.requests,
+           result.failures);
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    options.url = argc > 1 ? argv[1] : "http://127.0.0.1:8080/";
+    options.requests = argc > 2 ? atoi(argv[2]) : 20000;
+    options.concurrency = argc > 3 ? atoi(argv[3]) : 32;
+
+    HttpClient* client = HttpClient::getInstance();
+    client->setMaxConcurrentRequests(options.concurrency);
+    client->setMaxConcurrentRequestsPerHost(0);
+
+    // Warm up the connection pool
+    Run warmup(options);
+    warmup.measure([&]() {
+        for (int i = 0; i < options.concurrency; ++i)
+        {
+            sendNext(warmup);
+        }
+    });
+
+    Run callbacks(options);
+    Result result = callbacks.measure([&]() {
+        for (int i = 0; i < options.concurrency; ++i)
+        {
+            sendNext(callbacks);
+        }
+    });
+    report("callback", options, result);
+
+    Run coroutines(options);
+    result = coroutines.measure([&]() {
+        for (int i = 0; i < options.concurrency; ++i)
+        {
+            worker(coroutines);
+        }
+    });
+    report("co_await", options, result);
+    return 0;
+}
@@ -0,0 +1,302 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+// Open loop load generator: sends requests at a fixed arrival rate whether or not
+// earlier ones came back, and times each from when it was meant to be sent, so a
+// stalled upstream or client shows up in the latencies instead of slowing the
+// load down (no coordinated omission).
+//
+//   LoadGenerator url [rates] [seconds] [concurrency]
+//
+// rates is a comma separated list of requests per second, 100 by default, run one
+// after the other for seconds each, 10 by default, to step up to a saturation point.
+// concurrency caps the client's transfers, 256 by default, requests beyond it wait
+// in the client's queue and that wait counts. Each step reports:
+//   latency     from intended send time to response, what a user would see, the
+//               requests still unanswered at report time counted as waiting until then
+//   service     the transfer alone, as libcurl timed it, what the upstream costs
+//   queue       time in the client's queue, grows when the client saturates
+//   send lag    how late the generator itself sent, grows when this machine saturates
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include "HttpClient/HttpClient.h"
+
+using namespace network;
+
+typedef std::chrono::steady_clock Clock;
+
+/** Histogram plus its largest sample, in microseconds */
+struct Distribution
+{
+    Distribution()
+    : max(0)
+    {
+    }
+
+    void record(long long microseconds)
+    {
+        uint64_t value = microseconds > 0 ? (uint64_t)microseconds : 0;
+        ++histogram.count;
+        histogram.sum += value;
+        ++histogram.buckets[HttpMetrics::Histogram::bucketOf(value)];
+        max = std::max(max, value);
+    }
+
+    HttpMetrics::Histogram histogram;
+    uint64_t               max;
+};
+
+/** Outcome of one rate step, filled by the response callbacks */
+class Step
+{
+public:
+    Step()
+    : _sent(0)
+    , _completed(0)
+    , _errors(0)
+    , _unanswered(0)
+    , _reported(false)
+    {
+    }
+
+    void sent(long long id, const Clock::time_point& intended)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending[id] = intended;
+        ++_sent;
+    }
+
+    void completed(long long id, const HttpResponse::pointer& response, const Clock::time_point& intended)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // one that comes back after the report was already counted there as unanswered
+        if (_reported)
+        {
+            return;
+        }
+        _pending.erase(id);
+        const HttpResponse::Timings& timings = response->getTimings();
+        _latency.record(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - intended).count());
+        if (timings.total >= 0)
+        {
+            _service.record(timings.total);
+        }
+        if (timings.queue >= 0)
+        {
+            _queue.record(timings.queue);
+        }
+        if (!response->isSucceed())
+        {
+            ++_errors;
+        }
+        ++_completed;
+        _lastCompletion = Clock::now();
+    }
+
+    void lagged(long long microseconds)
+    {
+        _lag.record(microseconds);
+    }
+
+    /** Wait for the outstanding responses, false if some didn't come within timeout */
+    bool drain(const Clock::duration& timeout)
+    {
+        Clock::time_point until = Clock::now() + timeout;
+        while (Clock::now() < until)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_completed >= _sent)
+                {
+                    return true;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+    void report(double rate, const Clock::time_point& start, double seconds)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // dropping the unanswered would hide the worst latencies, they waited at least until now
+        Clock::time_point now = Clock::now();
+        for (std::map<long long, Clock::time_point>::const_iterator it = _pending.begin(); it != _pending.end(); ++it)
+        {
+            _latency.record(std::chrono::duration_cast<std::chrono::microseconds>(now - it->second).count());
+        }
+        _unanswered = (int)_pending.size();
+        _pending.clear();
+        _reported = true;
+
+        // throughput runs until the last response, the backlog of a saturated step included
+        double answering = std::chrono::duration<double>(_lastCompletion - start).count();
+        printf("\nrate %.0f req/s for %.1f s: sent %d, completed %d (%.0f req/s), errors %d, unanswered %d\n",
+               rate, seconds, _sent, _completed, answering > 0 ? _completed / answering : 0.0, _errors, _unanswered);
+        printf("%-10s %10s %10s %10s %10s %10s %10s %10s   (ms)\n", "", "mean", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+        print("latency", _latency);
+        if (_unanswered > 0)
+        {
+            printf("%-10s %d unanswered included, timed up to the report\n", "", _unanswered);
+        }
+        print("service", _service);
+        print("queue", _queue);
+        print("send lag", _lag);
+
+        // the latency histogram, coarsened to powers of two
+        printf("latency histogram:\n");
+        const std::vector<uint64_t>& buckets = _latency.histogram.buckets;
+        for (size_t first = 0; first < buckets.size(); first += HttpMetrics::SUB_BUCKETS)
+        {
+            uint64_t count = 0;
+            for (size_t i = first; i < first + HttpMetrics::SUB_BUCKETS && i < buckets.size(); ++i)
+            {
+                count += buckets[i];
+            }
+            if (count == 0)
+            {
+                continue;
+            }
+            uint64_t lower = HttpMetrics::Histogram::bucketLowerBound(first);
+            uint64_t upper = first + HttpMetrics::SUB_BUCKETS < buckets.size() ? HttpMetrics::Histogram::bucketLowerBound(first + HttpMetrics::SUB_BUCKETS) : lower;
+            int width = (int)(50 * count / _latency.histogram.count);
+            printf("  %10.3f - %10.3f ms %8llu %s\n", lower / 1e3, upper / 1e3, (unsigned long long)count, std::string(width, '#').c_str());
+        }
+    }
+
+private:
+    static double milliseconds(const Distribution& distribution, double fraction)
+    {
+        // percentiles fall mid bucket, the largest sample is exact
+        return std::min(distribution.histogram.percentile(fraction), distribution.max) / 1e3;
+    }
+
+    static void print(const char* name, const Distribution& distribution)
+    {
+        const HttpMetrics::Histogram& histogram = distribution.histogram;
+        if (histogram.count == 0)
+        {
+            printf("%-10s %10s\n", name, "-");
+            return;
+        }
+        printf("%-10s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", name,
+               histogram.sum / 1e3 / histogram.count,
+               milliseconds(distribution, 0.5),
+               milliseconds(distribution, 0.9),
+               milliseconds(distribution, 0.99),
+               milliseconds(distribution, 0.999),
+               milliseconds(distribution, 0.9999),
+               distribution.max / 1e3);
+    }
+
+private:
+    std::mutex          _mutex;
+    int                 _sent;
+    int                 _completed;
+    int                 _errors;
+    int                 _unanswered;
+    bool                _reported;
+    std::map<long long, Clock::time_point> _pending;   /// intended send time by request, until it completes
+    Clock::time_point   _lastCompletion;
+    Distribution        _latency;
+    Distribution        _service;
+    Distribution        _queue;
+    Distribution        _lag;   /// only touched by the generator thread
+};
+
+// Send at rate for seconds, on a fixed schedule that never waits for responses
+static void runStep(const std::string& url, double rate, double seconds)
+{
+    // callbacks hold on to the step, one that comes back after the report finds it still there
+    std::shared_ptr<Step> step = std::make_shared<Step>();
+    HttpClient* client = HttpClient::getInstance();
+    Clock::duration interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate));
+    long long total = (long long)(rate * seconds);
+    Clock::time_point start = Clock::now();
+
+    for (long long i = 0; i < total; ++i)
+    {
+        Clock::time_point intended = start + interval * i;
+        Clock::time_point now = Clock::now();
+        if (now < intended)
+        {
+            std::this_thread::sleep_until(intended);
+            now = Clock::now();
+        }
+        // a late send keeps its intended time, the delay is part of what gets measured
+        step->lagged(std::chrono::duration_cast<std::chrono::microseconds>(now - intended).count());
+
+        HttpRequest::pointer request = HttpRequest::create();
+        request->setUrl(url.c_str());
+        request->setRequestType(HttpRequest::Type::GET);
+        request->setResponseCallback([step, i, intended](HttpClient*, HttpResponse::pointer response) {
+            step->completed(i, response, intended);
+        });
+        step->sent(i, intended);
+        client->sendAsynchronousRequest(request);
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    step->drain(std::chrono::seconds(30));
+    step->report(rate, start, elapsed);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s url [rates] [seconds] [concurrency]\n", argv[0]);
+        return 1;
+    }
+    std::string url = argv[1];
+    std::string rates = argc > 2 ? argv[2] : "100";
+    double seconds = argc > 3 ? atof(argv[3]) : 10;
+    int concurrency = argc > 4 ? atoi(argv[4]) : 256;
+
+    HttpClient* client = HttpClient::getInstance();
+    client->setMaxConcurrentRequests(concurrency);
+    client->setMaxConcurrentRequestsPerHost(0);
+
+    for (size_t begin = 0; begin < rates.size(); )
+    {
+        size_t end = rates.find(',', begin);
+        end = end == std::string::npos ? rates.size() : end;
+        double rate = atof(rates.substr(begin, end - begin).c_str());
+        if (rate > 0)
+        {
+            runStep(url, rate, seconds);
+        }
+        begin = end + 1;
+    }
+    return 0;
+}
@@ -0,0 +1,376 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+// Throughput, latency and client CPU of each way to send a request, against an
+// HTTP/1.1 server running in the same process on 127.0.0.1, so runs need no
+// network and can be compared from one build to the next.
+//
+//   LoopbackBenchmark [requests] [engines] [allocations]
+//
+// requests is per run, 2000 by default, fewer for large payloads. engines is a
+// comma separated subset of sync,async,batch,future. Each engine runs once per
+// payload size and concurrency level. CPU per request counts the whole process
+// minus the server's threads, where the platform can time threads separately.
+// Passing "allocations" adds the heap allocations and bytes per request of each
+// phase inside HttpClient. It needs a build with HTTPCLIENT_ALLOCATION_HOOKS defined
+// (the CMake option of that name), which replaces the global operator new for every
+// run, with or without "allocations", and so slows every allocation down a little.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "HttpClient/HttpClient.h"
+#include "HttpClient/HttpAllocations.h"
+#ifdef HTTPCLIENT_ALLOCATION_HOOKS
+#include "HttpClient/HttpAllocationHooks.h"
+#endif
+#include "LoopbackServer.h"
+
+using namespace network;
+
+static double processCpuSeconds()
+{
+#if defined(CLOCK_PROCESS_CPUTIME_ID)
+    timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#else
+    return double(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+struct Result
+{
+    double              seconds;
+    double              clientCpuSeconds;
+    int                 failures;
+    std::vector<double> latencies;  /// microseconds, one per request
+};
+
+/** One engine, payload size and concurrency level: `requests` requests, `concurrency` of them outstanding at a time */
+class Run
+{
+public:
+    Run(const std::string& url, int requests, int concurrency)
+    : _url(url)
+    , _requests(requests)
+    , _concurrency(concurrency)
+    , _started(0)
+    , _finished(0)
+    , _failures(0)
+    , _latencies(requests, 0)
+    {
+    }
+
+    HttpRequest::pointer makeRequest() const
+    {
+        HttpAllocationScope allocations(HttpAllocations::CREATE);
+        HttpRequest::pointer request = HttpRequest::create();
+        request->setUrl(_url.c_str());
+        request->setRequestType(HttpRequest::Type::GET);
+        return request;
+    }
+
+    /** Claim the next request to send, -1 once all are sent */
+    int claim()
+    {
+        int index = _started++;
+        return index < _requests ? index : -1;
+    }
+
+    void finished(int index, const std::chrono::steady_clock::time_point& sentAt, bool succeeded)
+    {
+        _latencies[index] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sentAt).count();
+        if (!succeeded)
+        {
+            ++_failures;
+        }
+        ++_finished;
+    }
+
+    void wait()
+    {
+        while (_finished < _requests)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    int requests() const
+    {
+        return _requests;
+    }
+
+    int concurrency() const
+    {
+        return _concurrency;
+    }
+
+    Result result(double seconds, double clientCpuSeconds)
+    {
+        Result result;
+        result.seconds = seconds;
+        result.clientCpuSeconds = clientCpuSeconds;
+        result.failures = _failures;
+        result.latencies = _latencies;
+        return result;
+    }
+
+private:
+    std::string         _url;
+    int                 _requests;
+    int                 _concurrency;
+    std::atomic<int>    _started;
+    std::atomic<int>    _finished;
+    std::atomic<int>    _failures;
+    std::vector<double> _latencies;
+};
+
+// sendSynchronousRequest: one caller thread per outstanding request
+static void runSync(Run& run)
+{
+    std::vector<std::thread> callers;
+    for (int i = 0; i < run.concurrency(); ++i)
+    {
+        callers.push_back(std::thread([&run]() {
+            for (int index = run.claim(); index >= 0; index = run.claim())
+            {
+                std::chrono::steady_clock::time_point sentAt = std::chrono::steady_clock::now();
+                int error = 0;
+                HttpClient::getInstance()->sendSynchronousRequest(run.makeRequest(), error);
+                run.finished(index, sentAt, error == 0);
+            }
+        }));
+    }
+    for (size_t i = 0; i < callers.size(); ++i)
+    {
+        callers[i].join();
+    }
+}
+
+// sendAsynchronousRequest: each callback sends the next request
+static void sendNextAsync(Run& run)
+{
+    int index = run.claim();
+    if (index < 0)
+    {
+        return;
+    }
+    std::chrono::steady_clock::time_point sentAt = std::chrono::steady_clock::now();
+    HttpRequest::pointer request = run.makeRequest();
+    request->setResponseCallback([&run, index, sentAt](HttpClient*, HttpResponse::pointer response) {
+        run.finished(index, sentAt, response->isSucceed());
+        sendNextAsync(run);
+    });
+    HttpClient::getInstance()->sendAsynchronousRequest(request);
+}
+
+static void runAsync(Run& run)
+{
+    for (int i = 0; i < run.concurrency(); ++i)
+    {
+        sendNextAsync(run);
+    }
+    run.wait();
+}
+
+// sendBatch: waves of `concurrency` requests, the next wave once the batch callback fired
+static void sendNextBatch(Run& run)
+{
+    std::vector<HttpRequest::pointer> requests;
+    std::chrono::steady_clock::time_point sentAt = std::chrono::steady_clock::now();
+    for (int i = 0; i < run.concurrency(); ++i)
+    {
+        int index = run.claim();
+        if (index < 0)
+        {
+            break;
+        }
+        HttpRequest::pointer request = run.makeRequest();
+        request->setResponseCallback([&run, index, sentAt](HttpClient*, HttpResponse::pointer response) {
+            run.finished(index, sentAt, response->isSucceed());
+        });
+        requests.push_back(request);
+    }
+    if (!requests.empty())
+    {
+        HttpClient::getInstance()->sendBatch(requests, [&run](HttpClient*, const std::vector<HttpResponse::pointer>&) {
+            sendNextBatch(run);
+        });
+    }
+}
+
+static void runBatch(Run& run)
+{
+    sendNextBatch(run);
+    run.wait();
+}
+
+// sendAsync: each future's continuation sends the next request
+static void sendNextFuture(Run& run)
+{
+    int index = run.claim();
+    if (index < 0)
+    {
+        return;
+    }
+    std::chrono::steady_clock::time_point sentAt = std::chrono::steady_clock::now();
+    HttpClient::getInstance()->sendAsync(run.makeRequest()).onReady([&run, index, sentAt](const HttpResponse::pointer& response) {
+        run.finished(index, sentAt, response->isSucceed());
+        sendNextFuture(run);
+    });
+}
+
+static void runFuture(Run& run)
+{
+    for (int i = 0; i < run.concurrency(); ++i)
+    {
+        sendNextFuture(run);
+    }
+    run.wait();
+}
+
+struct Engine
+{
+    const char* name;
+    void      (*run)(Run& run);
+};
+
+static double percentile(std::vector<double>& sorted, double fraction)
+{
+    size_t index = std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()));
+    return sorted[index];
+}
+
+// Allocations per request of each phase, the ones of the server's threads left out
+static void reportAllocations(int requests)
+{
+    HttpAllocations::Stats stats = HttpAllocations::getStats();
+    HttpAllocations::Counters client = stats.client();
+    printf("        allocs/req %.1f (%.0f B) in HttpClient:", double(client.allocations) / requests, double(client.bytes) / requests);
+    for (int phase = HttpAllocations::CREATE; phase < HttpAllocations::PHASE_COUNT; ++phase)
+    {
+        const HttpAllocations::Counters& counters = stats.phases[phase];
+        printf(" %s %.1f (%.0f B)", HttpAllocations::phaseName((HttpAllocations::Phase)phase),
+               double(counters.allocations) / requests, double(counters.bytes) / requests);
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int requests = argc > 1 ? atoi(argv[1]) : 2000;
+    std::string selected = argc > 2 ? argv[2] : "sync,async,batch,future";
+    bool allocations = argc > 3 && std::string(argv[3]) == "allocations";
+#ifndef HTTPCLIENT_ALLOCATION_HOOKS
+    if (allocations)
+    {
+        fprintf(stderr, "allocations need a build with HTTPCLIENT_ALLOCATION_HOOKS\n");
+        return 1;
+    }
+#endif
+    // before the first request, so libcurl's allocations are counted too
+    HttpAllocations::enable(allocations);
+
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+
+    LoopbackServer server;
+    if (!server.start())
+    {
+        fprintf(stderr, "could not listen on 127.0.0.1\n");
+        return 1;
+    }
+
+    const Engine engines[] = { { "sync", runSync }, { "async", runAsync }, { "batch", runBatch }, { "future", runFuture } };
+    const size_t payloads[] = { 64, 4096, 65536, 1048576 };
+    const int concurrencies[] = { 1, 8, 64 };
+
+    HttpClient* client = HttpClient::getInstance();
+    client->setMaxConcurrentRequestsPerHost(0);
+
+    printf("%-7s %8s %5s %10s %10s %10s %12s %7s\n", "engine", "payload", "conc", "req/s", "p50 us", "p99 us", "cpu us/req", "failed");
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); ++e)
+    {
+        if (("," + selected + ",").find(std::string(",") + engines[e].name + ",") == std::string::npos)
+        {
+            continue;
+        }
+        for (size_t p = 0; p < sizeof(payloads) / sizeof(payloads[0]); ++p)
+        {
+            char url[64];
+            sprintf(url, "http://127.0.0.1:%d/%lu", server.port(), (unsigned long)payloads[p]);
+            // keep each run to about 256MB of responses
+            int count = std::max(1, std::min(requests, (int)((256u << 20) / payloads[p])));
+
+            for (size_t c = 0; c < sizeof(concurrencies) / sizeof(concurrencies[0]); ++c)
+            {
+                int concurrency = concurrencies[c];
+                client->setMaxConcurrentRequests(concurrency);
+
+                // warm up the connection pool at this concurrency
+                Run warmup(url, concurrency * 2, concurrency);
+                engines[e].run(warmup);
+
+                Run run(url, count, concurrency);
+                HttpAllocations::reset();
+                double serverCpu = server.cpuSeconds();
+                double cpu = processCpuSeconds();
+                std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+                engines[e].run(run);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+                Result result = run.result(seconds, (processCpuSeconds() - cpu) - (server.cpuSeconds() - serverCpu));
+
+                std::sort(result.latencies.begin(), result.latencies.end());
+                printf("%-7s %8lu %5d %10.0f %10.0f %10.0f %12.1f %7d\n", engines[e].name, (unsigned long)payloads[p], concurrency,
+                       count / result.seconds,
+                       percentile(result.latencies, 0.5),
+                       percentile(result.latencies, 0.99),
+                       result.clientCpuSeconds * 1e6 / count,
+                       result.failures);
+                if (allocations)
+                {
+                    reportAllocations(count);
+                }
+                fflush(stdout);
+            }
+        }
+    }
+
+    server.stop();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
@@ -0,0 +1,378 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#ifndef __LOOPBACK_SERVER_H__
+#define __LOOPBACK_SERVER_H__
+
+// Keep-alive HTTP/1.1 server on 127.0.0.1 for the benchmarks and the client tests, so
+// neither needs a network. Header only, include it in one source file of a program.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctype.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+#define closeSocket closesocket
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <time.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closeSocket close
+#endif
+
+// CPU time of the calling thread, 0 where it can't be told apart from the process'
+static double threadCpuSeconds()
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#else
+    return 0;
+#endif
+}
+
+/** Keep-alive HTTP/1.1 server, one thread per connection. Without a handler it answers
+    GET /<n> with n bytes, a handler set before start() may answer anything else */
+class LoopbackServer
+{
+public:
+    /** A request as it came in */
+    struct Request
+    {
+        std::string method;
+        std::string path;       /// with the query string
+        std::string header;     /// request line and header fields
+        std::string body;
+
+        /** Value of a header field, name compared case insensitively, empty if absent */
+        std::string field(const char* name) const
+        {
+            size_t length = strlen(name);
+            size_t line = header.find("\r\n");
+            while (line != std::string::npos)
+            {
+                line += 2;
+                size_t end = header.find("\r\n", line);
+                std::string text = header.substr(line, end == std::string::npos ? std::string::npos : end - line);
+                if (text.size() > length && text[length] == ':' && equalsIgnoreCase(text.substr(0, length), name))
+                {
+                    size_t value = text.find_first_not_of(' ', length + 1);
+                    return value == std::string::npos ? "" : text.substr(value);
+                }
+                line = end;
+            }
+            return "";
+        }
+    };
+
+    /** What to answer */
+    struct Reply
+    {
+        Reply()
+        : status(200)
+        , filler(0)
+        , delayMs(0)
+        {
+        }
+
+        int         status;
+        std::string headers;    /// extra header lines, each ending with \r\n
+        std::string body;
+        size_t      filler;     /// bytes of 'x' sent after body
+        long        delayMs;    /// wait before answering, cut short by stop()
+    };
+
+    typedef std::function<void(const Request& request, Reply& reply)> Handler;
+
+    LoopbackServer()
+    : _listener(INVALID_SOCKET)
+    , _port(0)
+    , _stopping(false)
+    , _cpuMicroseconds(0)
+    {
+    }
+
+    ~LoopbackServer()
+    {
+        stop();
+    }
+
+    /** Answer requests with handler instead of the payload size in their path */
+    void setHandler(const Handler& handler)
+    {
+        _handler = handler;
+    }
+
+    bool start()
+    {
+        _listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (_listener == INVALID_SOCKET)
+        {
+            return false;
+        }
+        int yes = 1;
+        setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t length = sizeof(address);
+        if (bind(_listener, (sockaddr*)&address, sizeof(address)) != 0
+            || listen(_listener, 1024) != 0
+            || getsockname(_listener, (sockaddr*)&address, &length) != 0)
+        {
+            return false;
+        }
+        _port = ntohs(address.sin_port);
+        _acceptor = std::thread(&LoopbackServer::acceptLoop, this);
+        return true;
+    }
+
+    void stop()
+    {
+        if (_stopping.exchange(true) || _listener == INVALID_SOCKET)
+        {
+            return;
+        }
+        // shutting the sockets down wakes the threads blocked on them
+        shutdown(_listener, 2);
+        closeSocket(_listener);
+        _acceptor.join();
+
+        std::vector<std::thread> connections;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (size_t i = 0; i < _sockets.size(); ++i)
+            {
+                shutdown(_sockets[i], 2);
+            }
+            connections.swap(_connections);
+        }
+        for (size_t i = 0; i < connections.size(); ++i)
+        {
+            connections[i].join();
+        }
+    }
+
+    int port() const
+    {
+        return _port;
+    }
+
+    /** Url of path on this server, path starting with a slash */
+    std::string url(const std::string& path) const
+    {
+        char origin[32];
+        sprintf(origin, "http://127.0.0.1:%d", _port);
+        return origin + path;
+    }
+
+    /** CPU the connection threads spent answering, in seconds */
+    double cpuSeconds() const
+    {
+        return _cpuMicroseconds / 1e6;
+    }
+
+private:
+    static bool equalsIgnoreCase(const std::string& left, const char* right)
+    {
+        for (size_t i = 0; i < left.size(); ++i)
+        {
+            if (tolower((unsigned char)left[i]) != tolower((unsigned char)right[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static const char* reason(int status)
+    {
+        switch (status)
+        {
+            case 200: return "OK";
+            case 304: return "Not Modified";
+            case 404: return "Not Found";
+            case 429: return "Too Many Requests";
+            case 500: return "Internal Server Error";
+            case 503: return "Service Unavailable";
+            default:  return "Status";
+        }
+    }
+
+    void acceptLoop()
+    {
+        while (!_stopping)
+        {
+            socket_t connection = accept(_listener, nullptr, nullptr);
+            if (connection == INVALID_SOCKET)
+            {
+                continue;
+            }
+            int yes = 1;
+            setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopping)
+            {
+                closeSocket(connection);
+                break;
+            }
+            _sockets.push_back(connection);
+            _connections.push_back(std::thread(&LoopbackServer::serve, this, connection));
+        }
+    }
+
+    void serve(socket_t connection)
+    {
+        std::string buffer;
+        char chunk[16384];
+        while (true)
+        {
+            size_t headerEnd = buffer.find("\r\n\r\n");
+            if (headerEnd == std::string::npos)
+            {
+                int received = recv(connection, chunk, sizeof(chunk), 0);
+                if (received <= 0)
+                {
+                    break;
+                }
+                buffer.append(chunk, received);
+                continue;
+            }
+
+            double cpu = threadCpuSeconds();
+            Request request;
+            request.header = buffer.substr(0, headerEnd);
+            size_t bodyLength = (size_t)atol(request.field("Content-Length").c_str());
+            if (buffer.size() < headerEnd + 4 + bodyLength)
+            {
+                int received = recv(connection, chunk, sizeof(chunk), 0);
+                if (received <= 0)
+                {
+                    break;
+                }
+                buffer.append(chunk, received);
+                continue;
+            }
+            request.body = buffer.substr(headerEnd + 4, bodyLength);
+            buffer.erase(0, headerEnd + 4 + bodyLength);
+
+            // GET /<path> HTTP/1.1
+            size_t method = request.header.find(' ');
+            size_t path = request.header.find(' ', method + 1);
+            request.method = request.header.substr(0, method);
+            request.path = request.header.substr(method + 1, path - method - 1);
+
+            Reply reply;
+            if (_handler)
+            {
+                _handler(request, reply);
+            }
+            else
+            {
+                reply.filler = (size_t)atol(request.path.c_str() + 1);
+            }
+            for (long waited = 0; waited < reply.delayMs && !_stopping; waited += 10)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(std::min(10L, reply.delayMs - waited)));
+            }
+
+            char head[128];
+            int headLength = sprintf(head, "HTTP/1.1 %d %s\r\nContent-Length: %lu\r\nContent-Type: application/octet-stream\r\n",
+                                     reply.status, reason(reply.status), (unsigned long)(reply.body.size() + reply.filler));
+            std::string headers(head, headLength);
+            headers.append(reply.headers).append("\r\n").append(reply.body);
+            if (!sendAll(connection, headers.data(), headers.size()) || !sendFiller(connection, reply.filler))
+            {
+                break;
+            }
+            _cpuMicroseconds += (long long)((threadCpuSeconds() - cpu) * 1e6);
+        }
+        closeSocket(connection);
+    }
+
+    static bool sendAll(socket_t connection, const char* data, size_t length)
+    {
+        while (length > 0)
+        {
+            int sent = send(connection, data, (int)length, 0);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            data += sent;
+            length -= sent;
+        }
+        return true;
+    }
+
+    static bool sendFiller(socket_t connection, size_t size)
+    {
+        static const std::vector<char> filler(65536, 'x');
+        while (size > 0)
+        {
+            size_t part = std::min(size, filler.size());
+            if (!sendAll(connection, &filler[0], part))
+            {
+                return false;
+            }
+            size -= part;
+        }
+        return true;
+    }
+
+private:
+    socket_t                    _listener;
+    int                         _port;
+    std::atomic<bool>           _stopping;
+    std::atomic<long long>      _cpuMicroseconds;
+    Handler                     _handler;
+    std::thread                 _acceptor;
+    std::mutex                  _mutex;
+    std::vector<socket_t>       _sockets;
+    std::vector<std::thread>    _connections;
+};
+
+#endif //__LOOPBACK_SERVER_H__
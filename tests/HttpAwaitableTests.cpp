@@ -0,0 +1,73 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include <atomic>
+#include <exception>
+#include "HttpClient/HttpAwaitable.h"
+#include "TestServer.h"
+#include "NetworkTests.h"
+
+using namespace network;
+using namespace network_tests;
+
+/** Coroutine nobody waits for, it runs up to its first co_await right away */
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object() { return Detached(); }
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+static Detached sendTwice(HttpRequest::pointer request, std::atomic<int>* succeeded)
+{
+    HttpResponse::pointer first = co_await HttpClient::getInstance()->send(request);
+    HttpResponse::pointer second = co_await HttpClient::getInstance()->send(request);
+    *succeeded = (first->isSucceed() ? 1 : 0) + (second->isSucceed() ? 1 : 0);
+}
+
+TEST_CASE(awaiterRunsAndRestoresRequestCallback)
+{
+    std::atomic<int> calls(0);
+    std::atomic<int> succeeded(-1);
+    HttpRequest::pointer request = makeGet("/awaitable/callback");
+    request->setResponseCallback([&calls](HttpClient*, HttpResponse::pointer) {
+        ++calls;
+    });
+
+    // the awaiter of the first co_await is gone by the time the second one sends the request again
+    sendTwice(request, &succeeded);
+    CHECK(waitUntil([&succeeded]() { return succeeded >= 0; }));
+    CHECK(succeeded == 2);
+    CHECK(calls == 2);
+
+    // and the request is left with its own callback
+    CHECK(HttpClient::getInstance()->sendAsynchronousRequest(request));
+    CHECK(waitUntil([&calls]() { return calls == 3; }));
+    CHECK(serverHits("/awaitable/callback") == 3);
+}
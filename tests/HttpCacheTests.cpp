@@ -0,0 +1,323 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include <cstring>
+#include <fstream>
+#include "HttpClient/HttpCache.h"
+#include "NetworkTests.h"
+#include "TestServer.h"
+
+using namespace network;
+
+static std::vector<char> bytes(const char* text)
+{
+    return std::vector<char>(text, text + strlen(text));
+}
+
+static HttpRequest::pointer makeGet(const char* url, const char* header = nullptr)
+{
+    HttpRequest::pointer request = HttpRequest::create();
+    request->setUrl(url);
+    request->setRequestType(HttpRequest::Type::GET);
+    if (header)
+    {
+        request->setHeaders(std::vector<std::string>(1, header));
+    }
+    return request;
+}
+
+TEST_CASE(cacheParsesPolicyOfLastHeaderBlock)
+{
+    HttpCache::Policy policy = HttpCache::parsePolicy(bytes(
+        "HTTP/1.1 301 Moved Permanently\r\n"
+        "Cache-Control: no-store\r\n"
+        "Location: /next\r\n"
+        "\r\n"
+        "HTTP/1.1 200 OK\r\n"
+        "cache-control: public, MAX-AGE=120\r\n"
+        "Age: 20\r\n"
+        "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+        "ETag: \"abc\"\r\n"
+        "Last-Modified: Sat, 05 Nov 1994 08:49:37 GMT\r\n"
+        "Vary: Accept-Encoding, Accept-Language\r\n"
+        "\r\n"));
+
+    CHECK(!policy.noStore);
+    CHECK(!policy.noCache);
+    CHECK(policy.maxAge == 120);
+    CHECK(policy.age == 20);
+    CHECK(policy.date == 784111777);
+    CHECK(policy.etag == "\"abc\"");
+    CHECK(policy.lastModified == "Sat, 05 Nov 1994 08:49:37 GMT");
+    CHECK(policy.vary.size() == 2 && policy.vary[0] == "accept-encoding" && policy.vary[1] == "accept-language");
+    CHECK(!policy.varyAll);
+}
+
+TEST_CASE(cacheParsesDirectivesThatPreventReuse)
+{
+    HttpCache::Policy noStore = HttpCache::parsePolicy(bytes("HTTP/1.1 200 OK\r\nCache-Control: private, no-store\r\n\r\n"));
+    CHECK(noStore.noStore);
+
+    HttpCache::Policy pragma = HttpCache::parsePolicy(bytes("HTTP/1.1 200 OK\r\nPragma: no-cache\r\n\r\n"));
+    CHECK(pragma.noCache);
+
+    // Cache-Control takes precedence over Pragma
+    HttpCache::Policy both = HttpCache::parsePolicy(bytes("HTTP/1.1 200 OK\r\nPragma: no-cache\r\nCache-Control: max-age=5\r\n\r\n"));
+    CHECK(!both.noCache);
+    CHECK(both.maxAge == 5);
+
+    HttpCache::Policy invalidExpires = HttpCache::parsePolicy(bytes("HTTP/1.1 200 OK\r\nExpires: 0\r\n\r\n"));
+    CHECK(invalidExpires.expires == 1);
+
+    HttpCache::Policy varyAll = HttpCache::parsePolicy(bytes("HTTP/1.1 200 OK\r\nVary: *\r\n\r\n"));
+    CHECK(varyAll.varyAll);
+}
+
+TEST_CASE(cacheComputesFreshnessLifetime)
+{
+    time_t now = 1000000;
+    HttpCache::Policy policy;
+    CHECK(HttpCache::freshnessExpiry(policy, now) == 0);
+
+    policy.maxAge = 100;
+    policy.age = 30;
+    CHECK(HttpCache::freshnessExpiry(policy, now) == now + 70);
+
+    // max-age wins over Expires, which counts from the server's Date
+    policy.expires = 5000;
+    CHECK(HttpCache::freshnessExpiry(policy, now) == now + 70);
+    policy.maxAge = -1;
+    policy.age = 0;
+    policy.date = 4950;
+    CHECK(HttpCache::freshnessExpiry(policy, now) == now + 50);
+
+    policy.noCache = true;
+    CHECK(HttpCache::freshnessExpiry(policy, now) == 0);
+
+    HttpCache::Entry entry;
+    entry.expiresAt = now + 1;
+    CHECK(HttpCache::isFresh(entry, now));
+    CHECK(!HttpCache::isFresh(entry, now + 1));
+}
+
+TEST_CASE(cacheStoresOnlyReusableResponses)
+{
+    HttpCache cache("network_tests_cache");
+    const char* url = "http://cache.test/reusable";
+    HttpRequest::pointer request = makeGet(url);
+    std::vector<char> body = bytes("body");
+    cache.remove(url);
+
+    CHECK(!cache.store(request, 404, bytes("HTTP/1.1 404 Not Found\r\nCache-Control: max-age=60\r\n\r\n"), body));
+    CHECK(!cache.store(request, 200, bytes("HTTP/1.1 200 OK\r\nCache-Control: no-store\r\n\r\n"), body));
+    CHECK(!cache.store(request, 200, bytes("HTTP/1.1 200 OK\r\nVary: *\r\nCache-Control: max-age=60\r\n\r\n"), body));
+    // stale and nothing to revalidate it with
+    CHECK(!cache.store(request, 200, bytes("HTTP/1.1 200 OK\r\nCache-Control: max-age=0\r\n\r\n"), body));
+
+    HttpCache::Entry entry;
+    CHECK(!cache.lookup(request, entry));
+
+    CHECK(cache.store(request, 200, bytes("HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\n\r\n"), body));
+    CHECK(cache.lookup(request, entry));
+    CHECK(entry.responseCode == 200);
+    CHECK(entry.body == body);
+    CHECK(HttpCache::isFresh(entry, time(nullptr)));
+
+    cache.remove(url);
+    CHECK(!cache.lookup(request, entry));
+}
+
+TEST_CASE(cacheKeysVariantsOnVaryHeaders)
+{
+    HttpCache cache("network_tests_cache");
+    const char* url = "http://cache.test/vary";
+    cache.remove(url);
+
+    HttpRequest::pointer english = makeGet(url, "Accept-Language: en");
+    CHECK(cache.store(english, 200, bytes("HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nVary: Accept-Language\r\n\r\n"), bytes("hello")));
+
+    HttpCache::Entry entry;
+    CHECK(cache.lookup(makeGet(url, "accept-language:  en"), entry));
+    CHECK(entry.body == bytes("hello"));
+    CHECK(!cache.lookup(makeGet(url, "Accept-Language: fr-unstored"), entry));
+    cache.remove(url);
+}
+
+TEST_CASE(cacheRefreshesStaleEntryFromNotModified)
+{
+    HttpCache cache("network_tests_cache");
+    const char* url = "http://cache.test/refresh";
+    HttpRequest::pointer request = makeGet(url);
+    cache.remove(url);
+
+    std::vector<char> body = bytes("cached body");
+    CHECK(cache.store(request, 200, bytes("HTTP/1.1 200 OK\r\nCache-Control: max-age=0\r\nETag: \"v1\"\r\n"
+                                          "Last-Modified: Sat, 05 Nov 1994 08:49:37 GMT\r\n\r\n"), body));
+
+    // stale, so the client sends it conditionally
+    HttpCache::Entry entry;
+    CHECK(cache.lookup(request, entry));
+    CHECK(!HttpCache::isFresh(entry, time(nullptr)));
+    std::vector<std::string> conditional = HttpCache::conditionalHeaders(entry);
+    CHECK(conditional.size() == 2);
+    CHECK(conditional.size() == 2 && conditional[0] == "If-None-Match: \"v1\"");
+    CHECK(conditional.size() == 2 && conditional[1] == "If-Modified-Since: Sat, 05 Nov 1994 08:49:37 GMT");
+
+    // the 304 makes it fresh again and may bring a new validator, the body stays
+    cache.refresh(request, entry, bytes("HTTP/1.1 304 Not Modified\r\nCache-Control: max-age=60\r\nETag: \"v2\"\r\n\r\n"));
+    CHECK(HttpCache::isFresh(entry, time(nullptr)));
+    CHECK(entry.etag == "\"v2\"");
+    CHECK(entry.lastModified == "Sat, 05 Nov 1994 08:49:37 GMT");
+
+    HttpCache::Entry stored;
+    CHECK(cache.lookup(request, stored));
+    CHECK(HttpCache::isFresh(stored, time(nullptr)));
+    CHECK(stored.etag == "\"v2\"");
+    CHECK(stored.body == body);
+    cache.remove(url);
+}
+
+TEST_CASE(cacheMergesNotModifiedHeadersOverStoredOnes)
+{
+    std::vector<char> merged = HttpCache::mergeHeaders(
+        bytes("HTTP/1.1 200 OK\r\nContent-Length: 5\r\nCache-Control: max-age=60\r\nAge: 10\r\nETag: \"v1\"\r\n\r\n"),
+        bytes("HTTP/1.1 304 Not Modified\r\nContent-Length: 0\r\nETag: \"v2\"\r\nDate: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n"));
+    CHECK(std::string(merged.begin(), merged.end()) ==
+          "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nCache-Control: max-age=60\r\n"
+          "ETag: \"v2\"\r\nDate: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n");
+}
+
+TEST_CASE(cacheRefreshKeepsStoredFreshnessWhenNotModifiedHasNone)
+{
+    HttpCache::Entry entry;
+    entry.responseCode = 200;
+    entry.header = bytes("HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nETag: \"v1\"\r\n\r\n");
+
+    time_t now = time(nullptr);
+    HttpCache::revalidate(entry, bytes("HTTP/1.1 304 Not Modified\r\nETag: \"v1\"\r\n\r\n"), now);
+    CHECK(entry.expiresAt == now + 60);
+    CHECK(entry.etag == "\"v1\"");
+
+    // a 304 carrying its own freshness wins over the stored one
+    HttpCache::revalidate(entry, bytes("HTTP/1.1 304 Not Modified\r\nCache-Control: max-age=5\r\n\r\n"), now);
+    CHECK(entry.expiresAt == now + 5);
+    CHECK(entry.etag == "\"v1\"");
+}
+
+TEST_CASE(cacheRejectsEntryWrittenForAnotherKey)
+{
+    const char* directory = "network_tests_cache_keys";
+    network_tests::clearDirectory(directory);
+    HttpCache cache(directory);
+    HttpRequest::pointer first = makeGet("http://cache.test/first");
+    HttpRequest::pointer second = makeGet("http://cache.test/second");
+    std::vector<char> header = bytes("HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\n\r\n");
+
+    CHECK(cache.store(first, 200, header, bytes("first")));
+    std::vector<std::string> firstFiles = network_tests::listFiles(directory, ".cache");
+    CHECK(cache.store(second, 200, header, bytes("second")));
+    std::vector<std::string> files = network_tests::listFiles(directory, ".cache");
+    CHECK(firstFiles.size() == 1 && files.size() == 2);
+    if (firstFiles.size() != 1 || files.size() != 2)
+    {
+        return;
+    }
+
+    // make the second url's file hold the first one's entry, as a hash collision would
+    std::string secondFile = files[0] == firstFiles[0] ? files[1] : files[0];
+    std::ifstream in((std::string(directory) + "/" + firstFiles[0]).c_str(), std::ios::binary);
+    std::ofstream out((std::string(directory) + "/" + secondFile).c_str(), std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+    out.close();
+
+    HttpCache::Entry entry;
+    CHECK(!cache.lookup(second, entry));
+    CHECK(cache.lookup(first, entry) && entry.body == bytes("first"));
+}
+
+TEST_CASE(cacheRemoveDeletesEveryVariant)
+{
+    const char* directory = "network_tests_cache_remove";
+    network_tests::clearDirectory(directory);
+    HttpCache cache(directory);
+    const char* url = "http://cache.test/variants";
+    std::vector<char> header = bytes("HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nVary: Accept-Language\r\n\r\n");
+
+    CHECK(cache.store(makeGet(url, "Accept-Language: en"), 200, header, bytes("hello")));
+    CHECK(cache.store(makeGet(url, "Accept-Language: fr"), 200, header, bytes("bonjour")));
+    CHECK(network_tests::listFiles(directory, ".cache").size() == 2);
+
+    cache.remove(url);
+    CHECK(network_tests::listFiles(directory, ".cache").empty());
+    CHECK(network_tests::listFiles(directory, ".vary").empty());
+    CHECK(cache.getSize() == 0);
+}
+
+TEST_CASE(cacheEvictsLeastRecentlyUsedFilesOverItsCap)
+{
+    const char* directory = "network_tests_cache_evict";
+    network_tests::clearDirectory(directory);
+    HttpCache cache(directory, 4096);
+    std::vector<char> header = bytes("HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\n\r\n");
+    std::vector<char> body(1000, 'x');
+
+    CHECK(cache.store(makeGet("http://cache.test/a"), 200, header, body));
+    CHECK(cache.store(makeGet("http://cache.test/b"), 200, header, body));
+    CHECK(cache.store(makeGet("http://cache.test/c"), 200, header, body));
+    HttpCache::Entry entry;
+    CHECK(cache.lookup(makeGet("http://cache.test/a"), entry));
+
+    // over the cap: b is the least recently used
+    CHECK(cache.store(makeGet("http://cache.test/d"), 200, header, body));
+    CHECK(cache.getSize() <= 4096);
+    CHECK(cache.lookup(makeGet("http://cache.test/a"), entry));
+    CHECK(!cache.lookup(makeGet("http://cache.test/b"), entry));
+    CHECK(cache.lookup(makeGet("http://cache.test/c"), entry));
+    CHECK(cache.lookup(makeGet("http://cache.test/d"), entry));
+
+    // an entry that can't fit is not stored at all
+    CHECK(!cache.store(makeGet("http://cache.test/huge"), 200, header, std::vector<char>(8192, 'x')));
+
+    // files left by an earlier instance count against the cap
+    HttpCache reopened(directory, 4096);
+    CHECK(reopened.getSize() == cache.getSize());
+}
+
+TEST_CASE(cacheReadsFieldsLongerThanAnyBuffer)
+{
+    HttpCache cache("network_tests_cache");
+    const char* url = "http://cache.test/long-etag";
+    HttpRequest::pointer request = makeGet(url);
+    cache.remove(url);
+
+    std::string etag = "\"" + std::string(3000, 'e') + "\"";
+    std::string header = "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nETag: " + etag + "\r\n\r\n";
+    CHECK(cache.store(request, 200, std::vector<char>(header.begin(), header.end()), bytes("body")));
+
+    HttpCache::Entry entry;
+    CHECK(cache.lookup(request, entry));
+    CHECK(entry.etag == etag);
+    CHECK(entry.body == bytes("body"));
+    cache.remove(url);
+}
@@ -0,0 +1,496 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+#include "HttpClient/HttpRequestScheduler.h"
+#include "HttpClient/HttpExecutor.h"
+#include "HttpClient/HttpCompletionQueue.h"
+#include "TestServer.h"
+#include "NetworkTests.h"
+
+using namespace network;
+using namespace network_tests;
+
+TEST_CASE(clientSendsSynchronousRequest)
+{
+    int error = -1;
+    std::string body = HttpClient::getInstance()->sendSynchronousRequest(makeGet("/client/sync?body=hello"), error);
+    CHECK(error == 0);
+    CHECK(body == "hello");
+    CHECK(serverHits("/client/sync?body=hello") == 1);
+}
+
+TEST_CASE(clientSendsAsynchronousRequest)
+{
+    HttpResponse::pointer response = fetch(makeGet("/client/async?size=100000"));
+    CHECK(response != nullptr);
+    if (response)
+    {
+        CHECK(response->isSucceed());
+        CHECK(response->getResponseCode() == 200);
+        CHECK(response->getSharedResponseData()->size() == strlen("/client/async?size=100000") + 100000);
+    }
+}
+
+TEST_CASE(clientFailsOnErrorStatus)
+{
+    HttpResponse::pointer response = fetch(makeGet("/client/missing?status=404"));
+    CHECK(response != nullptr);
+    if (response)
+    {
+        CHECK(!response->isSucceed());
+        CHECK(response->getResponseCode() == 404);
+    }
+}
+
+TEST_CASE(clientSendsPostBody)
+{
+    HttpRequest::pointer request = makeGet("/client/post");
+    request->setRequestType(HttpRequest::Type::POST);
+    request->setRequestData("data", 4);
+    HttpResponse::pointer response = fetch(request);
+    CHECK(response != nullptr && response->isSucceed());
+    CHECK(response != nullptr && bodyOf(response) == "/client/post");
+    CHECK(serverHits("/client/post") == 1);
+}
+
+TEST_CASE(clientServesAndRevalidatesFromDiskCache)
+{
+    HttpClient* client = HttpClient::getInstance();
+    clearDirectory("network_tests_client_cache");
+    client->enableCache("network_tests_client_cache");
+    int error = -1;
+
+    // fresh: the second request never reaches the server
+    const char* fresh = "/client/disk?maxAge=60&body=disk";
+    CHECK(client->sendSynchronousRequest(makeGet(fresh), error) == "disk");
+    CHECK(client->sendSynchronousRequest(makeGet(fresh), error) == "disk");
+    CHECK(serverHits(fresh) == 1);
+
+    // a forced revalidation gets a 304 without Cache-Control, the stored max-age still holds after it
+    const char* tagged = "/client/disk-tagged?maxAge=60&etag=v1&body=tagged";
+    CHECK(client->sendSynchronousRequest(makeGet(tagged), error) == "tagged");
+    HttpRequest::pointer revalidate = makeGet(tagged);
+    revalidate->setHeaders(std::vector<std::string>(1, "Cache-Control: no-cache"));
+    CHECK(client->sendSynchronousRequest(revalidate, error) == "tagged");
+    CHECK(serverHits(tagged) == 2);
+    CHECK(client->sendSynchronousRequest(makeGet(tagged), error) == "tagged");
+    CHECK(serverHits(tagged) == 2);
+
+    client->enableCache(nullptr);
+}
+
+TEST_CASE(clientServesMemoryCacheHits)
+{
+    HttpClient* client = HttpClient::getInstance();
+    client->enableMemoryCache(1024 * 1024);
+
+    const char* path = "/client/memory?maxAge=60&body=hot";
+    HttpResponse::pointer first = fetch(makeGet(path));
+    HttpResponse::pointer second = fetch(makeGet(path));
+    CHECK(first != nullptr && !first->isFromCache() && bodyOf(first) == "hot");
+    CHECK(second != nullptr && second->isFromCache() && bodyOf(second) == "hot");
+    CHECK(second != nullptr && std::string(second->getResponseHeader()->begin(), second->getResponseHeader()->end()).find("max-age=60") != std::string::npos);
+    CHECK(serverHits(path) == 1);
+    CHECK(client->getMemoryCacheStats().hits >= 1);
+
+    client->enableMemoryCache(0);
+}
+
+TEST_CASE(clientPromotesDiskEntriesWithTheirOwnExpiry)
+{
+    HttpClient* client = HttpClient::getInstance();
+    const char* directory = "network_tests_client_promote";
+    const char* path = "/client/promote?maxAge=60&body=fresh";
+    clearDirectory(directory);
+
+    // stored with max-age=60 a while ago, one second of it is left
+    HttpCache cache(directory);
+    HttpRequest::pointer request = makeGet(path);
+    std::string header("HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\n\r\n");
+    std::string body("stored");
+    CHECK(cache.store(request, 200, std::vector<char>(header.begin(), header.end()), std::vector<char>(body.begin(), body.end())));
+    HttpCache::Entry entry;
+    CHECK(cache.lookup(request, entry));
+    time_t expiresAt = time(nullptr) + 1;
+    entry.expiresAt = expiresAt;
+    cache.update(request, entry);
+
+    client->enableCache(directory);
+    client->enableMemoryCache(1024 * 1024);
+    int error = -1;
+    CHECK(client->sendSynchronousRequest(makeGet(path), error) == "stored");
+    CHECK(serverHits(path) == 0);
+
+    // the memory copy goes stale with the disk entry, not 60 seconds after the disk hit
+    CHECK(waitUntil([expiresAt]() { return time(nullptr) > expiresAt; }, 3000));
+    CHECK(client->sendSynchronousRequest(makeGet(path), error) == "fresh");
+    CHECK(serverHits(path) == 1);
+
+    client->enableMemoryCache(0);
+    client->enableCache(nullptr);
+}
+
+TEST_CASE(clientCoalescesIdenticalRequests)
+{
+    HttpClient* client = HttpClient::getInstance();
+    client->enableRequestCoalescing(true);
+
+    const char* path = "/client/coalesce?delay=200&body=shared";
+    std::vector<HttpRequest::pointer> requests;
+    std::vector<HttpFuture<HttpResponse::pointer> > responses;
+    for (int i = 0; i < 5; ++i)
+    {
+        requests.push_back(makeGet(path));
+        responses.push_back(client->sendAsync(requests.back()));
+    }
+
+    // a follower cancelled on its own leaves the shared transfer to the others
+    client->cancelRequest(requests[3]);
+    for (size_t i = 0; i < responses.size(); ++i)
+    {
+        CHECK(responses[i].waitFor(5000));
+        if (!responses[i].waitFor(0))
+        {
+            continue;
+        }
+        HttpResponse::pointer response = responses[i].get();
+        CHECK(response->getHttpRequest() == requests[i]);
+        if (i == 3)
+        {
+            CHECK(!response->isSucceed() && std::string(response->getErrorBuffer()) == "cancelled");
+        }
+        else
+        {
+            CHECK(response->isSucceed() && bodyOf(response) == "shared");
+        }
+    }
+    CHECK(serverHits(path) == 1);
+
+    // with coalescing off every request is sent
+    client->enableRequestCoalescing(false);
+    const char* separate = "/client/coalesce-off?delay=100";
+    HttpFuture<HttpResponse::pointer> first = client->sendAsync(makeGet(separate));
+    HttpFuture<HttpResponse::pointer> second = client->sendAsync(makeGet(separate));
+    CHECK(first.waitFor(5000) && second.waitFor(5000));
+    CHECK(serverHits(separate) == 2);
+}
+
+TEST_CASE(clientCancelsQueuedRequest)
+{
+    HttpClient* client = HttpClient::getInstance();
+    int perHost = client->getMaxConcurrentRequestsPerHost();
+    client->setMaxConcurrentRequestsPerHost(1);
+
+    // the first request holds the only slot for the host, the second waits in the queue
+    HttpFuture<HttpResponse::pointer> blocker = client->sendAsync(makeGet("/client/cancel-blocker?delay=300"));
+    CHECK(waitUntil([]() { return serverHits("/client/cancel-blocker?delay=300") == 1; }));
+    HttpRequest::pointer queued = makeGet("/client/cancel-queued");
+    HttpFuture<HttpResponse::pointer> response = client->sendAsync(queued);
+    client->cancelRequest(queued);
+
+    CHECK(response.waitFor(5000));
+    if (response.waitFor(0))
+    {
+        CHECK(!response.get()->isSucceed());
+        CHECK(std::string(response.get()->getErrorBuffer()) == "cancelled");
+    }
+    CHECK(blocker.waitFor(5000) && blocker.get()->isSucceed());
+    CHECK(serverHits("/client/cancel-queued") == 0);
+
+    client->setMaxConcurrentRequestsPerHost(perHost);
+}
+
+TEST_CASE(clientCancelsRequestInFlight)
+{
+    HttpClient* client = HttpClient::getInstance();
+    const char* path = "/client/cancel-inflight?delay=3000";
+    HttpRequest::pointer request = makeGet(path);
+    HttpFuture<HttpResponse::pointer> response = client->sendAsync(request);
+    CHECK(waitUntil([path]() { return serverHits(path) == 1; }));
+
+    // the transfer is aborted rather than left to run for the server's delay
+    std::chrono::steady_clock::time_point cancelledAt = std::chrono::steady_clock::now();
+    client->cancelRequest(request);
+    CHECK(response.waitFor(1000));
+    CHECK(std::chrono::steady_clock::now() - cancelledAt < std::chrono::milliseconds(1000));
+    if (response.waitFor(0))
+    {
+        CHECK(!response.get()->isSucceed());
+        CHECK(std::string(response.get()->getErrorBuffer()) == "cancelled");
+    }
+}
+
+TEST_CASE(clientStartsRequestsQueuedWhileItDeliversResponses)
+{
+    // each request is queued as soon as the cancelled one before it is answered, while the
+    // network thread may still be on its way to sleep
+    HttpClient* client = HttpClient::getInstance();
+    for (int i = 0; i < 10; ++i)
+    {
+        HttpRequest::pointer cancelled = makeGet("/client/back-to-back-cancelled?delay=2000");
+        HttpFuture<HttpResponse::pointer> answer = client->sendAsync(cancelled);
+        client->cancelRequest(cancelled);
+        CHECK(answer.waitFor(1000));
+
+        HttpResponse::pointer response = fetch(makeGet("/client/back-to-back"), 1000);
+        CHECK(response != nullptr && response->isSucceed());
+        if (!response)
+        {
+            break;
+        }
+    }
+    CHECK(serverHits("/client/back-to-back") == 10);
+}
+
+// A GET for path that may be hedged, to hedgeUrl if given
+static HttpRequest::pointer makeHedged(const std::string& path, const std::string& hedgeUrl = "")
+{
+    HttpRequest::pointer request = makeGet(path);
+    request->setHedgingEnabled(true);
+    if (!hedgeUrl.empty())
+    {
+        request->setHedgeUrl(hedgeUrl.c_str());
+    }
+    return request;
+}
+
+// Url of path on the shared server through "localhost", a host of its own for the scheduler
+static std::string localhostUrl(const std::string& path)
+{
+    std::string url = serverUrl(path);
+    return url.replace(url.find("127.0.0.1"), strlen("127.0.0.1"), "localhost");
+}
+
+TEST_CASE(clientHedgesSlowRequests)
+{
+    HttpClient* client = HttpClient::getInstance();
+    client->enableHedging(true, 0.95, 50);
+
+    // the second copy goes to a fast endpoint and wins
+    HttpResponse::pointer response = fetch(makeHedged("/client/hedge-slow?delay=1500&body=slow", serverUrl("/client/hedge-fast?body=hedged")));
+    CHECK(response != nullptr && response->isSucceed() && bodyOf(response) == "hedged");
+    CHECK(serverHits("/client/hedge-fast?body=hedged") == 1);
+
+    client->enableHedging(false);
+}
+
+TEST_CASE(clientChargesHedgesAgainstTheHostLimit)
+{
+    HttpClient* client = HttpClient::getInstance();
+    client->enableHedging(true, 0.95, 50);
+    int perHost = client->getMaxConcurrentRequestsPerHost();
+    client->setMaxConcurrentRequestsPerHost(1);
+
+    // the original holds the host's only slot, so its hedge to the same host never starts
+    const char* path = "/client/hedge-capped?delay=1000&body=capped";
+    HttpResponse::pointer response = fetch(makeHedged(path));
+    CHECK(response != nullptr && response->isSucceed() && bodyOf(response) == "capped");
+    CHECK(serverHits(path) == 1);
+
+    client->setMaxConcurrentRequestsPerHost(perHost);
+    client->enableHedging(false);
+}
+
+TEST_CASE(clientChargesHedgesAgainstTheRateOfTheirHost)
+{
+    HttpClient* client = HttpClient::getInstance();
+    client->enableHedging(true, 0.95, 50);
+    const char* fast = "/client/hedge-rated?body=hedged";
+    std::string hedgeUrl = localhostUrl(fast);
+    std::string hedgeHost = HttpRequestScheduler::hostOf(hedgeUrl.c_str());
+    client->setHostRateLimit(hedgeHost, 0.2, 1);
+
+    // one token for the hedges' host: the first hedge takes it, the second original has to win on its own
+    HttpFuture<HttpResponse::pointer> first = client->sendAsync(makeHedged("/client/hedge-rated-1?delay=1000&body=slow", hedgeUrl));
+    HttpFuture<HttpResponse::pointer> second = client->sendAsync(makeHedged("/client/hedge-rated-2?delay=1000&body=slow", hedgeUrl));
+    CHECK(first.waitFor(5000) && second.waitFor(5000));
+    if (first.waitFor(0) && second.waitFor(0))
+    {
+        CHECK(first.get()->isSucceed() && second.get()->isSucceed());
+        CHECK((bodyOf(first.get()) == "hedged") != (bodyOf(second.get()) == "hedged"));
+    }
+    CHECK(serverHits(fast) == 1);
+
+    client->setHostRateLimit(hedgeHost, 0);
+    client->enableHedging(false);
+}
+
+// A GET for path retried up to maxAttempts times with a short backoff
+static HttpRequest::pointer makeRetried(const std::string& path, int maxAttempts)
+{
+    HttpRequest::pointer request = makeGet(path);
+    HttpRequest::RetryPolicy policy;
+    policy.maxAttempts = maxAttempts;
+    policy.baseDelayMs = 10;
+    request->setRetryPolicy(policy);
+    return request;
+}
+
+TEST_CASE(clientRetriesTransientFailures)
+{
+    // two 503s, then the answer
+    HttpRequest::pointer request = makeRetried("/client/retry?fail=2&body=done", 3);
+    HttpResponse::pointer response = fetch(request);
+    CHECK(response != nullptr && response->isSucceed() && bodyOf(response) == "done");
+    CHECK(request->getRetryCount() == 2);
+    CHECK(serverHits("/client/retry?fail=2&body=done") == 3);
+
+    // out of attempts, the last failure is the answer
+    HttpRequest::pointer exhausted = makeRetried("/client/retry-exhausted?fail=5", 3);
+    response = fetch(exhausted);
+    CHECK(response != nullptr && !response->isSucceed() && response->getResponseCode() == 503);
+    CHECK(serverHits("/client/retry-exhausted?fail=5") == 3);
+
+    // a status the policy doesn't list is final
+    response = fetch(makeRetried("/client/retry-final?status=404", 3));
+    CHECK(response != nullptr && response->getResponseCode() == 404);
+    CHECK(serverHits("/client/retry-final?status=404") == 1);
+}
+
+TEST_CASE(clientChargesRetryBudgetOnlyForRetriesMade)
+{
+    HttpClient* client = HttpClient::getInstance();
+    // retries are made while more than 3 of the 6 tokens are left, successes give nothing back
+    client->setRetryBudget(6, 0);
+
+    // one retry made, the second failure is final and costs nothing
+    HttpResponse::pointer response = fetch(makeRetried("/client/budget-exhausted?fail=5", 2));
+    CHECK(response != nullptr && !response->isSucceed());
+    CHECK(serverHits("/client/budget-exhausted?fail=5") == 2);
+
+    // 5 tokens left, so this failure is still retried
+    response = fetch(makeRetried("/client/budget-retried?fail=1&body=retried", 2));
+    CHECK(response != nullptr && response->isSucceed() && bodyOf(response) == "retried");
+    CHECK(serverHits("/client/budget-retried?fail=1&body=retried") == 2);
+
+    client->setRetryBudget(100, 0.1);
+}
+
+TEST_CASE(clientRunsCallbacksFromTheEventLoopExecutor)
+{
+    HttpClient* client = HttpClient::getInstance();
+    HttpEventLoopExecutor loop;
+    client->setCallbackExecutor(&loop);
+
+    std::atomic<int> calls(0);
+    std::thread::id callbackThread;
+    HttpRequest::pointer request = makeGet("/client/event-loop");
+    request->setResponseCallback([&calls, &callbackThread](HttpClient*, HttpResponse::pointer response) {
+        CHECK(response->isSucceed());
+        callbackThread = std::this_thread::get_id();
+        ++calls;
+    });
+    CHECK(client->sendAsynchronousRequest(request));
+
+    // the callback waits for the application's loop and runs on its thread
+    CHECK(waitUntil([]() { return serverHits("/client/event-loop") == 1; }));
+    CHECK(waitUntil([&loop, &calls]() {
+        loop.runPending();
+        return calls == 1;
+    }));
+    CHECK(callbackThread == std::this_thread::get_id());
+
+    client->setCallbackExecutor(nullptr);
+}
+
+TEST_CASE(clientRunsCallbacksOnTheThreadPoolExecutor)
+{
+    HttpClient* client = HttpClient::getInstance();
+
+    // without an executor the callbacks run on the network thread
+    std::thread::id networkThread;
+    HttpRequest::pointer request = makeGet("/client/thread-pool-network");
+    request->setResponseCallback([&networkThread](HttpClient*, HttpResponse::pointer) {
+        networkThread = std::this_thread::get_id();
+    });
+    CHECK(fetch(request) != nullptr);
+
+    std::mutex mutex;
+    std::vector<std::thread::id> callbackThreads;
+    {
+        HttpThreadPoolExecutor pool(2);
+        client->setCallbackExecutor(&pool);
+        for (int i = 0; i < 4; ++i)
+        {
+            request = makeGet("/client/thread-pool");
+            request->setResponseCallback([&mutex, &callbackThreads](HttpClient*, HttpResponse::pointer) {
+                std::lock_guard<std::mutex> lock(mutex);
+                callbackThreads.push_back(std::this_thread::get_id());
+            });
+            CHECK(client->sendAsynchronousRequest(request));
+        }
+        CHECK(waitUntil([&mutex, &callbackThreads]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return callbackThreads.size() == 4;
+        }));
+        // the pool runs what is left of the drain before it joins its threads
+        client->setCallbackExecutor(nullptr);
+    }
+
+    for (std::vector<std::thread::id>::iterator it = callbackThreads.begin(); it != callbackThreads.end(); ++it)
+    {
+        CHECK(*it != networkThread);
+        CHECK(*it != std::this_thread::get_id());
+    }
+}
+
+TEST_CASE(clientHandsResponsesToTheCompletionQueue)
+{
+    HttpClient* client = HttpClient::getInstance();
+    HttpCompletionQueue queue;
+    client->setCompletionQueue(&queue);
+    CHECK(queue.getFd() >= 0);
+
+    std::atomic<int> calls(0);
+    for (int i = 0; i < 3; ++i)
+    {
+        HttpRequest::pointer request = makeGet("/client/completion-queue");
+        request->setResponseCallback([&calls](HttpClient*, HttpResponse::pointer response) {
+            CHECK(response->isSucceed());
+            ++calls;
+        });
+        CHECK(client->sendAsynchronousRequest(request));
+    }
+
+    // the descriptor turns readable with the first response, the callbacks run from dispatch() only
+    struct pollfd fd = {queue.getFd(), POLLIN, 0};
+    CHECK(poll(&fd, 1, 5000) == 1);
+    CHECK(waitUntil([&queue, &calls]() {
+        queue.dispatch(HttpClient::getInstance());
+        return calls == 3;
+    }));
+
+    // and it's reset once everything is drained
+    std::vector<HttpResponse::pointer> responses;
+    CHECK(queue.drain(responses) == 0);
+    fd.revents = 0;
+    CHECK(poll(&fd, 1, 0) == 0);
+
+    client->setCompletionQueue(nullptr);
+}
@@ -0,0 +1,112 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include "HttpClient/HttpConcurrencyLimiter.h"
+#include "NetworkTests.h"
+
+using namespace network;
+
+TEST_CASE(limiterStartsHostsAtInitialLimit)
+{
+    HttpConcurrencyLimiter limiter(4, 1, 64);
+    CHECK(limiter.getInitialLimit() == 4);
+    CHECK(limiter.getLimit("a.test") == 4);
+
+    // the initial limit is kept within the bounds
+    HttpConcurrencyLimiter bounded(100, 2, 8);
+    CHECK(bounded.getInitialLimit() == 8);
+}
+
+TEST_CASE(limiterRaisesUsedLimitOnGoodResponses)
+{
+    HttpConcurrencyLimiter limiter(4, 1, 6);
+
+    // a host using half its limit or more earns about one more slot per round of responses
+    int limit = 4;
+    for (int i = 0; i < 4; ++i)
+    {
+        limit = limiter.onResponse("a.test", 10, false, 4);
+    }
+    CHECK(limit == 4);
+    for (int i = 0; i < 4; ++i)
+    {
+        limit = limiter.onResponse("a.test", 10, false, 4);
+    }
+    CHECK(limit == 5);
+    for (int i = 0; i < 100; ++i)
+    {
+        limit = limiter.onResponse("a.test", 10, false, 6);
+    }
+    CHECK(limit == 6);
+
+    // an idle host keeps its limit
+    for (int i = 0; i < 100; ++i)
+    {
+        limit = limiter.onResponse("b.test", 10, false, 1);
+    }
+    CHECK(limit == 4);
+}
+
+TEST_CASE(limiterBacksOffOncePerRound)
+{
+    HttpConcurrencyLimiter limiter(16, 2, 64, 0.5);
+
+    CHECK(limiter.onResponse("a.test", 10, true, 16) == 8);
+    // sent before that decrease, so no second one
+    CHECK(limiter.onResponse("a.test", 10, true, 16) == 8);
+    CHECK(limiter.getLimit("a.test") == 8);
+
+    // the floor holds whatever the failures
+    HttpConcurrencyLimiter floor(2, 2, 64, 0.5);
+    CHECK(floor.onResponse("a.test", 0, true, 2) == 2);
+}
+
+TEST_CASE(limiterTakesSlowResponsesForOverload)
+{
+    HttpConcurrencyLimiter limiter(16, 1, 64, 0.5, 2.0);
+    limiter.onResponse("a.test", 20, false, 0);
+    CHECK(limiter.getLimit("a.test") == 16);
+    CHECK(limiter.onResponse("a.test", 35, false, 0) == 16);
+    // over twice the 20 ms baseline
+    CHECK(limiter.onResponse("a.test", 100, false, 0) == 8);
+
+    // over twice a 2 ms baseline, but within the slack, jitter rather than overload
+    limiter.onResponse("b.test", 2, false, 0);
+    CHECK(limiter.onResponse("b.test", 11, false, 0) == 16);
+    CHECK(limiter.onResponse("b.test", 20, false, 0) == 8);
+}
+
+TEST_CASE(limiterClampsLimitsToNewMax)
+{
+    HttpConcurrencyLimiter limiter(8, 1, 64, 0.5);
+    limiter.onResponse("a.test", 10, false, 0);
+    CHECK(limiter.getLimit("a.test") == 8);
+
+    // lowering the cap, e.g. to the per host one, brings learned limits down with it
+    limiter.setMaxLimit(6);
+    CHECK(limiter.getLimit("a.test") == 6);
+    CHECK(limiter.getInitialLimit() == 6);
+    // so a backoff takes effect right away rather than from above the cap
+    CHECK(limiter.onResponse("a.test", 10, true, 6) == 3);
+}
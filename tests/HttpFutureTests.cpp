@@ -0,0 +1,178 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include <string>
+#include <thread>
+#include "HttpClient/HttpFuture.h"
+#include "NetworkTests.h"
+
+using namespace network;
+
+TEST_CASE(futureRunsContinuationsWithValue)
+{
+    HttpPromise<int> promise;
+    HttpFuture<int> future = promise.getFuture();
+    CHECK(future.isValid());
+    CHECK(!future.isReady());
+    CHECK(!future.waitFor(1));
+
+    HttpFuture<std::string> text = future.then([](const int& value) {
+        return std::to_string(value * 2);
+    });
+    CHECK(!text.isReady());
+
+    CHECK(promise.setValue(21));
+    CHECK(!promise.setValue(22));
+    CHECK(future.get() == 21);
+    CHECK(text.isReady());
+    CHECK(text.get() == "42");
+
+    // added once the value is there, runs right away
+    int seen = 0;
+    future.onReady([&seen](const int& value) {
+        seen = value;
+    });
+    CHECK(seen == 21);
+}
+
+TEST_CASE(futureThenWaitsForReturnedFuture)
+{
+    HttpPromise<int> first;
+    HttpPromise<int> second;
+    HttpFuture<int> chained = first.getFuture().then([second](const int& value) {
+        return second.getFuture().then([value](const int& next) {
+            return value + next;
+        });
+    });
+
+    first.setValue(1);
+    CHECK(!chained.isReady());
+    second.setValue(2);
+    CHECK(chained.isReady());
+    CHECK(chained.get() == 3);
+}
+
+TEST_CASE(futureInvalidNeverBecomesReady)
+{
+    HttpFuture<int> invalid;
+    CHECK(!invalid.isValid());
+    CHECK(!invalid.isReady());
+    CHECK(!invalid.waitFor(1));
+
+    bool ran = false;
+    invalid.onReady([&ran](const int&) {
+        ran = true;
+    });
+    HttpFuture<int> next = invalid.then([&ran](const int& value) {
+        ran = true;
+        return value;
+    });
+    CHECK(!ran);
+    CHECK(!next.isValid());
+
+    // get() has no value to wait for
+    bool threw = false;
+    try
+    {
+        invalid.get();
+    }
+    catch (const std::future_error& e)
+    {
+        threw = e.code() == std::make_error_code(std::future_errc::no_state);
+    }
+    CHECK(threw);
+}
+
+TEST_CASE(futureWhenAllKeepsInputOrder)
+{
+    CHECK(whenAll(std::vector<HttpFuture<int> >()).isReady());
+
+    std::vector<HttpPromise<int> > promises(3);
+    std::vector<HttpFuture<int> > futures;
+    for (size_t i = 0; i < promises.size(); ++i)
+    {
+        futures.push_back(promises[i].getFuture());
+    }
+    HttpFuture<std::vector<int> > all = whenAll(futures);
+
+    promises[2].setValue(30);
+    promises[0].setValue(10);
+    CHECK(!all.isReady());
+    promises[1].setValue(20);
+    CHECK(all.isReady());
+    const std::vector<int>& values = all.get();
+    CHECK(values.size() == 3 && values[0] == 10 && values[1] == 20 && values[2] == 30);
+}
+
+TEST_CASE(futureWhenAllGathersAcrossThreads)
+{
+    std::vector<HttpPromise<int> > promises(8);
+    std::vector<HttpFuture<int> > futures;
+    for (size_t i = 0; i < promises.size(); ++i)
+    {
+        futures.push_back(promises[i].getFuture());
+    }
+    HttpFuture<std::vector<int> > all = whenAll(futures);
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < promises.size(); ++i)
+    {
+        HttpPromise<int> promise = promises[i];
+        threads.push_back(std::thread([promise, i]() {
+            promise.setValue((int)i);
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+    CHECK(all.waitFor(1000));
+    int sum = 0;
+    for (size_t i = 0; i < all.get().size(); ++i)
+    {
+        sum += all.get()[i];
+    }
+    CHECK(sum == 28);
+}
+
+TEST_CASE(futureWhenAnyTakesFirstValue)
+{
+    CHECK(!whenAny(std::vector<HttpFuture<int> >()).isReady());
+
+    std::vector<HttpPromise<int> > promises(3);
+    std::vector<HttpFuture<int> > futures;
+    for (size_t i = 0; i < promises.size(); ++i)
+    {
+        futures.push_back(promises[i].getFuture());
+    }
+    futures.push_back(HttpFuture<int>());
+    HttpFuture<std::pair<size_t, int> > any = whenAny(futures);
+    CHECK(!any.isReady());
+
+    promises[1].setValue(20);
+    promises[0].setValue(10);
+    CHECK(any.isReady());
+    CHECK(any.get().first == 1);
+    CHECK(any.get().second == 20);
+}
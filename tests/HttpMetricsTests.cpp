@@ -0,0 +1,95 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include "HttpClient/HttpMetrics.h"
+#include "NetworkTests.h"
+
+using namespace network;
+
+typedef HttpMetrics::Histogram Histogram;
+
+static void record(Histogram& histogram, uint64_t value)
+{
+    ++histogram.count;
+    histogram.sum += value;
+    ++histogram.buckets[Histogram::bucketOf(value)];
+}
+
+TEST_CASE(histogramGivesSmallValuesTheirOwnBucket)
+{
+    for (uint64_t value = 0; value < HttpMetrics::SUB_BUCKETS; ++value)
+    {
+        CHECK(Histogram::bucketOf(value) == value);
+        CHECK(Histogram::bucketLowerBound((size_t)value) == value);
+    }
+    CHECK(Histogram::bucketOf(16) == 16);
+    CHECK(Histogram::bucketOf(31) == 31);
+    CHECK(Histogram::bucketOf(32) == 32);
+    CHECK(Histogram::bucketOf(33) == 32);
+}
+
+TEST_CASE(histogramBucketsStayWithinOneSixteenth)
+{
+    // every value lands in the bucket whose bounds surround it, buckets grow with their values
+    for (uint64_t value = 1; value < (1ULL << 36); value = value * 9 / 8 + 1)
+    {
+        size_t bucket = Histogram::bucketOf(value);
+        uint64_t lower = Histogram::bucketLowerBound(bucket);
+        uint64_t upper = Histogram::bucketLowerBound(bucket + 1);
+        CHECK(lower <= value && value < upper);
+        CHECK(upper - lower <= (lower < HttpMetrics::SUB_BUCKETS ? 1 : lower / HttpMetrics::SUB_BUCKETS));
+    }
+
+    // far beyond the range, the last bucket
+    CHECK(Histogram::bucketOf(~0ULL) == HttpMetrics::BUCKETS - 1);
+}
+
+TEST_CASE(histogramPercentiles)
+{
+    Histogram histogram;
+    CHECK(histogram.percentile(0.5) == 0);
+
+    for (uint64_t value = 1; value <= 100; ++value)
+    {
+        record(histogram, value);
+    }
+    CHECK(histogram.count == 100);
+    CHECK(histogram.sum == 5050);
+    // the middle of the bucket holding the sample of that rank
+    CHECK(histogram.percentile(0.5) == 51);
+    CHECK(histogram.percentile(0.99) == 98);
+    CHECK(histogram.percentile(1.0) == 102);
+    CHECK(histogram.percentile(0.0) == 1);
+    CHECK(histogram.percentile(0.9) <= histogram.percentile(0.99));
+
+    // a single outlier shows in the tail only
+    Histogram tail;
+    for (int i = 0; i < 999; ++i)
+    {
+        record(tail, 1000);
+    }
+    record(tail, 1000000);
+    CHECK_NEAR(tail.percentile(0.99), 1000, 1000 / HttpMetrics::SUB_BUCKETS);
+    CHECK_NEAR(tail.percentile(1.0), 1000000, 1000000 / HttpMetrics::SUB_BUCKETS);
+}
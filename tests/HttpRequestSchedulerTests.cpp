@@ -0,0 +1,202 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include "HttpClient/HttpRequestScheduler.h"
+#include "NetworkTests.h"
+
+using namespace network;
+
+typedef HttpRequestScheduler::TimePoint TimePoint;
+
+static HttpRequest::pointer makeRequest(const char* url, HttpRequest::Priority priority = HttpRequest::Priority::NORMAL)
+{
+    HttpRequest::pointer request = HttpRequest::create();
+    request->setUrl(url);
+    request->setPriority(priority);
+    return request;
+}
+
+TEST_CASE(schedulerStartsHigherPriorityFirst)
+{
+    HttpRequestScheduler scheduler;
+    HttpRequest::pointer normal = makeRequest("http://a.test/1");
+    HttpRequest::pointer background = makeRequest("http://a.test/2", HttpRequest::Priority::BACKGROUND);
+    HttpRequest::pointer high = makeRequest("http://b.test/1", HttpRequest::Priority::HIGH);
+    HttpRequest::pointer low = makeRequest("http://c.test/1", HttpRequest::Priority::LOW);
+    scheduler.push(normal);
+    scheduler.push(background);
+    scheduler.push(high);
+    scheduler.push(low);
+
+    CHECK(scheduler.size() == 4);
+    CHECK(scheduler.pop() == high);
+    CHECK(scheduler.pop() == normal);
+    CHECK(scheduler.pop() == low);
+    CHECK(scheduler.pop() == background);
+    CHECK(scheduler.pop() == nullptr);
+    CHECK(scheduler.empty());
+}
+
+TEST_CASE(schedulerRoundRobinsAcrossHosts)
+{
+    HttpRequestScheduler scheduler;
+    HttpRequest::pointer a1 = makeRequest("http://a.test/1");
+    HttpRequest::pointer a2 = makeRequest("http://a.test/2");
+    HttpRequest::pointer a3 = makeRequest("http://a.test/3");
+    HttpRequest::pointer b1 = makeRequest("http://b.test/1");
+    HttpRequest::pointer b2 = makeRequest("http://b.test/2");
+    HttpRequest::pointer c1 = makeRequest("http://C.test/1");
+    scheduler.push(a1);
+    scheduler.push(a2);
+    scheduler.push(a3);
+    scheduler.push(b1);
+    scheduler.push(b2);
+    scheduler.push(c1);
+
+    CHECK(scheduler.pop() == a1);
+    CHECK(scheduler.pop() == b1);
+    CHECK(scheduler.pop() == c1);
+    CHECK(scheduler.pop() == a2);
+    CHECK(scheduler.pop() == b2);
+    CHECK(scheduler.pop() == a3);
+    CHECK(scheduler.getInFlight("a.test") == 3);
+    CHECK(scheduler.getInFlight("c.test") == 1);
+}
+
+TEST_CASE(schedulerSkipsHostsAtTheirLimit)
+{
+    HttpRequestScheduler scheduler;
+    scheduler.setMaxPerHost(1);
+    HttpRequest::pointer a1 = makeRequest("http://a.test/1");
+    HttpRequest::pointer a2 = makeRequest("http://a.test/2");
+    HttpRequest::pointer b1 = makeRequest("http://b.test/1");
+    scheduler.push(a1);
+    scheduler.push(a2);
+    scheduler.push(b1);
+
+    CHECK(scheduler.pop() == a1);
+    CHECK(scheduler.pop() == b1);
+    CHECK(scheduler.pop() == nullptr);
+    scheduler.finished(a1);
+    CHECK(scheduler.pop() == a2);
+}
+
+TEST_CASE(schedulerCapsHostsWithoutOverrideAtDefaultLimit)
+{
+    HttpRequestScheduler scheduler;
+    scheduler.setDefaultHostLimit(2);
+    scheduler.setHostLimit("b.test", 3);
+    for (int i = 0; i < 4; ++i)
+    {
+        scheduler.push(makeRequest("http://a.test/"));
+        scheduler.push(makeRequest("http://b.test/"));
+    }
+
+    int started = 0;
+    while (scheduler.pop())
+    {
+        ++started;
+    }
+    CHECK(started == 5);
+    CHECK(scheduler.getInFlight("a.test") == 2);
+    CHECK(scheduler.getInFlight("b.test") == 3);
+}
+
+TEST_CASE(schedulerOrdersHostQueueByDeadline)
+{
+    HttpRequestScheduler scheduler;
+    TimePoint now = std::chrono::steady_clock::now();
+    HttpRequest::pointer first = makeRequest("http://a.test/first");
+    HttpRequest::pointer late = makeRequest("http://a.test/late");
+    late->setDeadline(now + std::chrono::milliseconds(500));
+    HttpRequest::pointer soon = makeRequest("http://a.test/soon");
+    soon->setDeadline(now + std::chrono::milliseconds(100));
+    HttpRequest::pointer last = makeRequest("http://a.test/last");
+    scheduler.push(first);
+    scheduler.push(late);
+    scheduler.push(soon);
+    scheduler.push(last);
+
+    CHECK(scheduler.nextDeadline() == soon->getDeadline());
+    CHECK(scheduler.pop() == soon);
+    CHECK(scheduler.pop() == late);
+    CHECK(scheduler.pop() == first);
+    CHECK(scheduler.pop() == last);
+}
+
+TEST_CASE(schedulerTakesExpiredRequests)
+{
+    HttpRequestScheduler scheduler;
+    TimePoint now = std::chrono::steady_clock::now();
+    HttpRequest::pointer expiring = makeRequest("http://a.test/1");
+    expiring->setDeadline(now + std::chrono::milliseconds(10));
+    HttpRequest::pointer open = makeRequest("http://a.test/2");
+    HttpRequest::pointer distant = makeRequest("http://b.test/1", HttpRequest::Priority::LOW);
+    distant->setDeadline(now + std::chrono::hours(1));
+    scheduler.push(expiring);
+    scheduler.push(open);
+    scheduler.push(distant);
+
+    std::vector<HttpRequest::pointer> expired;
+    scheduler.takeExpired(now, expired);
+    CHECK(expired.empty());
+
+    scheduler.takeExpired(now + std::chrono::seconds(1), expired);
+    CHECK(expired.size() == 1 && expired[0] == expiring);
+    CHECK(scheduler.size() == 2);
+    CHECK(scheduler.nextDeadline() == distant->getDeadline());
+    CHECK(scheduler.pop() == open);
+    CHECK(scheduler.pop() == distant);
+}
+
+TEST_CASE(schedulerAdmitsTransfersOutsideTheQueueWithinLimits)
+{
+    HttpRequestScheduler scheduler;
+    scheduler.setMaxPerHost(1);
+    TimePoint now = std::chrono::steady_clock::now();
+    std::string a = HttpRequestScheduler::hostOf("http://a.test/");
+    std::string b = HttpRequestScheduler::hostOf("http://b.test/");
+
+    // a.test is at its limit, b.test isn't
+    scheduler.push(makeRequest("http://a.test/1"));
+    CHECK(scheduler.pop() != nullptr);
+    CHECK(!scheduler.acquire(a, now));
+    CHECK(scheduler.acquire(b, now));
+    CHECK(scheduler.getInFlight(b) == 1);
+
+    // the slot taken outside the queue holds queued requests back until released
+    scheduler.push(makeRequest("http://b.test/queued"));
+    CHECK(scheduler.pop() == nullptr);
+    scheduler.release(b);
+    CHECK(scheduler.pop() != nullptr);
+
+    // a host out of tokens admits nothing, and takes nothing ahead of time
+    std::string c = HttpRequestScheduler::hostOf("http://c.test/");
+    scheduler.setHostRateLimit(c, 1, 1);
+    CHECK(scheduler.acquire(c, now));
+    scheduler.release(c);
+    CHECK(!scheduler.acquire(c, now));
+    CHECK(scheduler.getInFlight(c) == 0);
+    CHECK(scheduler.acquire(c, now + std::chrono::seconds(2)));
+}
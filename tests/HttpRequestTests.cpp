@@ -0,0 +1,73 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include <cstring>
+#include "HttpClient/HttpRequest.h"
+#include "NetworkTests.h"
+
+using namespace network;
+
+TEST_CASE(requestCopiesEveryProperty)
+{
+    HttpRequest request;
+    request.setRequestType(HttpRequest::Type::POST);
+    request.setUrl("http://request.test/copy");
+    request.setRequestData("data", 4);
+    request.setTag("tag");
+    request.setHeaders(std::vector<std::string>(1, "Accept: */*"));
+    request.setPriority(HttpRequest::Priority::HIGH);
+    request.setTimeoutMs(1500);
+    request.setHedgeUrl("http://mirror.test/copy");
+    request.setRetryCount(2);
+
+    HttpRequest copy(request);
+    CHECK(copy.getRequestType() == HttpRequest::Type::POST);
+    CHECK(strcmp(copy.getUrl(), "http://request.test/copy") == 0);
+    CHECK(copy.getRequestDataSize() == 4 && memcmp(copy.getRequestData(), "data", 4) == 0);
+    CHECK(strcmp(copy.getTag(), "tag") == 0);
+    CHECK(copy.getHeaders().size() == 1 && copy.getHeaders()[0] == "Accept: */*");
+    CHECK(copy.getPriority() == HttpRequest::Priority::HIGH);
+    CHECK(copy.getTimeoutMs() == 1500);
+    CHECK(strcmp(copy.getHedgeUrl(), "http://mirror.test/copy") == 0);
+    CHECK(copy.getRetryCount() == 2);
+    CHECK(!copy.isCancelled());
+}
+
+TEST_CASE(requestCopiesCancellation)
+{
+    HttpRequest request;
+    request.cancel();
+    HttpRequest copy(request);
+    CHECK(copy.isCancelled());
+
+    HttpRequest assigned;
+    CHECK(!assigned.isCancelled());
+    assigned = request;
+    CHECK(assigned.isCancelled());
+
+    // the copies are independent
+    assigned = HttpRequest();
+    CHECK(!assigned.isCancelled());
+    CHECK(request.isCancelled());
+}
@@ -0,0 +1,75 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include "HttpClient/HttpRetryBudget.h"
+#include "NetworkTests.h"
+
+using namespace network;
+
+TEST_CASE(retryBudgetStopsRetriesOnceHalfIsSpent)
+{
+    HttpRetryBudget budget(10, 0.5);
+    CHECK(budget.getTokens() == 10);
+    for (int i = 0; i < 4; ++i)
+    {
+        CHECK(budget.onFailure());
+    }
+    CHECK(!budget.onFailure());
+    CHECK(budget.getTokens() == 5);
+
+    // never below empty
+    for (int i = 0; i < 20; ++i)
+    {
+        budget.onFailure();
+    }
+    CHECK(budget.getTokens() == 0);
+}
+
+TEST_CASE(retryBudgetRefillsFromSuccesses)
+{
+    HttpRetryBudget budget(10, 0.5);
+    for (int i = 0; i < 6; ++i)
+    {
+        budget.onFailure();
+    }
+    CHECK(budget.getTokens() == 4);
+
+    // each success gives back its fraction of a token, up to the bucket size
+    for (int i = 0; i < 5; ++i)
+    {
+        budget.onSuccess();
+    }
+    CHECK(budget.getTokens() == 6.5);
+    CHECK(budget.onFailure());
+    for (int i = 0; i < 100; ++i)
+    {
+        budget.onSuccess();
+    }
+    CHECK(budget.getTokens() == 10);
+
+    budget.reset(4, 1);
+    CHECK(budget.getTokens() == 4);
+    CHECK(budget.onFailure());
+    CHECK(!budget.onFailure());
+}
@@ -0,0 +1,113 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include "HttpClient/HttpTimerWheel.h"
+#include "NetworkTests.h"
+
+using namespace network;
+
+typedef HttpTimerWheel::TimePoint TimePoint;
+
+TEST_CASE(timerWheelFiresTimersWhenDue)
+{
+    // the wheel's clock starts at construction, start is at or after it
+    HttpTimerWheel wheel(10, 8);
+    TimePoint start = std::chrono::steady_clock::now();
+    HttpRequest::pointer early = HttpRequest::create();
+    HttpRequest::pointer later = HttpRequest::create();
+    wheel.schedule(later, start + std::chrono::milliseconds(55));
+    wheel.schedule(early, start + std::chrono::milliseconds(25));
+    CHECK(wheel.size() == 2);
+    CHECK(wheel.nextDue() >= start + std::chrono::milliseconds(25));
+    CHECK(wheel.nextDue() < start + std::chrono::milliseconds(55));
+
+    std::vector<HttpRequest::pointer> due;
+    wheel.advance(start + std::chrono::milliseconds(15), due);
+    CHECK(due.empty());
+    wheel.advance(start + std::chrono::milliseconds(40), due);
+    CHECK(due.size() == 1 && due[0] == early);
+    wheel.advance(start + std::chrono::milliseconds(70), due);
+    CHECK(due.size() == 2 && due[1] == later);
+    CHECK(wheel.empty());
+    CHECK(wheel.nextDue() == TimePoint::max());
+}
+
+TEST_CASE(timerWheelKeepsTimersBeyondOneTurn)
+{
+    // 8 slots of 10 ms: a timer 200 ms away shares its slot with earlier ticks and waits for its turn
+    HttpTimerWheel wheel(10, 8);
+    TimePoint start = std::chrono::steady_clock::now();
+    HttpRequest::pointer distant = HttpRequest::create();
+    wheel.schedule(distant, start + std::chrono::milliseconds(200));
+    // ticks count from the wheel's clock, up to one tick ahead of start
+    CHECK(wheel.nextDue() > start + std::chrono::milliseconds(190));
+    CHECK(wheel.nextDue() <= start + std::chrono::milliseconds(210));
+
+    std::vector<HttpRequest::pointer> due;
+    for (int ms = 10; ms < 200; ms += 10)
+    {
+        wheel.advance(start + std::chrono::milliseconds(ms), due);
+    }
+    CHECK(due.empty());
+    CHECK(wheel.size() == 1);
+
+    // a jump of several turns at once still finds it
+    HttpRequest::pointer next = HttpRequest::create();
+    wheel.schedule(next, start + std::chrono::milliseconds(230));
+    wheel.advance(start + std::chrono::milliseconds(1000), due);
+    CHECK(due.size() == 2);
+    CHECK(wheel.empty());
+}
+
+TEST_CASE(timerWheelNeverFiresIntoThePast)
+{
+    HttpTimerWheel wheel(10, 8);
+    TimePoint start = std::chrono::steady_clock::now();
+    std::vector<HttpRequest::pointer> due;
+    wheel.advance(start + std::chrono::milliseconds(100), due);
+
+    // already due, fires on the next advance that moves past the current tick
+    HttpRequest::pointer overdue = HttpRequest::create();
+    wheel.schedule(overdue, start);
+    wheel.advance(start + std::chrono::milliseconds(100), due);
+    CHECK(due.empty());
+    wheel.advance(start + std::chrono::milliseconds(120), due);
+    CHECK(due.size() == 1 && due[0] == overdue);
+}
+
+TEST_CASE(timerWheelTakesCancelledTimers)
+{
+    HttpTimerWheel wheel(10, 8);
+    TimePoint start = std::chrono::steady_clock::now();
+    HttpRequest::pointer kept = HttpRequest::create();
+    HttpRequest::pointer cancelled = HttpRequest::create();
+    wheel.schedule(kept, start + std::chrono::milliseconds(30));
+    wheel.schedule(cancelled, start + std::chrono::milliseconds(30));
+    cancelled->cancel();
+
+    std::vector<HttpRequest::pointer> taken;
+    wheel.takeCancelled(taken);
+    CHECK(taken.size() == 1 && taken[0] == cancelled);
+    CHECK(wheel.size() == 1);
+}
@@ -0,0 +1,106 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "HttpClient/HttpTrace.h"
+#include "NetworkTests.h"
+
+using namespace network;
+
+static size_t countOf(const std::string& text, const std::string& pattern)
+{
+    size_t count = 0;
+    for (size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + 1))
+    {
+        ++count;
+    }
+    return count;
+}
+
+TEST_CASE(traceRecyclesRingsOfExitedThreads)
+{
+    HttpTrace::clear();
+    HttpTrace::enable(16);
+
+    // far more threads than rings, one after the other
+    for (int i = 0; i < 200; ++i)
+    {
+        std::thread thread([]() {
+            HttpTrace::instant("trace-short-lived");
+        });
+        thread.join();
+    }
+    HttpTrace::disable();
+
+    CHECK(HttpTrace::getDroppedEvents() == 0);
+    // the rings of the last threads still hold their events
+    std::string json = HttpTrace::toChromeJson();
+    CHECK(countOf(json, "\"name\":\"trace-short-lived\"") > 32);
+    HttpTrace::clear();
+}
+
+TEST_CASE(traceCountsEventsOfThreadsWithoutRing)
+{
+    HttpTrace::clear();
+    HttpTrace::enable(16);
+
+    // all alive at once, more of them than there are rings
+    int threadCount = 80;
+    std::mutex mutex;
+    std::condition_variable condition;
+    int recorded = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        threads.push_back(std::thread([&mutex, &condition, &recorded, threadCount]() {
+            HttpTrace::instant("trace-crowded");
+            std::unique_lock<std::mutex> lock(mutex);
+            ++recorded;
+            condition.notify_all();
+            condition.wait(lock, [&recorded, threadCount]() { return recorded == threadCount; });
+        }));
+    }
+    for (std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it)
+    {
+        it->join();
+    }
+
+    std::string json = HttpTrace::toChromeJson();
+    size_t kept = countOf(json, "\"name\":\"trace-crowded\"");
+    CHECK(kept <= 64);
+    CHECK(kept + HttpTrace::getDroppedEvents() == (size_t)threadCount);
+
+    // the rings are back for the next threads
+    std::thread late([]() {
+        HttpTrace::instant("trace-late");
+    });
+    late.join();
+    HttpTrace::disable();
+    CHECK(countOf(HttpTrace::toChromeJson(), "\"name\":\"trace-late\"") == 1);
+    HttpTrace::clear();
+}
@@ -0,0 +1,84 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include <cstring>
+#include <vector>
+#include "NetworkTests.h"
+
+namespace network_tests {
+
+struct TestCase
+{
+    const char*     name;
+    TestFunction    function;
+};
+
+// Function local, so registrars of any translation unit find it constructed
+static std::vector<TestCase>& testCases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+static int s_failures = 0;
+
+Registrar::Registrar(const char* name, TestFunction function)
+{
+    TestCase test = { name, function };
+    testCases().push_back(test);
+}
+
+void fail(const char* file, int line, const char* expression)
+{
+    fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+    ++s_failures;
+}
+
+}
+
+// Runs every case, or only those whose name contains argv[1]
+int main(int argc, char* argv[])
+{
+    using namespace network_tests;
+
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+    int run = 0;
+    int failed = 0;
+    std::vector<TestCase>& cases = testCases();
+    for (std::vector<TestCase>::iterator it = cases.begin(); it != cases.end(); ++it)
+    {
+        if (filter && !strstr(it->name, filter))
+        {
+            continue;
+        }
+        int failuresBefore = s_failures;
+        it->function();
+        ++run;
+        bool passed = s_failures == failuresBefore;
+        failed += passed ? 0 : 1;
+        printf("%-50s %s\n", it->name, passed ? "ok" : "FAILED");
+    }
+    printf("%d of %d test cases passed\n", run - failed, run);
+    return failed == 0 && run > 0 ? 0 : 1;
+}
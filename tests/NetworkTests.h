@@ -0,0 +1,60 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#ifndef __NETWORK_TESTS_H__
+#define __NETWORK_TESTS_H__
+
+// Minimal test harness of network_tests: TEST_CASE registers a function, CHECK records
+// a failure and goes on, so one run reports every broken expectation of a case.
+
+#include <cstdio>
+#include <cmath>
+
+namespace network_tests {
+
+typedef void (*TestFunction)();
+
+/** Add a test case to the run, done by TEST_CASE before main() */
+struct Registrar
+{
+    Registrar(const char* name, TestFunction function);
+};
+
+/** Report a failed expectation of the running case */
+void fail(const char* file, int line, const char* expression);
+
+}
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static network_tests::Registrar name##Registrar(#name, name); \
+    static void name()
+
+#define CHECK(expression) \
+    do { if (!(expression)) network_tests::fail(__FILE__, __LINE__, #expression); } while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) \
+    CHECK(std::fabs((double)(value) - (double)(expected)) <= (tolerance))
+
+#endif //__NETWORK_TESTS_H__
@@ -0,0 +1,199 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#include <map>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "benchmarks/LoopbackServer.h"
+#include "TestServer.h"
+
+using namespace network;
+
+namespace network_tests {
+
+static std::mutex                   s_hitsMutex;
+static std::map<std::string, int>   s_hits;
+
+// Value of name in the query string of path, empty if absent
+static std::string parameter(const std::string& path, const std::string& name)
+{
+    size_t query = path.find('?');
+    while (query != std::string::npos)
+    {
+        size_t begin = query + 1;
+        size_t end = path.find('&', begin);
+        std::string pair = path.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        if (pair.compare(0, name.size() + 1, name + "=") == 0)
+        {
+            return pair.substr(name.size() + 1);
+        }
+        query = end;
+    }
+    return "";
+}
+
+static void answer(const LoopbackServer::Request& request, LoopbackServer::Reply& reply)
+{
+    int hits = 0;
+    {
+        std::lock_guard<std::mutex> lock(s_hitsMutex);
+        hits = ++s_hits[request.path];
+    }
+
+    std::string body = parameter(request.path, "body");
+    reply.body = body.empty() ? request.path : body;
+    reply.filler = (size_t)atol(parameter(request.path, "size").c_str());
+    reply.delayMs = atol(parameter(request.path, "delay").c_str());
+    std::string status = parameter(request.path, "status");
+    if (!status.empty())
+    {
+        reply.status = atoi(status.c_str());
+    }
+    if (hits <= atoi(parameter(request.path, "fail").c_str()))
+    {
+        reply.status = 503;
+    }
+
+    std::string maxAge = parameter(request.path, "maxAge");
+    std::string etag = parameter(request.path, "etag");
+    if (!etag.empty())
+    {
+        etag = "\"" + etag + "\"";
+        reply.headers.append("ETag: ").append(etag).append("\r\n");
+        if (request.field("If-None-Match") == etag)
+        {
+            reply.status = 304;
+            reply.body.clear();
+            reply.filler = 0;
+            maxAge = parameter(request.path, "notModifiedMaxAge");
+        }
+    }
+    if (!maxAge.empty())
+    {
+        reply.headers.append("Cache-Control: max-age=").append(maxAge).append("\r\n");
+    }
+}
+
+static LoopbackServer& server()
+{
+    static LoopbackServer* server = nullptr;
+    if (!server)
+    {
+#ifdef _WIN32
+        WSADATA wsa;
+        WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+        // never stopped, connections the client keeps alive stay open until the process ends
+        server = new LoopbackServer();
+        server->setHandler(answer);
+        if (!server->start())
+        {
+            fprintf(stderr, "could not listen on 127.0.0.1\n");
+            exit(1);
+        }
+    }
+    return *server;
+}
+
+std::string serverUrl(const std::string& path)
+{
+    return server().url(path);
+}
+
+int serverHits(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(s_hitsMutex);
+    std::map<std::string, int>::iterator it = s_hits.find(path);
+    return it == s_hits.end() ? 0 : it->second;
+}
+
+bool waitUntil(const std::function<bool()>& condition, long timeoutMs)
+{
+    std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() >= until)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+HttpResponse::pointer fetch(HttpRequest::pointer request, long timeoutMs)
+{
+    HttpFuture<HttpResponse::pointer> response = HttpClient::getInstance()->sendAsync(request);
+    return response.waitFor(timeoutMs) ? response.get() : nullptr;
+}
+
+HttpRequest::pointer makeGet(const std::string& path)
+{
+    HttpRequest::pointer request = HttpRequest::create();
+    request->setUrl(serverUrl(path).c_str());
+    request->setRequestType(HttpRequest::Type::GET);
+    return request;
+}
+
+std::string bodyOf(HttpResponse::pointer response)
+{
+    std::shared_ptr<const std::vector<char> > data = response->getSharedResponseData();
+    return std::string(data->begin(), data->end());
+}
+
+std::vector<std::string> listFiles(const std::string& directory, const char* extension)
+{
+    std::vector<std::string> names;
+    DIR* dir = opendir(directory.c_str());
+    if (dir)
+    {
+        size_t length = strlen(extension);
+        struct dirent* item;
+        while ((item = readdir(dir)) != nullptr)
+        {
+            std::string name(item->d_name);
+            if (name.size() > length && name.compare(name.size() - length, length, extension) == 0)
+            {
+                names.push_back(name);
+            }
+        }
+        closedir(dir);
+    }
+    return names;
+}
+
+void clearDirectory(const std::string& directory)
+{
+    mkdir(directory.c_str(), 0755);
+    std::vector<std::string> names = listFiles(directory, "");
+    for (std::vector<std::string>::iterator it = names.begin(); it != names.end(); ++it)
+    {
+        if (*it != "." && *it != "..")
+        {
+            remove((directory + "/" + *it).c_str());
+        }
+    }
+}
+
+}
@@ -0,0 +1,74 @@
+/****************************************************************************
+ Copyright (c) 2014-2015 libo
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+
+
+#ifndef __TEST_SERVER_H__
+#define __TEST_SERVER_H__
+
+// Loopback server shared by the client tests, started on first use. What it answers
+// depends on the query string of the path, e.g. /name?maxAge=60&etag=v1:
+//   body=<text>    response body, the path itself by default
+//   size=<n>       n more bytes of body
+//   status=<code>  status of the response, 200 by default
+//   fail=<n>       503 to the first n requests for the path
+//   delay=<ms>     wait before answering
+//   maxAge=<s>     Cache-Control: max-age
+//   etag=<tag>     ETag, a request with a matching If-None-Match gets a 304
+//   notModifiedMaxAge=<s>  Cache-Control: max-age of that 304, none by default
+// Tests use paths of their own, the hit counts are per path.
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include "HttpClient/HttpClient.h"
+
+namespace network_tests {
+
+/** Url of path on the shared loopback server */
+std::string serverUrl(const std::string& path);
+
+/** Requests the server got for path, query string included */
+int serverHits(const std::string& path);
+
+/** Wait until condition holds or timeoutMs passed, returns whether it holds */
+bool waitUntil(const std::function<bool()>& condition, long timeoutMs = 5000);
+
+/** Send request asynchronously and wait for its response, null if none came within timeoutMs */
+network::HttpResponse::pointer fetch(network::HttpRequest::pointer request, long timeoutMs = 5000);
+
+/** A GET request for path on the shared server */
+network::HttpRequest::pointer makeGet(const std::string& path);
+
+/** Body of a response as a string */
+std::string bodyOf(network::HttpResponse::pointer response);
+
+/** Names of the files in directory ending with extension */
+std::vector<std::string> listFiles(const std::string& directory, const char* extension);
+
+/** Create directory if missing and delete the files in it */
+void clearDirectory(const std::string& directory);
+
+}
+
+#endif //__TEST_SERVER_H__